@@ -321,6 +321,22 @@ PyObject *_get_farfield(meep::dft_near2far *f, const meep::vec & v) {
     return res;
 }
 
+// Return a numpy array that takes ownership of (rather than copying) the data of a
+// new[]-allocated C++ array, which is delete[]d when the numpy array is garbage-collected
+template<typename T>
+static void _delete_array_capsule(PyObject *cap) {
+    delete[] (T *)PyCapsule_GetPointer(cap, NULL);
+}
+
+template<typename T>
+static PyObject *_array_from_owned_data(T *data, int rank, npy_intp *dims, int typenum) {
+    // Return value: New reference
+    PyObject *py_arr = PyArray_SimpleNewFromData(rank, dims, typenum, data);
+    PyObject *cap = PyCapsule_New(data, NULL, _delete_array_capsule<T>);
+    PyArray_SetBaseObject((PyArrayObject *)py_arr, cap);
+    return py_arr;
+}
+
 // Wrapper around meep::dft_near2far::get_farfields_array
 PyObject *_get_farfields_array(meep::dft_near2far *n2f, const meep::volume &where,
                                double resolution) {
@@ -344,11 +360,9 @@ PyObject *_get_farfields_array(meep::dft_near2far *n2f, const meep::volume &wher
         arr_dims[i] = dims[i - 1];
     }
 
-    PyObject *py_arr = PyArray_SimpleNew(rank, arr_dims, NPY_DOUBLE);
-    memcpy(PyArray_DATA((PyArrayObject*)py_arr), EH, sizeof(double) * 2 * N * 6 * n2f->freq.size());
+    PyObject *py_arr = _array_from_owned_data(EH, rank, arr_dims, NPY_DOUBLE);
 
     delete[] arr_dims;
-    delete[] EH;
     return py_arr;
 
 }
@@ -425,26 +439,18 @@ PyObject *_get_dft_array(meep::fields *f, dft_type dft, meep::component c, int n
     std::complex<double> *dft_arr = f->get_dft_array(dft, c, num_freq, &rank, dims);
 
     if (dft_arr==NULL){ // this can happen e.g. if component c vanishes by symmetry
-     std::complex<double> d[1] = {std::complex<double>(0,0)};
-     return PyArray_SimpleNewFromData(0, 0, NPY_CDOUBLE, d);
+     dft_arr = new std::complex<double>[1];
+     dft_arr[0] = 0;
+     rank = 0;
     }
 
-    if (rank == 0) // singleton results
-     return PyArray_SimpleNewFromData(0, 0, NPY_CDOUBLE, dft_arr);
-
-    size_t length = 1;
-    npy_intp *arr_dims = new npy_intp[rank];
-    for (int i = 0; i < rank; ++i) {
+    // rank == 0 for singleton results
+    npy_intp arr_dims[3];
+    for (int i = 0; i < rank; ++i)
         arr_dims[i] = dims[i];       // implicit size_t -> int cast, presumed safe for individual array dimensions
-        length *= dims[i];
-    }
 
-    PyObject *py_arr = PyArray_SimpleNew(rank, arr_dims, NPY_CDOUBLE);
-    memcpy(PyArray_DATA((PyArrayObject*)py_arr), dft_arr, sizeof(std::complex<double>) * length);
-    delete[] dft_arr;
-    if (arr_dims) delete[] arr_dims;
-
-    return py_arr;
+    // the numpy array is a view of dft_arr (no copy), which it now owns
+    return _array_from_owned_data(dft_arr, rank, arr_dims, NPY_CDOUBLE);
 }
 
 size_t _get_dft_data_size(meep::dft_chunk *dc) {
@@ -453,6 +459,7 @@ size_t _get_dft_data_size(meep::dft_chunk *dc) {
 }
 
 void _get_dft_data(meep::dft_chunk *dc, std::complex<double> *cdata, int size) {
+    meep::flush_dfts(dc);
     size_t istart;
     size_t n = meep::dft_chunks_Ntotal(dc, &istart) / 2;
     istart /= 2;
@@ -464,13 +471,14 @@ void _get_dft_data(meep::dft_chunk *dc, std::complex<double> *cdata, int size) {
     for (meep::dft_chunk *cur = dc; cur; cur = cur->next_in_dft) {
         size_t Nchunk = cur->N * cur->omega.size();
         for (size_t i = 0; i < Nchunk; ++i) {
-            cdata[i + istart] = cur->dft[i];
+            cdata[i + istart] = cur->dft_value(i);
         }
         istart += Nchunk;
     }
 }
 
 void _load_dft_data(meep::dft_chunk *dc, std::complex<double> *cdata, int size) {
+    meep::flush_dfts(dc);
     size_t istart;
     size_t n = meep::dft_chunks_Ntotal(dc, &istart) / 2;
     istart /= 2;
@@ -482,7 +490,7 @@ void _load_dft_data(meep::dft_chunk *dc, std::complex<double> *cdata, int size)
     for (meep::dft_chunk *cur = dc; cur; cur = cur->next_in_dft) {
         size_t Nchunk = cur->N * cur->omega.size();
         for (size_t i = 0; i < Nchunk; ++i) {
-            cur->dft[i] = cdata[i + istart];
+            cur->set_dft_value(i, cdata[i + istart]);
         }
         istart += Nchunk;
     }
@@ -561,6 +569,34 @@ PyObject *_get_array_slice_dimensions(meep::fields *f, const meep::volume &where
     return rval;
 }
 
+// Wrapper around meep::fields::get_array_slice_boxes: a list of (start, array) pairs,
+// one for each block of the slice (of rank `rank`) computed on this process, where the
+// numpy array takes ownership of (rather than copying) the data of the block
+PyObject *_get_array_slice_boxes(meep::fields *f, const meep::volume &where, int c, int rank,
+                                 double frequency, bool snap, bool cmplx) {
+    // Return value: New reference
+    std::vector<meep::array_slice_box> boxes;
+    if (meep::is_derived(c))
+        boxes = f->get_array_slice_boxes(where, meep::derived_component(c), frequency, snap);
+    else
+        boxes = f->get_array_slice_boxes(where, meep::component(c), frequency, snap, cmplx);
+    cmplx = cmplx && !meep::is_derived(c);
+
+    PyObject *res = PyList_New(boxes.size());
+    for (size_t n = 0; n < boxes.size(); ++n) {
+        npy_intp dims[3];
+        PyObject *py_start = PyTuple_New(rank);
+        for (int i = 0; i < rank; ++i) {
+            dims[i] = boxes[n].count[i];
+            PyTuple_SetItem(py_start, i, PyInteger_FromLong(boxes[n].start[i]));
+        }
+        PyObject *py_arr = _array_from_owned_data(boxes[n].data, rank, dims,
+                                                  cmplx ? NPY_CDOUBLE : NPY_DOUBLE);
+        PyList_SetItem(res, n, Py_BuildValue("(NN)", py_start, py_arr));
+    }
+    return res;
+}
+
 #ifdef HAVE_MPB
 meep::eigenmode_data *_get_eigenmode(meep::fields *f, double frequency, meep::direction d, const meep::volume where,
                                      const meep::volume eig_vol, int band_num, const meep::vec &_kpoint,
@@ -1006,6 +1042,15 @@ void _get_gradient(PyObject *grad, PyObject *fields_a, PyObject *fields_f, PyObj
     $1 = (size_t *)array_data($input);
 }
 
+// element strides of a (possibly non-contiguous) slice array, as a numpy array of np.intp
+%typecheck(SWIG_TYPECHECK_POINTER, fragment="NumPy_Fragments") const ptrdiff_t *strides {
+    $1 = is_array($input) || $input == Py_None;
+}
+
+%typemap(in, fragment="NumPy_Macros") const ptrdiff_t *strides {
+    $1 = $input == Py_None ? NULL : (ptrdiff_t *)array_data($input);
+}
+
 %typecheck(SWIG_TYPECHECK_POINTER, fragment="NumPy_Fragments") double* slice {
     $1 = is_array($input);
 }
@@ -1473,6 +1518,7 @@ void _get_gradient(PyObject *grad, PyObject *fields_a, PyObject *fields_f, PyObj
 %ignore is_medium;
 %ignore is_metal;
 %ignore meep::infinity;
+%ignore meep::fields::get_array_slice_boxes; // see _get_array_slice_boxes
 
 %ignore std::vector<meep::volume>::vector(size_type);
 %ignore std::vector<meep::volume>::resize;
@@ -1595,6 +1641,8 @@ kpoint_list get_eigenmode_coefficients_and_kpoints(meep::fields *f, meep::dft_fl
 PyObject *_get_array_slice_dimensions(meep::fields *f, const meep::volume &where, size_t dims[3],
                                       bool collapse_empty_dimensions, bool snap_empty_dimensions,
                                       meep::component cgrid = Centered, PyObject *min_max_loc = NULL);
+PyObject *_get_array_slice_boxes(meep::fields *f, const meep::volume &where, int c, int rank,
+                                 double frequency, bool snap, bool cmplx);
 
 %ignore eps_func;
 %ignore inveps_func;
@@ -1856,6 +1904,7 @@ meep::structure *create_structure_and_set_materials(vector3 cell_size,
                                                     meep_geom::absorber_list alist,
                                                     meep_geom::material_type_list extra_materials,
                                                     bool split_chunks_evenly,
+                                                    bool split_chunks_hilbert,
                                                     bool set_materials,
                                                     meep::structure *existing_s,
                                                     bool output_chunk_costs,
@@ -1872,6 +1921,7 @@ meep::structure *create_structure_and_set_materials(vector3 cell_size,
     meep_geom::fragment_stats::resolution = gv.a;
     meep_geom::fragment_stats::dims = gv.dim;
     meep_geom::fragment_stats::split_chunks_evenly = split_chunks_evenly;
+    meep_geom::fragment_stats::split_chunks_hilbert = split_chunks_hilbert;
     meep_geom::init_libctl(_default_material, _ensure_periodicity,
                            &gv, cell_size, center, &gobj_list);
 
@@ -1928,6 +1978,7 @@ meep::structure *create_structure_and_set_materials(vector3 cell_size,
     // Return params to default state
     meep_geom::fragment_stats::resolution = 0;
     meep_geom::fragment_stats::split_chunks_evenly = false;
+    meep_geom::fragment_stats::split_chunks_hilbert = false;
 
     return s;
 }
@@ -761,6 +761,10 @@ class DftFields(DftObj):
     def chunks(self):
         return self.swigobj_attr('chunks')
 
+    @property
+    def stride(self):
+        return self.swigobj_attr('stride')
+
 
 Mode = namedtuple('Mode', ['freq', 'decay', 'Q', 'amp', 'err'])
 
@@ -963,8 +967,15 @@ class Simulation(object):
                  geometry_center=mp.Vector3(),
                  force_all_components=False,
                  split_chunks_evenly=True,
+                 split_chunks_hilbert=False,
                  chunk_layout=None,
-                 collect_stats=False):
+                 collect_stats=False,
+                 dft_decimation=1,
+                 dft_single_precision=False,
+                 async_output=False,
+                 output_compression=0,
+                 output_compression_tolerance=0,
+                 structure_cache_dir=None):
         """
         All `Simulation` attributes are described in further detail below. In brackets
         after each variable is the type of value that it should hold. The classes, complex
@@ -1192,6 +1203,62 @@ class Simulation(object):
           the exception of PML regions, which must be on their own chunk). When `False`,
           Meep attempts to allocate an equal amount of work to each processor, which can
           increase the performance of [parallel simulations](Parallel_Meep.md).
+
+        + **`split_chunks_hilbert` [`boolean`]** — When `True`, the cell is divided among
+          the processors by cutting a [Hilbert curve](https://en.wikipedia.org/wiki/Hilbert_curve)
+          through a coarse grid of the cell into pieces of equal work (as determined by
+          `split_chunks_evenly`), instead of by recursive bisection. Each processor then
+          gets a compact region made up of several chunks, for any number of processors.
+          Defaults to `False`.
+
+        + **`dft_decimation` [`integer`]** — When greater than 1, the Fourier transforms of
+          the flux, energy, force, near-to-far, and DFT-field monitors are accumulated
+          only every `dft_decimation` timesteps, which reduces their cost proportionally.
+          When `0`, each monitor uses the largest factor for which the fields at its
+          frequencies are not corrupted by aliasing, given the bandwidth of the
+          sources (falling back to 1 with custom sources or nonlinear materials). Defaults
+          to 1 (no decimation).
+
+        + **`dft_single_precision` [`boolean`]** — When `True`, the Fourier-transformed
+          fields of all DFT monitors are stored in single precision, which halves their
+          memory. Each update (or batch of updates with `fields.set_dft_batch_size`) is
+          computed in double precision and then added to the single-precision sums, so the
+          roundoff error grows with the number of batches: for the ring resonator of
+          `tests/dft-fields.cpp` (4000 timesteps), the relative error compared to double
+          precision is about 1e-6, or 3e-7 and 1e-7 with batches of 10 and 100 timesteps.
+          Defaults to `False`.
+
+        + **`async_output` [`boolean`]** — When `True`, HDF5 output of the fields (e.g.
+          `output_efield` at every step of a movie) is written by a background thread:
+          the output functions only copy the fields into a staging buffer and return,
+          and the simulation waits only if more than 1 GB of output is not yet written.
+          The output is flushed at the end of `run`, before the output files are
+          passed to `output_h5_hook` (e.g. for `output_png`), when the fields are
+          destroyed, and before any other access to an HDF5 file. Only supported for
+          serial (single-process) runs: a `ValueError` is raised with MPI. Defaults to `False`.
+
+        + **`output_compression` [`integer`]** — If positive, the HDF5 datasets of the
+          fields output (e.g. `output_efield`, including appended movies) are stored in
+          chunks compressed with the shuffle and deflate (gzip) filters at this level
+          (1–9). The files are read by any HDF5 tool as usual. Defaults to 0 (no
+          compression).
+
+        + **`output_compression_tolerance` [`number`]** — If positive (which requires a
+          positive `output_compression`), the output fields are first rounded to
+          multiples of a power of two, with an absolute error of at most this value, so
+          that they compress several times better (e.g. 5x for a tolerance of $10^{-3}$ of the
+          maximum field, compared to about 1.4x for lossless compression). Defaults to 0
+          (lossless).
+
+        + **`structure_cache_dir` [`string`]** — If not `None`, the initialized structure
+          (the subpixel-averaged $\\varepsilon$ and $\\mu$ and the susceptibilities) is saved
+          to an HDF5 file in this directory, whose name is a hash of the geometry,
+          materials, resolution, and symmetries. A later simulation with the same
+          inputs (e.g. a rerun, a sweep over the sources, or a run on a different
+          number of processes) loads this file instead of repeating the subpixel
+          averaging. Geometries with
+          user-defined material functions, nonlinear or conductive materials, absorbers,
+          or multilevel atoms are not cached. Defaults to `None`.
         """
 
         self.cell_size = Vector3(*cell_size)
@@ -1237,8 +1304,19 @@ class Simulation(object):
         self._is_initialized = False
         self.force_all_components = force_all_components
         self.split_chunks_evenly = split_chunks_evenly
+        self.split_chunks_hilbert = split_chunks_hilbert
         self.chunk_layout = chunk_layout
         self.collect_stats = collect_stats
+        self.dft_decimation = dft_decimation
+        self.dft_single_precision = dft_single_precision
+        self.async_output = async_output
+        if async_output and mp.count_processors() > 1:
+            raise ValueError("async_output is only supported for serial (single-process) runs")
+        self.output_compression = output_compression
+        self.output_compression_tolerance = output_compression_tolerance
+        if output_compression_tolerance > 0 and not output_compression:
+            raise ValueError("output_compression_tolerance requires output_compression > 0")
+        self.structure_cache_dir = structure_cache_dir
         self.fragment_stats = None
         self._output_stats = os.environ.get('MEEP_STATS', None)
 
@@ -1671,6 +1749,7 @@ class Simulation(object):
         self.absorber_vols = fragment_vols[4]
         self.gv = gv
 
+        mp.set_structure_cache_directory(self.structure_cache_dir)
         self.structure = mp.create_structure_and_set_materials(
             self.cell_size,
             self.dft_data_list,
@@ -1693,6 +1772,7 @@ class Simulation(object):
             absorbers,
             self.extra_materials,
             self.split_chunks_evenly,
+            self.split_chunks_hilbert,
             False if self.chunk_layout and not isinstance(self.chunk_layout,mp.BinaryPartition) else True,
             None,
             True if self._output_stats is not None else False,
@@ -1845,6 +1925,7 @@ class Simulation(object):
             absorbers,
             self.extra_materials,
             self.split_chunks_evenly,
+            self.split_chunks_hilbert,
             True,
             self.structure,
             False,
@@ -1868,6 +1949,29 @@ class Simulation(object):
             raise ValueError("Fields must be initialized before calling load_structure")
         self.structure.load(fname)
 
+    def dump_fields(self, fname):
+        """
+        Dumps the fields at the current time to the file `fname`, including the auxiliary
+        PML fields, the polarization of dispersive materials, and the accumulated DFT fields
+        of all flux, energy, force, near-to-far, and DFT-field monitors, as a checkpoint from
+        which the simulation can be continued with `load_fields`.
+        """
+        if self.fields is None:
+            raise ValueError("Fields must be initialized before calling dump_fields")
+        self.fields.dump(fname)
+
+    def load_fields(self, fname):
+        """
+        Loads the fields from the file `fname` (created by `dump_fields`), and sets the
+        current time to the time of the dump, so that running the simulation continues
+        exactly where the dumped simulation was. The `Simulation` must have the same
+        chunks and materials as the dumped one, and the same monitors (added in the same
+        order) before calling `load_fields`; the sources are not stored in the file and
+        must be the same.
+        """
+        self.init_sim()
+        self.fields.load(fname)
+
     def dump_chunk_layout(self, fname):
         """
         Dumps the chunk layout to file `fname`.
@@ -1936,6 +2040,16 @@ class Simulation(object):
             v = Vector3(self.k_point.x, self.k_point.y) if self.special_kz else self.k_point
             self.fields.use_bloch(py_v3_to_vec(self.dimensions, v, self.is_cylindrical))
 
+        if self.dft_decimation != 1:
+            self.fields.set_dft_decimation(self.dft_decimation)
+        if self.dft_single_precision:
+            self.fields.set_dft_single_precision(True)
+        if self.async_output:
+            self.fields.set_output_async(True)
+        if self.output_compression:
+            self.fields.set_output_compression(self.output_compression,
+                                               self.output_compression_tolerance)
+
         self.add_sources()
 
         for hook in self.init_sim_hooks:
@@ -2402,7 +2516,7 @@ class Simulation(object):
 
     def add_dft_fields(self, *args, **kwargs):
         """
-        `add_dft_fields(cs, fcen, df, nfreq, freq, where=None, center=None, size=None, yee_grid=False)` ##sig
+        `add_dft_fields(cs, fcen, df, nfreq, freq, where=None, center=None, size=None, yee_grid=False, stride=1)` ##sig
 
         Given a list of field components `cs`, compute the Fourier transform of these
         fields for `nfreq` equally spaced frequencies covering the frequency range
@@ -2412,7 +2526,12 @@ class Simulation(object):
         default routine interpolates the Fourier transformed fields at the center of each
         voxel within the specified volume. Alternatively, the exact Fourier transformed
         fields evaluated at each corresponding Yee grid point is available by setting
-        `yee_grid` to `True`.
+        `yee_grid` to `True`. If `stride` is greater than 1, the Fourier transform is
+        only computed and stored at every `stride`-th grid point (in each non-empty
+        direction of the volume, starting at its first grid point), which reduces the
+        memory and time for large volumes when only a coarser grid is needed (e.g. for
+        visualization). The arrays from `get_dft_array` and `output_dft` are then on the
+        coarser grid, as is the metadata from `get_array_metadata(dft_cell=...)`.
         """
         components = args[0]
         args = fix_dft_args(args, 1)
@@ -2421,21 +2540,22 @@ class Simulation(object):
         center = kwargs.get('center', None)
         size = kwargs.get('size', None)
         yee_grid = kwargs.get('yee_grid', False)
+        stride = kwargs.get('stride', 1)
         center_v3 = Vector3(*center) if center is not None else None
         size_v3 = Vector3(*size) if size is not None else None
         use_centered_grid = not yee_grid
-        dftf = DftFields(self._add_dft_fields, [components, where, center_v3, size_v3, freq, use_centered_grid])
+        dftf = DftFields(self._add_dft_fields, [components, where, center_v3, size_v3, freq, use_centered_grid, stride])
         self.dft_objects.append(dftf)
         return dftf
 
-    def _add_dft_fields(self, components, where, center, size, freq, use_centered_grid):
+    def _add_dft_fields(self, components, where, center, size, freq, use_centered_grid, stride):
         if self.fields is None:
             self.init_sim()
         try:
             where = self._volume_from_kwargs(where, center, size)
         except ValueError:
             where = self.fields.total_volume()
-        return self.fields.add_dft_fields(components, where, freq, use_centered_grid)
+        return self.fields.add_dft_fields(components, where, freq, use_centered_grid, stride)
 
     def output_dft(self, dft_fields, fname):
         """
@@ -2461,7 +2581,7 @@ class Simulation(object):
 
     def add_near2far(self, *args, **kwargs):
         """
-        `add_near2far(fcen, df, nfreq, freq, Near2FarRegions..., nperiods=1)`  ##sig
+        `add_near2far(fcen, df, nfreq, freq, Near2FarRegions..., nperiods=1, lattice_sum=False)`  ##sig
 
         Add a bunch of `Near2FarRegion`s to the current simulation (initializing the
         fields if they have not yet been initialized), telling Meep to accumulate the
@@ -2474,14 +2594,19 @@ class Simulation(object):
         freq = args[0]
         near2fars = args[1:]
         nperiods = kwargs.get('nperiods', 1)
-        n2f = DftNear2Far(self._add_near2far, [freq, nperiods, near2fars])
+        lattice_sum = kwargs.get('lattice_sum', False)
+        n2f = DftNear2Far(self._add_near2far, [freq, nperiods, near2fars, lattice_sum])
         self.dft_objects.append(n2f)
         return n2f
 
-    def _add_near2far(self, freq, nperiods, near2fars):
+    def _add_near2far(self, freq, nperiods, near2fars, lattice_sum=False):
         if self.fields is None:
             self.init_sim()
-        return self._add_fluxish_stuff(self.fields.add_dft_near2far, freq, near2fars, nperiods)
+        # nperiods > 1 is what tells add_dft_near2far which directions are periodic
+        n2f = self._add_fluxish_stuff(self.fields.add_dft_near2far, freq, near2fars,
+                                      max(nperiods, 2) if lattice_sum else nperiods)
+        n2f.lattice_sum = lattice_sum
+        return n2f
 
     def add_energy(self, *args):
         """
@@ -2628,6 +2753,13 @@ class Simulation(object):
         nx&#215;ny&#215;nz&#215;nfreq 4d array of space&#215;frequency although dimensions
         that =1 are omitted. The volume can optionally be specified via `center` and
         `size`.
+
+        If `where` is a plane (or, in 2d, a line) parallel to planar near-field
+        surfaces, the far fields are computed with FFT convolutions of the Green's
+        function on a lattice aligned with the FDTD grid, interpolated to the output
+        grid, whenever that is estimated to be faster than the direct sum over all
+        pairs of near- and far-field points. The two methods agree to about $10^{-6}$
+        relative error or better.
         """
         if self.fields is None:
             self.init_sim()
@@ -2793,9 +2925,9 @@ class Simulation(object):
         self.load_force_data(force, fdata)
         force.scale_dfts(complex(-1.0))
 
-    def add_flux(self, *args):
+    def add_flux(self, *args, **kwargs):
         """
-        `add_flux(fcen, df, nfreq, freq, FluxRegions...)` ##sig
+        `add_flux(fcen, df, nfreq, freq, FluxRegions..., time_series=0)` ##sig
 
         Add a bunch of `FluxRegion`s to the current simulation (initializing the fields if
         they have not yet been initialized), telling Meep to accumulate the appropriate
@@ -2803,22 +2935,33 @@ class Simulation(object):
         frequency range `fcen-df/2` to `fcen+df/2` or an array/list `freq` for arbitrarily
         spaced frequencies. Return a *flux object*, which you can pass to the functions
         below to get the flux spectrum, etcetera.
+
+        For very many (e.g. thousands of) equally spaced frequencies, setting
+        `time_series` to a number of timesteps $M$ (e.g. a few thousand) records the
+        fields of up to $M$ timesteps at a time and Fourier-transforms them with FFTs
+        (a chirp-z transform), so that the cost per timestep does not grow with `nfreq`.
+        This needs memory for $M$ field values per point of the flux regions, and gives
+        the same results.
         """
         args = fix_dft_args(args, 0)
         freq = args[0]
         fluxes = args[1:]
-        flux = DftFlux(self._add_flux, [freq, fluxes])
+        time_series = kwargs.get('time_series', 0)
+        flux = DftFlux(self._add_flux, [freq, fluxes, time_series])
         self.dft_objects.append(flux)
         return flux
 
-    def _add_flux(self, freq, fluxes):
+    def _add_flux(self, freq, fluxes, time_series):
         if self.fields is None:
             self.init_sim()
-        return self._add_fluxish_stuff(self.fields.add_dft_flux, freq, fluxes)
+        flux = self._add_fluxish_stuff(self.fields.add_dft_flux, freq, fluxes)
+        if time_series:
+            flux.record_time_series(time_series)
+        return flux
 
     def add_mode_monitor(self, *args, **kwargs):
         """
-        `add_mode_monitor(fcen, df, nfreq, freq, ModeRegions...)`  ##sig
+        `add_mode_monitor(fcen, df, nfreq, freq, ModeRegions..., time_series=0)`  ##sig
 
         Similar to `add_flux`, but for use with `get_eigenmode_coefficients`.
         """
@@ -2826,11 +2969,12 @@ class Simulation(object):
         freq = args[0]
         fluxes = args[1:]
         yee_grid = kwargs.get("yee_grid", False)
-        flux = DftFlux(self._add_mode_monitor, [freq, fluxes, yee_grid])
+        time_series = kwargs.get("time_series", 0)
+        flux = DftFlux(self._add_mode_monitor, [freq, fluxes, yee_grid, time_series])
         self.dft_objects.append(flux)
         return flux
 
-    def _add_mode_monitor(self, freq, fluxes, yee_grid):
+    def _add_mode_monitor(self, freq, fluxes, yee_grid, time_series):
         if self.fields is None:
             self.init_sim()
 
@@ -2843,7 +2987,10 @@ class Simulation(object):
         d0 = region.direction
         d = self.fields.normal_direction(v.swigobj) if d0 < 0 else d0
 
-        return self.fields.add_mode_monitor(d, v.swigobj, freq, centered_grid)
+        flux = self.fields.add_mode_monitor(d, v.swigobj, freq, centered_grid)
+        if time_series:
+            flux.record_time_series(time_series)
+        return flux
 
     def display_fluxes(self, *fluxes):
         """
@@ -3089,7 +3236,12 @@ class Simulation(object):
             nm = self.fields.h5file_name(mp.component_name(c), self.get_filename_prefix(), True)
             if c == mp.Dielectric:
                 self.last_eps_filename = nm
-            self.output_h5_hook(nm)
+            self._call_output_h5_hook(nm)
+
+    def _call_output_h5_hook(self, fname):
+        # the hook (e.g. h5topng in output_png) reads the file, so it must be complete
+        self.fields.flush_output()
+        self.output_h5_hook(fname)
 
     def output_components(self, fname, *components):
         if self.fields is None:
@@ -3106,7 +3258,8 @@ class Simulation(object):
                 f.prevent_deadlock()
 
         if self.output_append_h5 is None:
-            self.output_h5_hook(self.fields.h5file_name(fname, self.get_filename_prefix(), True))
+            self._call_output_h5_hook(
+                self.fields.h5file_name(fname, self.get_filename_prefix(), True))
 
     def h5topng(self, rm_h5, option, *step_funcs):
         opts = "h5topng {}".format(option)
@@ -3139,7 +3292,9 @@ class Simulation(object):
           which will be overwritten with the field/material data instead of allocating a
           new array.  Normally, this will be the array returned from a previous call to
           `get_array` for a similar slice, allowing one to re-use `arr` (e.g., when
-          fetching the same slice repeatedly at different times).
+          fetching the same slice repeatedly at different times). `arr` need not be
+          contiguous: a transposed array or a strided view of a larger array (e.g.
+          `big[::2, 10:20]`) is filled in place, without a temporary copy.
 
         + `frequency`: optional frequency point over which the average eigenvalue of the
           $\\varepsilon$ and $\\mu$ tensors are evaluated (defaults to 0).
@@ -3201,18 +3356,54 @@ class Simulation(object):
                     fmt = "Expected dimensions {}, but got {}"
                     raise ValueError(fmt.format(dims, arr.shape))
 
-            arr = np.require(arr, requirements=['C', 'W'])
+            if arr.ndim == len(dims) and arr.flags.writeable and all(s % arr.itemsize == 0 for s in arr.strides):
+                # the slice is written directly into arr, with its strides (in elements)
+                strides = np.array(arr.strides, dtype=np.intp) // arr.itemsize
+            else:
+                arr = np.require(arr, requirements=['C', 'W'])
+                strides = None
 
         else:
             arr = np.zeros(dims, dtype=np.complex128 if cmplx else np.float64)
+            strides = None
 
         if np.iscomplexobj(arr):
-            self.fields.get_complex_array_slice(v, component, arr, frequency, snap)
+            self.fields.get_complex_array_slice(v, component, arr, frequency, snap, strides)
         else:
-            self.fields.get_array_slice(v, component, arr, frequency, snap)
+            self.fields.get_array_slice(v, component, arr, frequency, snap, strides)
 
         return arr
 
+    def get_array_blocks(self, component=None, vol=None, center=None, size=None, cmplx=None,
+                         frequency=0, snap=False):
+        """
+        Like `get_array` (with the same parameters, except `arr`), but without any MPI
+        communication and without allocating the whole slice: returns a list of
+        `(start, block)` pairs, one for each block of the slice computed from the chunks
+        owned by this process, where `block` is a NumPy array holding the elements
+        `[start[0]:start[0]+block.shape[0], start[1]:...]` of the array returned by
+        `get_array`. This is useful when each process post-processes its own part of a
+        large slice. The sum of the blocks of all processes is the slice: the blocks are
+        disjoint, except where the interpolation across an empty dimension of the slice
+        (see `snap`) involves two chunks.
+        """
+        if component is None:
+            raise ValueError("component is required")
+
+        dim_sizes = np.zeros(3, dtype=np.uintp)
+
+        if vol is None and center is None and size is None:
+            v = self.fields.total_volume()
+        else:
+            v = self._volume_from_kwargs(vol, center, size)
+
+        rank, _ = mp._get_array_slice_dimensions(self.fields, v, dim_sizes, not snap, snap)
+
+        if cmplx is None:
+            cmplx = frequency != 0 or (component < mp.Dielectric and not self.fields.is_real)
+
+        return mp._get_array_slice_boxes(self.fields, v, component, rank, frequency, snap, cmplx)
+
     def get_dft_array(self, dft_obj, component, num_freq):
         """
         Returns the Fourier-transformed fields as a NumPy array.
@@ -3289,7 +3480,9 @@ class Simulation(object):
         `center`/`size`. Set `dft_cell` to a `dft_flux` or `dft_fields` object to define the
         region covered by the array. If the `dft_cell` argument is provided then all other
         arguments related to the spatial region (`vol`, `center`, and `size`) are ignored.
-        If no arguments are provided, then the entire cell is used.
+        If no arguments are provided, then the entire cell is used. For a `dft_fields`
+        object with `stride` > 1 (see `add_dft_fields`), the points and weights are those
+        of its coarser grid.
 
         For empty dimensions of the grid slice `get_array_metadata` will collapse
         the *two* elements corresponding to the nearest Yee grid points into a *single*
@@ -3299,13 +3492,16 @@ class Simulation(object):
         list of `mp.Vector3`s with the same dimensions as `w` (weights). Otherwise, by
         default the return value is a 4-tuple `(x,y,z,w)`.
         """
+        stride = 1
         if dft_cell:
             vol = dft_cell.where
+            if isinstance(dft_cell, (DftFields, mp.dft_fields)):
+                stride = dft_cell.stride
         if vol is None and center is None and size is None:
             v = self.fields.total_volume()
         else:
             v = self._volume_from_kwargs(vol, center, size)
-        xyzw_vector = self.fields.get_array_metadata(v)
+        xyzw_vector = self.fields.get_array_metadata(v, stride)
         offset, tics = 0, []
         for n in range(3):
             N = int(xyzw_vector[offset])
@@ -3474,7 +3670,8 @@ class Simulation(object):
         self.fields.output_hdf5(name, [cs, func], ov, h5, append, self.output_single_precision,
                                 self.get_filename_prefix(), real_only)
         if h5file is None:
-            self.output_h5_hook(self.fields.h5file_name(name, self.get_filename_prefix(), True))
+            self._call_output_h5_hook(
+                self.fields.h5file_name(name, self.get_filename_prefix(), True))
 
     def _get_field_function_volume(self, where=None, center=None, size=None):
         try:
@@ -3649,6 +3846,9 @@ class Simulation(object):
         else:
             raise ValueError("Invalid run configuration")
 
+        # so that the output files are complete when run returns
+        self.fields.flush_output()
+
     def print_times(self):
         """
         Call after running a simulation to print the times spent on various types of work.
@@ -3689,6 +3889,28 @@ class Simulation(object):
         """
         return self.fields.time_spent_on(time_sink)
 
+    def time_spent_on_chunks(self):
+        """
+        Return a list of the wall-clock times spent timestepping each chunk (by the
+        process that owns it) since the fields were initialized or since the chunks
+        were last moved by `rebalance_chunks`.
+        """
+        return self.fields.time_spent_on_chunks()
+
+    def rebalance_chunks(self, tolerance=0.1):
+        """
+        Move chunks between processes during a run based on the measured
+        `time_spent_on_chunks`, if the slowest process takes more than `1+tolerance`
+        times the mean time. Returns `True` if any chunks were moved. The chunks
+        themselves are not split, so this is only useful when there are several chunks
+        per process (see `num_chunks`); chunks containing sources or DFT monitors stay
+        on their current process. Must be called on all processes, e.g. via
+        `mp.at_every(100, lambda sim: sim.rebalance_chunks())`.
+        """
+        if self.fields is None:
+            self.init_sim()
+        return self.fields.rebalance_chunks(tolerance)
+
     def output_times(self, fname):
         """
         Call after running a simulation to output to a file with filename `fname` the
@@ -4223,7 +4445,7 @@ def to_appended(fname, *step_funcs):
 
         if todo == 'finish':
             closure['h5'] = None
-            sim.output_h5_hook(sim.fields.h5file_name(fname, sim.get_filename_prefix()))
+            sim._call_output_h5_hook(sim.fields.h5file_name(fname, sim.get_filename_prefix()))
         sim.output_append_h5 = h5save
     return _to_appended
 
@@ -4248,11 +4470,21 @@ def stop_when_fields_decayed(dt, c, pt, decay_by):
         'max_abs': 0,
         'cur_max': 0,
         't0': 0,
+        'fields': None,
+        'probe': None,
     }
 
     def _stop(sim):
-        fabs = abs(sim.get_field_point(c, pt)) * abs(sim.get_field_point(c, pt))
-        closure['cur_max'] = max(closure['cur_max'], fabs)
+        # The field value is summed over processes in the background while the
+        # next step runs, so each check uses the value from the previous step.
+        if closure['fields'] is not sim.fields:
+            closure['fields'] = sim.fields
+            v3 = py_v3_to_vec(sim.dimensions, pt, sim.is_cylindrical)
+            closure['probe'] = mp.field_point_probe(sim.fields, c, v3)
+        else:
+            fabs = abs(closure['probe'].value())**2
+            closure['cur_max'] = max(closure['cur_max'], fabs)
+        closure['probe'].update()
 
         if sim.round_time() <= dt + closure['t0']:
             return False
@@ -82,6 +82,35 @@ class TestCavityArraySlice(unittest.TestCase):
         self.sim.get_array(mp.Hz, vol, arr=arr)
         np.testing.assert_allclose(self.expected_2d, arr)
 
+    def test_2d_slice_strided_user_array(self):
+        self.sim.run(until_after_sources=0)
+        vol = mp.Volume(center=self.center_2d, size=self.size_2d)
+        arr = np.zeros((38, 126)).T
+        self.sim.get_array(mp.Hz, vol, arr=arr)
+        np.testing.assert_allclose(self.expected_2d, arr)
+
+        big = np.zeros((260, 50))
+        arr = self.sim.get_array(mp.Hz, vol, arr=big[:252:2, 5:43])
+        self.assertTrue(np.shares_memory(arr, big))
+        np.testing.assert_allclose(self.expected_2d, big[:252:2, 5:43])
+        self.assertFalse(big[1::2].any())
+
+    def test_slice_blocks(self):
+        self.sim.run(until_after_sources=0)
+        vol = mp.Volume(center=self.center_2d, size=self.size_2d)
+        for start, block in self.sim.get_array_blocks(mp.Hz, vol):
+            self.assertEqual(len(start), 2)
+            region = tuple(slice(s, s + n) for s, n in zip(start, block.shape))
+            np.testing.assert_allclose(self.expected_2d[region], block)
+
+        # the blocks of the 1d slice are interpolated across y (and may overlap)
+        vol = mp.Volume(center=self.center_1d, size=self.size_1d)
+        hl_slice1d = np.zeros(126)
+        for start, block in self.sim.get_array_blocks(mp.Hz, vol):
+            hl_slice1d[start[0]:start[0] + block.shape[0]] += block
+        if mp.count_processors() == 1:
+            np.testing.assert_allclose(self.expected_1d, hl_slice1d)
+
     def test_illegal_user_array(self):
         self.sim.run(until_after_sources=0)
 
@@ -1,5 +1,6 @@
 import meep as mp
 import copy
+import os
 import unittest
 
 process_ids = []
@@ -53,6 +54,46 @@ class TestChunkLayoutBinaryPartition(unittest.TestCase):
 
         self.assertListEqual([int(f) for f in owners],[f % mp.count_processors() for f in process_ids])
         self.assertListEqual(areas,chunk_areas)
-        
+
+    def test_chunk_layout_hilbert(self):
+        cell_size = mp.Vector3(10.0,5.0,0)
+        pml_layers = [mp.PML(1.0)]
+
+        sim1 = mp.Simulation(cell_size=cell_size,
+                             resolution=10,
+                             boundary_layers=pml_layers,
+                             num_chunks=5,
+                             split_chunks_hilbert=True)
+        sim1.init_sim()
+        vols1 = [ v.surroundings() for v in sim1.structure.get_chunk_volumes() ]
+        owners1 = [ int(f) for f in sim1.structure.get_chunk_owners() ]
+
+        self.assertGreaterEqual(len(vols1),5)
+        self.assertAlmostEqual(sum([ v.full_volume() for v in vols1 ]),cell_size.x*cell_size.y)
+
+        # the layout (and the chunk owners) must survive a dump/load, even into
+        # a simulation that would have divided the cell differently
+        fname = 'test_chunk_layout_hilbert.h5'
+        sim1.dump_chunk_layout(fname)
+        sim2 = mp.Simulation(cell_size=cell_size,
+                             resolution=10,
+                             boundary_layers=pml_layers,
+                             num_chunks=5,
+                             chunk_layout=fname)
+        sim2.init_sim()
+        vols2 = [ v.surroundings() for v in sim2.structure.get_chunk_volumes() ]
+        owners2 = [ int(f) for f in sim2.structure.get_chunk_owners() ]
+
+        self.assertEqual(len(vols1),len(vols2))
+        for v1, v2 in zip(vols1, vols2):
+            for c1, c2 in [(v1.get_min_corner(),v2.get_min_corner()),
+                           (v1.get_max_corner(),v2.get_max_corner())]:
+                self.assertAlmostEqual(c1.x(),c2.x())
+                self.assertAlmostEqual(c1.y(),c2.y())
+        self.assertListEqual(owners1,owners2)
+
+        if mp.am_master():
+            os.remove(fname)
+
 if __name__ == '__main__':
     unittest.main()
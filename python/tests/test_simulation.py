@@ -156,6 +156,15 @@ class TestSimulation(unittest.TestCase):
 
         self.assertTrue(done[0])
 
+    def test_fields_decayed_derived_component(self):
+        # derived components are not sums of per-process values (see field_point_probe)
+        for c in [mp.EnergyDensity, mp.Sx]:
+            sim = self.init_simple_simulation()
+            pt = mp.Vector3(1.3, 0.7)
+            sim.run(until_after_sources=mp.stop_when_fields_decayed(5, c, pt, 1e-2))
+            self.assertGreater(sim.meep_time(), 5)
+            self.assertLess(sim.meep_time(), 200)
+
     def test_with_prefix(self):
         sim = self.init_simple_simulation()
         sim.use_output_directory(self.temp_dir)
@@ -298,7 +307,7 @@ class TestSimulation(unittest.TestCase):
         sim.field_energy_in_box(tv)
         sim.field_energy_in_box(v)
 
-    def _load_dump_structure(self, chunk_file=False, chunk_sim=False):
+    def _load_dump_structure(self, chunk_file=False, chunk_sim=False, num_chunks=0):
         from meep.materials import Al
         resolution = 50
         cell = mp.Vector3(5, 5)
@@ -342,6 +351,7 @@ class TestSimulation(unittest.TestCase):
                             sources=[sources],
                             symmetries=symmetries,
                             chunk_layout=chunk_layout,
+                            num_chunks=num_chunks,
                             load_structure=dump_fn)
 
         field_points = []
@@ -364,6 +374,69 @@ class TestSimulation(unittest.TestCase):
     def test_load_dump_chunk_layout_sim(self):
         self._load_dump_structure(chunk_sim=True)
 
+    def test_load_dump_structure_num_chunks(self):
+        self._load_dump_structure(num_chunks=3)
+
+    def test_load_dump_fields(self):
+        from meep.materials import Al
+
+        def make_sim():
+            sim = mp.Simulation(resolution=20,
+                                cell_size=mp.Vector3(5, 5),
+                                boundary_layers=[mp.PML(0.5)],
+                                geometry=[mp.Block(material=Al, center=mp.Vector3(),
+                                                   size=mp.Vector3(1, 1, mp.inf))],
+                                sources=[mp.Source(src=mp.GaussianSource(1, fwidth=0.2),
+                                                   center=mp.Vector3(-1), component=mp.Ez)])
+            flux = sim.add_flux(1, 0.2, 5, mp.FluxRegion(center=mp.Vector3(1.5), size=mp.Vector3(0, 3)))
+            return sim, flux
+
+        sample_point = mp.Vector3(0.12, -0.29)
+        dump_fn = os.path.join(self.temp_dir, 'test_load_dump_fields.h5')
+
+        sim1, flux1 = make_sim()
+        sim1.run(until=10)
+        sim1.dump_fields(dump_fn)
+        sim1.run(until=20)
+
+        sim2, flux2 = make_sim()
+        sim2.load_fields(dump_fn)
+        self.assertAlmostEqual(sim2.meep_time(), sim1.meep_time() - 20)
+        sim2.run(until=20)
+
+        self.assertEqual(sim1.get_field_point(mp.Ez, sample_point),
+                         sim2.get_field_point(mp.Ez, sample_point))
+        np.testing.assert_array_equal(mp.get_fluxes(flux1), mp.get_fluxes(flux2))
+
+    def test_structure_cache(self):
+        from meep.materials import Al
+        cache_dir = os.path.join(self.temp_dir, 'structure_cache')
+
+        def run_sim(eps):
+            sim = mp.Simulation(resolution=20,
+                                cell_size=mp.Vector3(5, 5),
+                                boundary_layers=[mp.PML(0.5)],
+                                geometry=[mp.Block(material=Al, center=mp.Vector3(),
+                                                   size=mp.Vector3(1, 1, mp.inf)),
+                                          mp.Cylinder(material=mp.Medium(epsilon=eps),
+                                                      center=mp.Vector3(1.2), radius=0.4)],
+                                sources=[mp.Source(src=mp.GaussianSource(1, fwidth=0.2),
+                                                   center=mp.Vector3(-1), component=mp.Ez)],
+                                structure_cache_dir=cache_dir)
+            sim.run(until=20)
+            return sim.get_field_point(mp.Ez, mp.Vector3(0.12, -0.29))
+
+        def cache_files():
+            return sorted(f for f in os.listdir(cache_dir) if f.endswith('.h5'))
+
+        ref = run_sim(12)
+        files = cache_files()
+        self.assertEqual(len(files), 1)
+        self.assertEqual(run_sim(12), ref)
+        self.assertEqual(cache_files(), files)
+        run_sim(11)
+        self.assertEqual(len(cache_files()), 2)
+
     def test_get_array_output(self):
         sim = self.init_simple_simulation()
         sim.use_output_directory(self.temp_dir)
@@ -404,6 +477,41 @@ class TestSimulation(unittest.TestCase):
         np.testing.assert_allclose(energy, energy_arr)
         np.testing.assert_allclose(efield, efield_arr)
 
+    def test_async_output(self):
+        if mp.count_processors() > 1:
+            with self.assertRaises(ValueError):
+                self.init_simple_simulation(async_output=True)
+            return
+
+        sim = self.init_simple_simulation(async_output=True)
+        sim.use_output_directory(self.temp_dir)
+        sim.filename_prefix = 'test_async_output'
+        ez_files = []
+
+        def read_ez(fname):
+            # the (asynchronous) output must be complete when the hook is called
+            with h5py.File(fname, 'r') as f:
+                ez_files.append(f['ez'][()])
+
+        sim.output_h5_hook = read_ez
+        sim.run(mp.at_every(5, mp.output_efield_z),
+                mp.to_appended('ez-movie', mp.at_every(1, mp.output_efield_z)), until=20)
+        self.assertGreater(len(ez_files), 4)
+        mp.output_efield_z(sim)
+        np.testing.assert_allclose(ez_files[-1], sim.get_efield_z(snap=True))
+
+        # the movie must also be complete when run returns
+        fname = os.path.join(self.temp_dir, 'test_async_output-ez-movie.h5')
+        with h5py.File(fname, 'r') as f:
+            movie = f['ez'][()]
+        self.assertEqual(movie.shape[:2], ez_files[-1].shape)
+        self.assertGreater(movie.shape[2], 10)
+
+    def test_output_compression_tolerance(self):
+        # lossy compression requires the deflate filter
+        with self.assertRaises(ValueError):
+            self.init_simple_simulation(output_compression_tolerance=1e-3)
+
     def test_synchronized_magnetic(self):
         # Issue 309
         cell = mp.Vector3(16, 8, 0)
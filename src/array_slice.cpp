@@ -57,6 +57,15 @@ typedef struct {
   std::vector<component> components;
 
   void *vslice;
+  ptrdiff_t strides[3]; // strides of vslice (in elements) along the slice dimensions
+
+  // the boxes of the (uncollapsed) slice filled in by this process
+  std::vector<array_box> boxes;
+
+  // if true, each box is computed in its own row-major array (in box_data)
+  // instead of in vslice
+  bool own_boxes;
+  std::vector<double *> box_data;
 
   // temporary internal storage buffers
   component *cS;
@@ -246,27 +255,41 @@ static void get_array_slice_chunkloop(fields_chunk *fc, int ichnk, component cgr
     if (ied < isd) offset[permute.in_direction(d)] = count[i] - 1;
   }
 
-  // slightly confusing: for array_slice, in contrast to
-  // h5fields, strides are computed using the dimensions of
-  // the full array slice, not the dimensions of the chunk.
-  size_t dims[3] = {1, 1, 1};
-  for (int i = 0; i < data->rank; i++) {
-    direction d = data->ds[i];
-    dims[i] = (data->max_corner.in_direction(d) - data->min_corner.in_direction(d)) / 2 + 1;
+  array_box box;
+  for (int i = 0; i < 3; ++i) {
+    box.start[i] = start[i];
+    box.count[i] = count[i];
+  }
+  data->boxes.push_back(box);
+
+  bool complex_data = (data->rfun == 0);
+  void *vslice = data->vslice;
+  ptrdiff_t strides[3] = {data->strides[0], data->strides[1], data->strides[2]};
+  if (data->own_boxes) { // a row-major array for just this box
+    const size_t n = slice_size * (complex_data ? 2 : 1);
+    vslice = memset(new double[n], 0, n * sizeof(double));
+    data->box_data.push_back((double *)vslice);
+    for (int i = data->rank - 1, s = 1; i >= 0; s *= count[i--]) {
+      strides[i] = s;
+      start[i] = 0;
+    }
   }
 
+  // slightly confusing: for array_slice, in contrast to
+  // h5fields, strides are those of the full array slice
+  // (as given by the caller), not those of the chunk.
   ptrdiff_t stride[3] = {1, 1, 1};
   for (int i = 0; i < data->rank; ++i) {
-    direction d = data->ds[i];
-    int j = permute.in_direction(d);
-    for (int k = i + 1; k < data->rank; ++k)
-      stride[j] *= dims[k];
+    int j = permute.in_direction(data->ds[i]);
+    stride[j] = strides[i];
     offset[j] *= stride[j];
     if (offset[j]) stride[j] *= -1;
   }
 
   // sco="slice chunk offset"
-  ptrdiff_t sco = start[0] * dims[1] * dims[2] + start[1] * dims[2] + start[2];
+  ptrdiff_t sco = 0;
+  for (int i = 0; i < data->rank; ++i)
+    sco += start[i] * strides[i];
 
   //-----------------------------------------------------------------------//
   // Otherwise proceed to compute the function of field components to be   //
@@ -274,11 +297,10 @@ static void get_array_slice_chunkloop(fields_chunk *fc, int ichnk, component cgr
   //-----------------------------------------------------------------------//
   double *slice = 0;
   complex<double> *zslice = 0;
-  bool complex_data = (data->rfun == 0);
   if (complex_data)
-    zslice = (complex<double> *)data->vslice;
+    zslice = (complex<double> *)vslice;
   else
-    slice = (double *)data->vslice;
+    slice = (double *)vslice;
 
   ptrdiff_t *off = data->offsets;
   component *cS = data->cS;
@@ -412,6 +434,94 @@ complex<double> *array_to_all(complex<double> *array, size_t array_size) {
   return (complex<double> *)array_to_all((double *)array, 2 * array_size);
 }
 
+/***************************************************************/
+/* consolidate an array of which each process has filled in    */
+/* only the entries in its own boxes: in contrast to           */
+/* array_to_all, each process sends only the entries of its    */
+/* boxes (preceded by the box coordinates), so that the amount */
+/* of data communicated is independent of the number of        */
+/* processes.  The boxes of different processes must not       */
+/* overlap; entries in no box are left unchanged.  The strides */
+/* of the array (in units of elem_size) may be arbitrary.      */
+/***************************************************************/
+static void copy_array_box(double *array, const ptrdiff_t strides[3], size_t elem_size,
+                           const size_t start[3], const size_t count[3], double *buf,
+                           bool unpack) {
+  const size_t run = count[2] * elem_size;
+  for (size_t i0 = 0; i0 < count[0]; ++i0)
+    for (size_t i1 = 0; i1 < count[1]; ++i1, buf += run) {
+      ptrdiff_t index = ptrdiff_t(start[0] + i0) * strides[0] +
+                        ptrdiff_t(start[1] + i1) * strides[1] + ptrdiff_t(start[2]) * strides[2];
+      double *a = array + index * ptrdiff_t(elem_size);
+      if (strides[2] == 1) {
+        if (unpack)
+          memcpy(a, buf, run * sizeof(double));
+        else
+          memcpy(buf, a, run * sizeof(double));
+        continue;
+      }
+      for (size_t i2 = 0; i2 < count[2]; ++i2, a += strides[2] * ptrdiff_t(elem_size))
+        for (size_t k = 0; k < elem_size; ++k)
+          if (unpack)
+            a[k] = buf[i2 * elem_size + k];
+          else
+            buf[i2 * elem_size + k] = a[k];
+    }
+}
+
+static void row_major_strides(const size_t dims[3], ptrdiff_t strides[3]) {
+  strides[2] = 1;
+  strides[1] = dims[2];
+  strides[0] = dims[1] * dims[2];
+}
+
+// zero all entries of an array of dimensions dims[3] with the given strides
+static void clear_array(double *array, const size_t dims[3], const ptrdiff_t strides[3],
+                        size_t elem_size) {
+  for (size_t i0 = 0; i0 < dims[0]; ++i0)
+    for (size_t i1 = 0; i1 < dims[1]; ++i1) {
+      double *a = array + (ptrdiff_t(i0) * strides[0] + ptrdiff_t(i1) * strides[1]) *
+                              ptrdiff_t(elem_size);
+      for (size_t i2 = 0; i2 < dims[2]; ++i2, a += strides[2] * ptrdiff_t(elem_size))
+        for (size_t k = 0; k < elem_size; ++k)
+          a[k] = 0;
+    }
+}
+
+void gather_array_boxes(double *array, const ptrdiff_t strides[3], size_t elem_size,
+                        const std::vector<array_box> &boxes, bool to_all) {
+  if (count_processors() == 1) return;
+
+  std::vector<double> mine;
+  for (const array_box &b : boxes) {
+    mine.insert(mine.end(), b.start, b.start + 3);
+    mine.insert(mine.end(), b.count, b.count + 3);
+    size_t pos = mine.size();
+    mine.resize(pos + b.count[0] * b.count[1] * b.count[2] * elem_size);
+    copy_array_box(array, strides, elem_size, b.start, b.count, &mine[pos], false);
+  }
+
+  std::vector<double> all = to_all ? gather_to_all(mine) : gather_to_master(mine);
+
+  for (size_t pos = 0; pos < all.size();) {
+    size_t start[3], count[3];
+    for (int i = 0; i < 3; ++i) {
+      start[i] = size_t(all[pos + i]);
+      count[i] = size_t(all[pos + 3 + i]);
+    }
+    pos += 6;
+    copy_array_box(array, strides, elem_size, start, count, &all[pos], true);
+    pos += count[0] * count[1] * count[2] * elem_size;
+  }
+}
+
+void gather_array_boxes(double *array, const size_t dims[3], size_t elem_size,
+                        const std::vector<array_box> &boxes, bool to_all) {
+  ptrdiff_t strides[3];
+  row_major_strides(dims, strides);
+  gather_array_boxes(array, strides, elem_size, boxes, to_all);
+}
+
 /***************************************************************/
 /* given a volume, fill in the dims[] and dirs[] arrays        */
 /* describing the array slice needed to store field data for   */
@@ -572,12 +682,50 @@ complex<double> *collapse_array(complex<double> *array, int *rank, size_t dims[3
   return (complex<double> *)collapse_array((double *)array, rank, dims, dirs, where, 2);
 }
 
+/* sum a (row-major) box b of the uncollapsed slice, whose dimensions are
+   in the directions ds[0..rank-1], over the empty dimensions of where, as
+   collapse_array does for the whole slice */
+static void collapse_box(array_slice_box &b, int rank, const direction *ds, const volume &where,
+                         int elem_size) {
+  size_t start[3] = {0, 0, 0}, count[3] = {1, 1, 1}, rstride[3] = {0, 0, 0};
+  int reduced_rank = 0;
+  for (int i = 0; i < rank; ++i)
+    if (where.in_direction(ds[i]) != 0.0) {
+      start[reduced_rank] = b.start[i];
+      count[reduced_rank++] = b.count[i];
+    }
+  for (int i = rank - 1, r = reduced_rank - 1, s = 1; i >= 0; --i)
+    if (where.in_direction(ds[i]) != 0.0) {
+      rstride[i] = s;
+      s *= count[r--];
+    }
+
+  const size_t reduced_size = count[0] * count[1] * count[2] * elem_size;
+  double *reduced = new double[reduced_size];
+  memset(reduced, 0, reduced_size * sizeof(double));
+  size_t n[3] = {0, 0, 0}, index = 0;
+  do {
+    size_t rindex = n[0] * rstride[0] + n[1] * rstride[1] + n[2] * rstride[2];
+    for (int k = 0; k < elem_size; ++k)
+      reduced[rindex * elem_size + k] += b.data[index * elem_size + k];
+    ++index;
+  } while (!increment(n, b.count, rank));
+
+  delete[] b.data;
+  b.data = reduced;
+  for (int i = 0; i < 3; ++i) {
+    b.start[i] = start[i];
+    b.count[i] = count[i];
+  }
+}
+
 /**********************************************************************/
 /* precisely one of fun, rfun, should be non-NULL                     */
 /**********************************************************************/
 void *fields::do_get_array_slice(const volume &where, std::vector<component> components,
                                  field_function fun, field_rfunction rfun, void *fun_data,
-                                 void *vslice, double frequency, bool snap) {
+                                 void *vslice, double frequency, bool snap,
+                                 const ptrdiff_t *strides, std::vector<array_slice_box> *boxes) {
   am_now_working_on(FieldOutput);
 
   /***************************************************************/
@@ -588,12 +736,34 @@ void *fields::do_get_array_slice(const volume &where, std::vector<component> com
   direction dirs[3];
   array_slice_data data;
   int rank = get_array_slice_dimensions(where, dims, dirs, false, snap, 0, &data);
+  for (int i = rank; i < 3; ++i)
+    dims[i] = 1;
   size_t slice_size = data.slice_size;
   bool complex_data = (rfun == 0);
   int elem_size = complex_data ? 2 : 1;
-  void *vslice_uncollapsed;
 
-  vslice_uncollapsed = memset(new double[slice_size * elem_size], 0, slice_size * elem_size * sizeof(double));
+  // the slice is computed directly in the caller's array (with the caller's
+  // strides) unless empty dimensions must be summed over in collapse_array
+  bool collapse = false;
+  if (!snap)
+    for (int i = 0; i < rank; ++i)
+      if (where.in_direction(dirs[i]) == 0.0) collapse = true;
+
+  double *vslice_uncollapsed = NULL;
+  row_major_strides(dims, data.strides);
+  data.own_boxes = (boxes != NULL);
+  if (data.own_boxes)
+    vslice = NULL; // each box is allocated in get_array_slice_chunkloop
+  else if (vslice && !collapse) {
+    vslice_uncollapsed = (double *)vslice;
+    if (strides)
+      for (int i = 0; i < rank; ++i)
+        data.strides[i] = strides[i];
+    clear_array(vslice_uncollapsed, dims, data.strides, elem_size);
+  }
+  else
+    vslice_uncollapsed = (double *)memset(new double[slice_size * elem_size], 0,
+                                          slice_size * elem_size * sizeof(double));
 
   data.vslice = vslice_uncollapsed;
   data.snap = snap;
@@ -644,20 +814,46 @@ void *fields::do_get_array_slice(const volume &where, std::vector<component> com
 
   loop_in_chunks(get_array_slice_chunkloop, (void *)&data, where, Centered, true, snap);
 
-  if (!snap) {
-    double *slice = collapse_array((double *)vslice_uncollapsed, &rank, dims, dirs, where, elem_size);
-    rank = get_array_slice_dimensions(where, dims, dirs, true, false, 0, &data);
-    slice_size = data.slice_size;
-    vslice_uncollapsed = (double*) slice;
+  if (boxes) {
+    for (size_t k = 0; k < data.boxes.size(); ++k) {
+      array_slice_box b;
+      for (int i = 0; i < 3; ++i) {
+        b.start[i] = data.boxes[k].start[i];
+        b.count[i] = data.boxes[k].count[i];
+      }
+      b.data = data.box_data[k];
+      if (collapse) collapse_box(b, rank, dirs, where, elem_size);
+      boxes->push_back(b);
+    }
   }
-  if (vslice) {
-    memcpy(vslice, vslice_uncollapsed, slice_size * elem_size * sizeof(double));
-    delete[] (double*) vslice_uncollapsed;
+  else {
+    // the chunks write disjoint entries of the uncollapsed slice, so it is
+    // gathered before summing over the empty dimensions in collapse_array
+    am_now_working_on(MpiAllTime);
+    gather_array_boxes(vslice_uncollapsed, data.strides, elem_size, data.boxes);
+    finished_working();
+
+    if (collapse) {
+      double *slice = collapse_array(vslice_uncollapsed, &rank, dims, dirs, where, elem_size);
+      rank = get_array_slice_dimensions(where, dims, dirs, true, false, 0, &data);
+      if (vslice) {
+        size_t start[3] = {0, 0, 0}, count[3] = {1, 1, 1};
+        ptrdiff_t vstrides[3];
+        for (int i = 0; i < rank; ++i)
+          count[i] = dims[i];
+        row_major_strides(count, vstrides);
+        if (strides)
+          for (int i = 0; i < rank; ++i)
+            vstrides[i] = strides[i];
+        copy_array_box((double *)vslice, vstrides, elem_size, start, count, slice, true);
+        delete[] slice;
+      }
+      else
+        vslice = slice;
+    }
+    else if (!vslice)
+      vslice = vslice_uncollapsed;
   }
-  else
-    vslice = vslice_uncollapsed;
-
-  array_to_all((double *)vslice, elem_size * slice_size);
 
   delete[] data.offsets;
   delete[] data.fields;
@@ -673,42 +869,68 @@ void *fields::do_get_array_slice(const volume &where, std::vector<component> com
 /***************************************************************/
 double *fields::get_array_slice(const volume &where, std::vector<component> components,
                                 field_rfunction rfun, void *fun_data, double *slice,
-                                double frequency, bool snap) {
+                                double frequency, bool snap, const ptrdiff_t *strides) {
   return (double *)do_get_array_slice(where, components, 0, rfun, fun_data, (void *)slice,
-                                      frequency, snap);
+                                      frequency, snap, strides);
 }
 
 complex<double> *fields::get_complex_array_slice(const volume &where, std::vector<component> components,
                                                  field_function fun, void *fun_data, complex<double> *slice,
-                                                 double frequency, bool snap) {
+                                                 double frequency, bool snap,
+                                                 const ptrdiff_t *strides) {
   return (complex<double> *)do_get_array_slice(where, components, fun, 0, fun_data, (void *)slice,
-                                               frequency, snap);
+                                               frequency, snap, strides);
 }
 
 double *fields::get_array_slice(const volume &where, component c, double *slice, double frequency,
-                                bool snap) {
+                                bool snap, const ptrdiff_t *strides) {
   std::vector<component> components(1);
   components[0] = c;
   return (double *)do_get_array_slice(where, components, 0, default_field_rfunc, 0, (void *)slice,
-                                      frequency, snap);
+                                      frequency, snap, strides);
 }
 
 double *fields::get_array_slice(const volume &where, derived_component c, double *slice,
-                                double frequency, bool snap) {
+                                double frequency, bool snap, const ptrdiff_t *strides) {
   int nfields;
   component carray[12];
   field_rfunction rfun = derived_component_func(c, gv, nfields, carray);
   std::vector<component> cs(carray, carray + nfields);
   return (double *)do_get_array_slice(where, cs, 0, rfun, &nfields, (void *)slice,
-                                      frequency, snap);
+                                      frequency, snap, strides);
 }
 
 complex<double> *fields::get_complex_array_slice(const volume &where, component c, complex<double> *slice,
-                                                 double frequency, bool snap) {
+                                                 double frequency, bool snap,
+                                                 const ptrdiff_t *strides) {
   std::vector<component> components(1);
   components[0] = c;
   return (complex<double> *)do_get_array_slice(where, components, default_field_func, 0, 0, (void *)slice,
-                                       frequency, snap);
+                                       frequency, snap, strides);
+}
+
+std::vector<array_slice_box> fields::get_array_slice_boxes(const volume &where, component c,
+                                                           double frequency, bool snap,
+                                                           bool complex_data) {
+  std::vector<component> components(1);
+  components[0] = c;
+  std::vector<array_slice_box> boxes;
+  if (complex_data)
+    do_get_array_slice(where, components, default_field_func, 0, 0, 0, frequency, snap, 0, &boxes);
+  else
+    do_get_array_slice(where, components, 0, default_field_rfunc, 0, 0, frequency, snap, 0, &boxes);
+  return boxes;
+}
+
+std::vector<array_slice_box> fields::get_array_slice_boxes(const volume &where, derived_component c,
+                                                           double frequency, bool snap) {
+  int nfields;
+  component carray[12];
+  field_rfunction rfun = derived_component_func(c, gv, nfields, carray);
+  std::vector<component> cs(carray, carray + nfields);
+  std::vector<array_slice_box> boxes;
+  do_get_array_slice(where, cs, 0, rfun, &nfields, 0, frequency, snap, 0, &boxes);
+  return boxes;
 }
 
 complex<double> *fields::get_source_slice(const volume &where, component source_slice_component,
@@ -747,7 +969,9 @@ complex<double> *fields::get_source_slice(const volume &where, component source_
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
-std::vector<double> fields::get_array_metadata(const volume &where) {
+std::vector<double> fields::get_array_metadata(const volume &where, int stride) {
+
+  if (stride < 1) abort("invalid stride %d in get_array_metadata", stride);
 
   /* get extremal corners of subgrid and array of weights, collapsed if necessary */
   size_t dims[3];
@@ -757,8 +981,10 @@ std::vector<double> fields::get_array_metadata(const volume &where) {
 
   double *weights = get_array_slice(where, NO_COMPONENT);
 
-  /* get length and endpoints of x,y,z tics arrays */
-  size_t nxyz[3] = {1, 1, 1};
+  /* get length and endpoints of x,y,z tics arrays; for stride > 1 (a DFT   */
+  /* volume storing only every stride-th point) the tics are the points of  */
+  /* the coarser grid, which start at the first point of the full grid     */
+  size_t nxyz[3] = {1, 1, 1}, nfine[3] = {1, 1, 1};
   double xyzmin[3] = {0.0, 0.0, 0.0}, xyzmax[3] = {0.0, 0.0, 0.0};
   for (int nd = 0, rr = 0; nd < 3; ++nd) {
     direction d = direction(nd);
@@ -767,7 +993,8 @@ std::vector<double> fields::get_array_metadata(const volume &where) {
       nxyz[nd] = 1;
     }
     else {
-      nxyz[nd] = dims[rr++];
+      nfine[nd] = dims[rr++];
+      nxyz[nd] = (nfine[nd] - 1) / stride + 1;
       xyzmin[nd] = min_max_loc[0].in_direction(d);
       xyzmax[nd] = min_max_loc[1].in_direction(d);
     }
@@ -779,10 +1006,23 @@ std::vector<double> fields::get_array_metadata(const volume &where) {
   for (int nd = 0; nd < 3; nd++) {
     xyzw.push_back((double)nxyz[nd]);
     for (size_t n = 0; n < nxyz[nd]; n++)
-      xyzw.push_back(xyzmin[nd] + n * gv.inva);
+      xyzw.push_back(xyzmin[nd] + n * stride * gv.inva);
   }
-  for (unsigned nw = 0; nw < (nxyz[0] * nxyz[1] * nxyz[2]); nw++)
-    xyzw.push_back(weights[nw]);
+  const size_t wstart = xyzw.size();
+  xyzw.resize(wstart + nxyz[0] * nxyz[1] * nxyz[2], 0.0);
+
+  /* on a coarser grid, the weight of each point of the full grid goes to */
+  /* the nearest point of the coarser grid, so that the weights still sum */
+  /* to the integral over the volume                                      */
+  for (size_t i = 0; i < nfine[0]; ++i)
+    for (size_t j = 0; j < nfine[1]; ++j)
+      for (size_t k = 0; k < nfine[2]; ++k) {
+        size_t ic = std::min((i + stride / 2) / stride, nxyz[0] - 1);
+        size_t jc = std::min((j + stride / 2) / stride, nxyz[1] - 1);
+        size_t kc = std::min((k + stride / 2) / stride, nxyz[2] - 1);
+        xyzw[wstart + (ic * nxyz[1] + jc) * nxyz[2] + kc] +=
+            weights[(i * nfine[1] + j) * nfine[2] + k];
+      }
 
   delete[] weights;
   return xyzw;
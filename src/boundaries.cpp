@@ -412,11 +412,15 @@ void fields::connect_the_chunks() {
         }       // LOOP_OVER_VOL_NOTOWNED
     }           // FOR_COMPONENTS
 
-    // Allocating comm blocks as we go...
+    // Allocating comm blocks as we go... (not needed between two chunks
+    // owned by this process, which step_boundaries copies directly)
     FOR_FIELD_TYPES(ft) {
       for (int j = 0; j < num_chunks; j++) {
         delete[] comm_blocks[ft][j + i * num_chunks];
-        comm_blocks[ft][j + i * num_chunks] = new realnum[comm_size_tot(ft, j + i * num_chunks)];
+        comm_blocks[ft][j + i * num_chunks] =
+            (chunks[i]->is_mine() && chunks[j]->is_mine())
+                ? NULL
+                : new realnum[comm_size_tot(ft, j + i * num_chunks)];
       }
     }
   } // loop over i chunks
@@ -244,7 +244,7 @@ bool fields::solve_cw(double tol, int maxiters, complex<double> frequency, int L
   t = tsave;
 
   unset_solve_cw_omega();
-  update_dfts();
+  update_dfts(false); // a single sample for every DFT, regardless of decimation
 
   return !ierr;
 }
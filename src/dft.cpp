@@ -19,13 +19,17 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
 #include <algorithm>
 
 #include "meep.hpp"
 #include "meep_internals.hpp"
+#include "config.h"
 
 using namespace std;
 
+#define UNUSED(x) (void)x // silence compiler warnings
+
 namespace meep {
 
 std::vector<double> linspace(double freq_min, double freq_max, size_t Nfreq) {
@@ -49,6 +53,11 @@ struct dft_chunk_data { // for passing to field::loop_in_chunks as void*
   bool include_dV_and_interp_weights;
   bool sqrt_dV_and_interp_weights;
   bool empty_dim[5];
+  int batch_size;
+  int decimation_factor;
+  bool single_precision;
+  ivec stride, stride_origin; // see dft_chunk::stride
+  int list_id;
   dft_chunk *dft_chunks;
 };
 
@@ -96,28 +105,112 @@ dft_chunk::dft_chunk(fields_chunk *fc_, ivec is_, ivec ie_, vec s0_, vec s1_, ve
   const int Nomega = data->omega.size();
   omega = data->omega;
   dft_phase = new complex<double>[Nomega];
+  decimation_factor = data->decimation_factor;
+  dft_phase_step.resize(Nomega);
+  for (int i = 0; i < Nomega; ++i)
+    dft_phase_step[i] = polar(1.0, omega[i] * fc->dt * decimation_factor);
+  dft_phase_time = 0;
+  dft_phase_age = -1; // dft_phase not yet computed
+
+  stride = data->stride;
 
-  N = 1;
-  LOOP_OVER_DIRECTIONS(is.dim, d) { N *= (ie.in_direction(d) - is.in_direction(d)) / 2 + 1; }
-  dft = new complex<double>[N * Nomega];
-  for (size_t i = 0; i < N * Nomega; ++i)
-    dft[i] = 0.0;
+  // the weight of each point is the same at every timestep, so compute it once
+  const double avg_factor = avg2 ? 0.25 : (avg1 ? 0.5 : 1.0);
+  LOOP_OVER_IVECS(fc->gv, is, ie, idx) {
+    IVEC_LOOP_ILOC(fc->gv, iloc);
+    if (!stored_point(iloc)) continue;
+    index.push_back(idx);
+    double w = 1.0;
+    if (include_dV_and_interp_weights) {
+      w = IVEC_LOOP_WEIGHT(s0, s1, e0, e1, dV0 + dV1 * loop_i2);
+      if (sqrt_dV_and_interp_weights) w = sqrt(w);
+    }
+    weight.push_back(w * avg_factor);
+  }
+  N = index.size();
+
+  if (data->single_precision) {
+    dft = NULL;
+    dft_single = new complex<float>[N * Nomega];
+    for (size_t i = 0; i < N * Nomega; ++i)
+      dft_single[i] = 0.0;
+  }
+  else {
+    dft_single = NULL;
+    dft = new complex<double>[N * Nomega];
+    for (size_t i = 0; i < N * Nomega; ++i)
+      dft[i] = 0.0;
+  }
   for (int i = 0; i < 5; ++i)
     empty_dim[i] = data->empty_dim[i];
 
+  batch_size = data->batch_size;
+  nbatched = 0;
+  batch_numcmp = 1;
+  time_series = false;
+  batch_time0 = 0;
+  chirpz_length = 0;
+
   next_in_chunk = fc->dft_chunks;
   fc->dft_chunks = this;
   next_in_dft = data->dft_chunks;
+  list_id = data->list_id;
+  anchor_list = NULL;
+}
+
+dft_chunk::dft_chunk(component c_, const std::vector<double> &omega_, int list_id_) {
+  fc = NULL;
+  c = c_;
+  omega = omega_;
+  list_id = list_id_;
+  anchor_list = NULL;
+  next_in_chunk = next_in_dft = NULL;
+
+  N = 0;
+  dft = NULL;
+  dft_single = NULL;
+  dft_phase = NULL;
+  dft_phase_time = 0;
+  dft_phase_age = -1;
+  stored_weight = extra_weight = scale = 1.0;
+  include_dV_and_interp_weights = sqrt_dV_and_interp_weights = false;
+  dV0 = dV1 = 0;
+  for (int i = 0; i < 5; ++i)
+    empty_dim[i] = false;
+  sn = 0;
+  avg1 = avg2 = 0;
+  vc = 0;
+  decimation_factor = 1;
+
+  batch_size = 1;
+  nbatched = 0;
+  batch_numcmp = 1;
+  time_series = false;
+  batch_time0 = 0;
+  chirpz_length = 0;
+}
+
+bool dft_chunk::stored_point(const ivec &iloc) const {
+  if (stride == one_ivec(stride.dim)) return true;
+  ivec ilocS = S.transform(iloc, sn) + shift;
+  ivec isS = min(S.transform(is, sn), S.transform(ie, sn)) + shift;
+  LOOP_OVER_DIRECTIONS(ilocS.dim, d) {
+    if ((ilocS.in_direction(d) - isS.in_direction(d)) % (2 * stride.in_direction(d))) return false;
+  }
+  return true;
 }
 
 dft_chunk::~dft_chunk() {
   delete[] dft;
+  delete[] dft_single;
   delete[] dft_phase;
 
-  // delete from fields_chunk list
-  dft_chunk *cur = fc->dft_chunks;
+  // delete from fields_chunk list (or from the list of anchors)
+  dft_chunk **head = fc ? &fc->dft_chunks : anchor_list;
+  if (!head) return;
+  dft_chunk *cur = *head;
   if (cur == this)
-    fc->dft_chunks = next_in_chunk;
+    *head = next_in_chunk;
   else {
     while (cur && cur->next_in_chunk && cur->next_in_chunk != this)
       cur = cur->next_in_chunk;
@@ -148,15 +241,53 @@ static void add_dft_chunkloop(fields_chunk *fc, int ichunk, component cgrid, ive
   component c = S.transform(data->c, -sn);
   if (c >= NUM_FIELD_COMPONENTS || !fc->f[c][0]) return; // this chunk doesn't have component c
 
+  if (data->stride != one_ivec(is.dim)) {
+    // shrink [is,ie] to the points of the coarser grid, in the transformed coordinates
+    ivec isS = S.transform(is, sn) + shift, ieS = S.transform(ie, sn) + shift;
+    ivec lo = min(isS, ieS), hi = max(isS, ieS);
+    LOOP_OVER_DIRECTIONS(lo.dim, d) {
+      const int step = 2 * data->stride.in_direction(d), o = data->stride_origin.in_direction(d);
+      lo.set_direction(d, o + step * ((lo.in_direction(d) - o + step - 1) / step));
+      hi.set_direction(d, o + step * ((hi.in_direction(d) - o) / step));
+      if (lo.in_direction(d) > hi.in_direction(d)) return; // no stored points in this chunk
+    }
+    ivec lo0 = S.transform(lo - shift, -sn), hi0 = S.transform(hi - shift, -sn);
+    is = min(lo0, hi0);
+    ie = max(lo0, hi0);
+  }
+
   data->dft_chunks =
       new dft_chunk(fc, is, ie, s0, s1, e0, e1, dV0, dV1, c, cgrid == Centered,
                     shift_phase * S.phase_shift(c, sn), shift, S, sn, chunkloop_data);
 }
 
+// the lower corner of the points of data->c in the (transformed) chunks of the DFT volume
+static void dft_stride_origin_chunkloop(fields_chunk *fc, int ichunk, component cgrid, ivec is,
+                                        ivec ie, vec s0, vec s1, vec e0, vec e1, double dV0,
+                                        double dV1, ivec shift, complex<double> shift_phase,
+                                        const symmetry &S, int sn, void *chunkloop_data) {
+  UNUSED(ichunk);
+  UNUSED(cgrid);
+  UNUSED(s0);
+  UNUSED(s1);
+  UNUSED(e0);
+  UNUSED(e1);
+  UNUSED(dV0);
+  UNUSED(dV1);
+  UNUSED(shift_phase);
+
+  dft_chunk_data *data = (dft_chunk_data *)chunkloop_data;
+  component c = S.transform(data->c, -sn);
+  if (c >= NUM_FIELD_COMPONENTS || !fc->f[c][0]) return;
+  data->stride_origin =
+      min(data->stride_origin, min(S.transform(is, sn), S.transform(ie, sn)) + shift);
+}
+
 dft_chunk *fields::add_dft(component c, const volume &where, const double *freq, size_t Nfreq,
                            bool include_dV_and_interp_weights, complex<double> stored_weight,
                            dft_chunk *chunk_next, bool sqrt_dV_and_interp_weights,
-                           complex<double> extra_weight, bool use_centered_grid, int vc) {
+                           complex<double> extra_weight, bool use_centered_grid, int vc,
+                           int stride) {
   if (coordinate_mismatch(gv.dim, c)) return NULL;
 
   /* If you call add_dft before adding sources, it will do nothing
@@ -176,16 +307,43 @@ dft_chunk *fields::add_dft(component c, const volume &where, const double *freq,
     data.omega[i] = 2 * pi * freq[i];
   data.stored_weight = stored_weight;
   data.extra_weight = extra_weight;
-  data.dt_factor = dt / sqrt(2.0 * pi);
+  data.decimation_factor = dft_decimation ? dft_decimation : dft_decimation_factor(freq, Nfreq);
+  data.dt_factor = dt * data.decimation_factor / sqrt(2.0 * pi);
   data.include_dV_and_interp_weights = include_dV_and_interp_weights;
   data.sqrt_dV_and_interp_weights = sqrt_dV_and_interp_weights;
+  data.batch_size = dft_batch_size;
+  data.single_precision = dft_single_precision;
   data.empty_dim[0] = data.empty_dim[1] = data.empty_dim[2] = data.empty_dim[3] =
       data.empty_dim[4] = false;
   LOOP_OVER_DIRECTIONS(where.dim, d) { data.empty_dim[d] = where.in_direction(d) == 0; }
+  if (stride < 1) abort("invalid DFT stride %d", stride);
+  /* the interpolation and dV weights of the loop are those of the full grid, which
+     are wrong for the points of a coarser grid */
+  if (stride > 1 && include_dV_and_interp_weights)
+    abort("include_dV_and_interp_weights must be false for stride > 1 in add_dft");
+  data.stride = one_ivec(gv.dim);
+  LOOP_OVER_DIRECTIONS(gv.dim, d) {
+    if (!data.empty_dim[d]) data.stride.set_direction(d, stride);
+  }
+  if (stride > 1) { // the coarse grid starts at the lower corner of the whole DFT volume
+    data.stride_origin = one_ivec(gv.dim) * (INT_MAX / 2);
+    loop_in_chunks(dft_stride_origin_chunkloop, (void *)&data, where,
+                   use_centered_grid ? Centered : c);
+    am_now_working_on(MpiAllTime);
+    data.stride_origin = -max_to_all(-data.stride_origin);
+    finished_working();
+  }
+  data.list_id = dft_list_count++;
   data.dft_chunks = chunk_next;
   loop_in_chunks(add_dft_chunkloop, (void *)&data, where, use_centered_grid ? Centered : c);
 
-  return data.dft_chunks;
+  // the anchor of the new chunks (see dft_anchors), on every process
+  dft_chunk *anchor = new dft_chunk(c, data.omega, data.list_id);
+  anchor->next_in_dft = data.dft_chunks;
+  anchor->anchor_list = &dft_anchors;
+  anchor->next_in_chunk = dft_anchors;
+  dft_anchors = anchor;
+  return anchor;
 }
 
 dft_chunk *fields::add_dft(const volume_list *where, const std::vector<double> freq,
@@ -201,76 +359,466 @@ dft_chunk *fields::add_dft(const volume_list *where, const std::vector<double> f
   return chunks;
 }
 
-void fields::update_dfts() {
-  am_now_working_on(FourierTransforming);
+/* Sampling the fields every k timesteps aliases a frequency f to
+   f - 1/(k dt), so the spectrum of the sources (up to src_freq_max) stays
+   outside of the DFT frequencies (up to freq_max) if 1/(k dt) >=
+   freq_max + src_freq_max, which we require with a safety margin.  We
+   don't know the spectrum of the fields if there are no sources (e.g.
+   with initialize_field), custom sources, or nonlinear materials (which
+   generate harmonics), so there is no decimation in these cases. */
+int fields::dft_decimation_factor(const double *freq, size_t Nfreq) const {
+  const double safety_margin = 1.25;
+  double freq_max = 0;
+  for (size_t i = 0; i < Nfreq; ++i)
+    freq_max = std::max(freq_max, fabs(freq[i]));
+  double src_freq_max = 0;
+  for (const src_time *s = sources; s; s = s->next)
+    src_freq_max = std::max(src_freq_max, s->max_frequency());
+  bool nonlinear = false;
   for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine()) chunks[i]->update_dfts(time(), time() - 0.5 * dt);
+    if (chunks[i]->is_mine()) FOR_COMPONENTS(c) {
+        if (chunks[i]->s->chi2[c] || chunks[i]->s->chi3[c]) nonlinear = true;
+      }
+  nonlinear = or_to_all(nonlinear);
+  if (!sources || nonlinear || src_freq_max == infinity || freq_max + src_freq_max <= 0) return 1;
+  return std::max(1, int(floor(1 / (safety_margin * dt * (freq_max + src_freq_max)))));
+}
+
+void fields::set_dft_single_precision(bool single_precision) {
+  dft_single_precision = single_precision;
+}
+
+void fields::set_dft_decimation(int decimation) {
+  if (decimation < 0) abort("invalid DFT decimation factor %d", decimation);
+  dft_decimation = decimation;
+}
+
+/* The DFTs are updated in blocks of about dft_block_work frequency-point
+   products, which each add to their own rows of dft, so that the blocks
+   of all the DFTs (including the blocks of one large DFT volume) can be
+   processed by parallel threads without any synchronization. */
+static const size_t dft_block_work = 65536;
+
+void fields::update_dfts(bool decimate) {
+  am_now_working_on(FourierTransforming);
+  const double timeE = time(), timeH = time() - 0.5 * dt;
+
+  struct dft_block {
+    fields_chunk *fc;
+    dft_chunk *dft;
+    size_t start, end;
+  };
+  std::vector<dft_block> blocks;
+  std::vector<dft_chunk *> started;
+  for (int i : my_chunks_by_time()) {
+    double start = wall_time();
+    started.clear();
+    chunks[i]->start_dft_updates(timeE, timeH, decimate ? t : -1, started);
+    for (dft_chunk *cur : started) {
+      const size_t n = std::max(size_t(1), dft_block_work / std::max(size_t(1), cur->omega.size()));
+      for (size_t k = 0; k < cur->N; k += n)
+        blocks.push_back({chunks[i], cur, k, std::min(k + n, cur->N)});
+    }
+    chunks[i]->step_time += wall_time() - start;
+  }
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (size_t j = 0; j < blocks.size(); j++) {
+    double start = wall_time();
+    blocks[j].dft->update_points(blocks[j].start, blocks[j].end);
+    const double elapsed = wall_time() - start;
+#ifdef HAVE_OPENMP
+#pragma omp atomic
+#endif
+    blocks[j].fc->step_time += elapsed;
+  }
+
+  for (const dft_block &b : blocks)
+    if (b.end == b.dft->N) b.dft->finish_update();
   finished_working();
 }
 
-void fields_chunk::update_dfts(double timeE, double timeH) {
+/* Start the update of each DFT that takes a sample at this timestep.
+   current_step < 0 means a single sample of every DFT (e.g. from
+   solve_cw), without the decimation factor included in its scale. */
+void fields_chunk::start_dft_updates(double timeE, double timeH, int current_step,
+                                     std::vector<dft_chunk *> &started) {
   if (doing_solve_cw) return;
   for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_chunk) {
-    cur->update_dft(is_magnetic(cur->c) ? timeH : timeE);
+    const double time = is_magnetic(cur->c) ? timeH : timeE;
+    if (current_step < 0) {
+      if (cur->start_update(time, 1.0 / cur->decimation_factor)) started.push_back(cur);
+    }
+    else if (current_step % cur->decimation_factor == 0) {
+      if (cur->start_update(time)) started.push_back(cur);
+    }
   }
 }
 
-void dft_chunk::update_dft(double time) {
-  if (!fc->f[c][0]) return;
+void fields::flush_dfts() {
+  for (int i = 0; i < num_chunks; i++)
+    if (chunks[i]->is_mine())
+      for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+        cur->flush_dft();
+}
 
-  const int Nomega = omega.size();
-  for (int i = 0; i < Nomega; ++i)
-    dft_phase[i] = polar(1.0, omega[i] * time) * scale;
+void fields::set_dft_batch_size(int batch_size) {
+  if (batch_size < 1) abort("invalid DFT batch size %d", batch_size);
+  flush_dfts();
+  dft_batch_size = batch_size;
+  for (int i = 0; i < num_chunks; i++)
+    for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+      if (!cur->time_series) cur->batch_size = batch_size;
+}
 
-  int numcmp = fc->f[c][1] ? 2 : 1;
+/* The phases exp(iwt) are updated by the recurrence exp(iw(t+dt)) =
+   exp(iwt) exp(iw dt) (with dt the time between samples) instead of
+   calling polar() for every frequency at every sample.  They are
+   recomputed exactly every max_phase_age samples (so that roundoff errors
+   cannot accumulate) and whenever the time does not advance by exactly
+   one sample (e.g. after fields::reset). */
+static const int max_phase_age = 64;
 
-  size_t idx_dft = 0;
-  LOOP_OVER_IVECS(fc->gv, is, ie, idx) {
-    double w;
-    if (include_dV_and_interp_weights) {
-      w = IVEC_LOOP_WEIGHT(s0, s1, e0, e1, dV0 + dV1 * loop_i2);
-      if (sqrt_dV_and_interp_weights) w = sqrt(w);
+void dft_chunk::update_dft(double time, double rescale) {
+  if (!start_update(time, rescale)) return;
+  update_points(0, N);
+  finish_update();
+}
+
+bool dft_chunk::start_update(double time, double rescale) {
+  if (!fc->f[c][0]) return false;
+
+  const int Nomega = omega.size();
+  const double dt = fc->dt * decimation_factor; // time between samples
+  const int numcmp = fc->f[c][1] ? 2 : 1;
+  if (time_series) { // a batch must consist of equally spaced samples
+    if (nbatched > 0 && (numcmp != batch_numcmp ||
+                         fabs(time - (batch_time0 + nbatched * dt)) > 1e-3 * dt))
+      flush_dft();
+    if (nbatched == 0) {
+      batch_numcmp = numcmp;
+      batch_fields.resize(N * batch_size * numcmp);
+      batch_rescale.resize(batch_size);
+      batch_time0 = time;
     }
-    else
-      w = 1.0;
-    double f[2]; // real/imag field value at epsilon point
+    batch_rescale[nbatched] = rescale;
+    if (nbatched + 1 == batch_size) prepare_time_series_flush(batch_size);
+    return true;
+  }
+
+  if (dft_phase_age >= 0 && dft_phase_age < max_phase_age &&
+      fabs(time - (dft_phase_time + dt)) < 1e-3 * dt) {
+    for (int i = 0; i < Nomega; ++i)
+      dft_phase[i] *= dft_phase_step[i];
+    dft_phase_age++;
+  }
+  else {
+    for (int i = 0; i < Nomega; ++i)
+      dft_phase[i] = polar(1.0, omega[i] * time) * scale;
+    dft_phase_age = 0;
+  }
+  dft_phase_time = time;
+
+  if (nbatched > 0 && numcmp != batch_numcmp) flush_dft();
+  if (nbatched == 0) {
+    batch_numcmp = numcmp;
+    batch_fields.resize(N * batch_size * numcmp);
+    batch_phase.resize(size_t(batch_size) * Nomega);
+  }
+  for (int i = 0; i < Nomega; ++i)
+    batch_phase[size_t(nbatched) * Nomega + i] = dft_phase[i] * rescale;
+  return true;
+}
+
+// store the weighted field values at the epsilon points start <= k < end
+// as column nbatched of batch_fields, and add them to dft if the batch is full
+void dft_chunk::update_points(size_t start, size_t end) {
+  const int numcmp = batch_numcmp;
+  const size_t stride = size_t(batch_size) * numcmp;
+  for (int cmp = 0; cmp < numcmp; ++cmp) {
+    const realnum *fcmp = fc->f[c][cmp];
+    double *fb = &batch_fields[nbatched * numcmp + cmp];
     if (avg2)
-      for (int cmp = 0; cmp < numcmp; ++cmp)
-        f[cmp] = (w * 0.25) * (fc->f[c][cmp][idx] + fc->f[c][cmp][idx + avg1] +
-                               fc->f[c][cmp][idx + avg2] + fc->f[c][cmp][idx + (avg1 + avg2)]);
+      for (size_t k = start; k < end; ++k) {
+        const ptrdiff_t idx = index[k];
+        fb[stride * k] = weight[k] * (fcmp[idx] + fcmp[idx + avg1] + fcmp[idx + avg2] +
+                                      fcmp[idx + (avg1 + avg2)]);
+      }
     else if (avg1)
-      for (int cmp = 0; cmp < numcmp; ++cmp)
-        f[cmp] = (w * 0.5) * (fc->f[c][cmp][idx] + fc->f[c][cmp][idx + avg1]);
+      for (size_t k = start; k < end; ++k) {
+        const ptrdiff_t idx = index[k];
+        fb[stride * k] = weight[k] * (fcmp[idx] + fcmp[idx + avg1]);
+      }
     else
-      for (int cmp = 0; cmp < numcmp; ++cmp)
-        f[cmp] = w * fc->f[c][cmp][idx];
+      for (size_t k = start; k < end; ++k)
+        fb[stride * k] = weight[k] * fcmp[index[k]];
+  }
+  if (nbatched + 1 == batch_size) flush_points(start, end, batch_size);
+}
+
+void dft_chunk::finish_update() {
+  if (++nbatched == batch_size) nbatched = 0; // already added to dft by update_points
+}
+
+extern "C" void F77_FUNC(dgemm, DGEMM)(const char *transa, const char *transb, const int *m,
+                                       const int *n, const int *k, const double *alpha,
+                                       const double *A, const int *lda, const double *B,
+                                       const int *ldb, const double *beta, double *C,
+                                       const int *ldc);
+extern "C" void F77_FUNC(zgemm, ZGEMM)(const char *transa, const char *transb, const int *m,
+                                       const int *n, const int *k, const complex<double> *alpha,
+                                       const complex<double> *A, const int *lda,
+                                       const complex<double> *B, const int *ldb,
+                                       const complex<double> *beta, complex<double> *C,
+                                       const int *ldc);
+
+void dft_chunk::flush_dft() {
+  if (nbatched == 0) return;
+  if (time_series) prepare_time_series_flush(nbatched);
+  flush_points(0, N, nbatched);
+  nbatched = 0;
+}
+
+/* Add M buffered timesteps to the rows start <= k < end, stored from d on,
+   looping over the frequencies in the inner loop, over contiguous arrays of
+   reals (interleaved real/imaginary parts), which the compiler can vectorize. */
+static void add_batch(double *d, size_t start, size_t end, size_t n2, const double *ph,
+                      const double *F, int M, int batch_size, int numcmp) {
+  for (size_t k = start; k < end; ++k) {
+    double *dk = d + n2 * (k - start);
+    for (int m = 0; m < M; ++m) {
+      const double *p = ph + n2 * m;
+      if (numcmp == 2) {
+        const double fr = F[2 * (k * batch_size + m)], fi = F[2 * (k * batch_size + m) + 1];
+#ifdef HAVE_OPENMP
+#pragma omp simd
+#endif
+        for (size_t j = 0; j < n2; j += 2) {
+          dk[j] += p[j] * fr - p[j + 1] * fi;
+          dk[j + 1] += p[j] * fi + p[j + 1] * fr;
+        }
+      }
+      else {
+        const double fr = F[k * batch_size + m];
+#ifdef HAVE_OPENMP
+#pragma omp simd
+#endif
+        for (size_t j = 0; j < n2; ++j)
+          dk[j] += p[j] * fr;
+      }
+    }
+  }
+}
 
-    if (numcmp == 2) {
-      complex<double> fc(f[0], f[1]);
-      for (int i = 0; i < Nomega; ++i)
-        dft[Nomega * idx_dft + i] += dft_phase[i] * fc;
+/* Add the n double-precision partial sums x to the single-precision sums s,
+   with a single rounding of each sum. */
+static void add_to_single(float *s, const double *x, size_t n) {
+  for (size_t j = 0; j < n; ++j)
+    s[j] = float(double(s[j]) + x[j]);
+}
+
+/* Add M buffered timesteps to the rows start <= k < end of dft.  For
+   single-precision DFTs, the batch is summed in double precision, a block of
+   rows at a time (so that the double-precision partial sums only take the
+   memory of one block), and then added to dft_single with one rounding. */
+void dft_chunk::flush_points(size_t start, size_t end, int M) {
+  const size_t Nomega = omega.size();
+  if (Nomega == 0 || end <= start) return;
+  if (dft) {
+    add_points(dft + start * Nomega, start, end, M);
+    return;
+  }
+  const size_t rows = std::max(size_t(1), size_t(1 << 16) / Nomega);
+  std::vector<complex<double> > sum;
+  for (size_t k0 = start; k0 < end; k0 += rows) {
+    const size_t k1 = std::min(end, k0 + rows);
+    sum.assign((k1 - k0) * Nomega, 0.0);
+    add_points(&sum[0], k0, k1, M);
+    add_to_single(reinterpret_cast<float *>(dft_single + k0 * Nomega),
+                  reinterpret_cast<const double *>(&sum[0]), 2 * sum.size());
+  }
+}
+
+/* C += F * P for the rows start <= k < end, where C holds these rows of the
+   DFT, F = batch_fields is N x M and P = batch_phase is M x Nomega (both
+   row-major).  For real fields, P is real (M x 2Nomega) when viewed as an
+   array of doubles. */
+void dft_chunk::add_points(complex<double> *C, size_t start, size_t end, int M) {
+  const int Nomega = omega.size();
+  if (time_series && chirpz_length > 0) {
+    flush_time_series_points(C, start, end, M);
+    return;
+  }
+  const double *ph = reinterpret_cast<const double *>(&batch_phase[0]);
+  const double *F = &batch_fields[0];
+  const size_t n2 = 2 * size_t(Nomega);
+
+#ifdef HAVE_BLAS
+  if (M > 1 && end - start <= INT_MAX) {
+    // column-major BLAS: C^T += P^T * F^T
+    const int n = int(end - start), ldf = batch_size;
+    if (batch_numcmp == 2) {
+      const complex<double> one = 1.0;
+      F77_FUNC(zgemm, ZGEMM)
+      ("N", "N", &Nomega, &n, &M, &one, &batch_phase[0], &Nomega,
+       reinterpret_cast<const complex<double> *>(F) + start * ldf, &ldf, &one, C, &Nomega);
     }
     else {
-      double fr = f[0];
-      for (int i = 0; i < Nomega; ++i)
-        dft[Nomega * idx_dft + i] += dft_phase[i] * fr;
+      const int m = int(n2);
+      const double one = 1.0;
+      F77_FUNC(dgemm, DGEMM)
+      ("N", "N", &m, &n, &M, &one, ph, &m, F + start * ldf, &ldf, &one,
+       reinterpret_cast<double *>(C), &m);
     }
-    idx_dft++;
+    return;
   }
+#endif
+
+  add_batch(reinterpret_cast<double *>(C), start, end, n2, ph, F, M, batch_size, batch_numcmp);
+}
+
+void flush_dfts(dft_chunk *dft_chunks) {
+  for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_dft)
+    cur->flush_dft();
+}
+
+/* In-place FFT of a, of length n = 2^k, with the n/2 twiddle factors
+   w[j] = exp(-2 pi i j / n) (or their conjugates if inverse). */
+void fft_radix2(complex<double> *a, size_t n, const complex<double> *w, bool inverse) {
+  for (size_t i = 1, j = 0; i < n; ++i) { // bit-reversal permutation
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(a[i], a[j]);
+  }
+  double *x = reinterpret_cast<double *>(a);
+  const double *wx = reinterpret_cast<const double *>(w);
+  const double sign = inverse ? -1 : 1;
+  for (size_t len = 2; len <= n; len <<= 1) {
+    const size_t half = len / 2, step = n / len;
+    for (size_t i = 0; i < n; i += len)
+      for (size_t j = 0; j < half; ++j) {
+        const double wr = wx[2 * j * step], wi = sign * wx[2 * j * step + 1];
+        double *u = x + 2 * (i + j), *v = u + 2 * half;
+        const double vr = v[0] * wr - v[1] * wi, vi = v[0] * wi + v[1] * wr;
+        v[0] = u[0] - vr;
+        v[1] = u[1] - vi;
+        u[0] += vr;
+        u[1] += vi;
+      }
+  }
+}
+
+/* For equally spaced samples t_m = t_0 + m dt (0 <= m < M) and frequencies
+   w_k = w_0 + k dw, the DFT of the samples f_m of a point is
+     sum_m f_m exp(i w_k t_m) = exp(i w_k t_0 + i a k^2/2) sum_m
+        [f_m exp(i w_0 m dt + i a m^2/2)] exp(-i a (k-m)^2/2)
+   with a = dw dt, since km = (k^2 + m^2 - (k-m)^2)/2.  This is a convolution,
+   computed by FFTs of length L >= M + Nomega - 1 (Bluestein's algorithm).
+   If this costs more than adding the batch directly (for short batches), we
+   compute batch_phase instead. */
+void dft_chunk::prepare_time_series_flush(int M) {
+  const int Nomega = omega.size();
+  const double dt = fc->dt * decimation_factor;
+  size_t L = 1;
+  while (L < size_t(M) + Nomega - 1)
+    L *= 2;
+  if (2.0 * L * log2(double(L)) >= double(M) * Nomega) {
+    chirpz_length = 0;
+    batch_phase.resize(size_t(M) * Nomega);
+    for (int m = 0; m < M; ++m)
+      for (int k = 0; k < Nomega; ++k)
+        batch_phase[size_t(m) * Nomega + k] =
+            polar(batch_rescale[m], omega[k] * (batch_time0 + m * dt)) * scale;
+    return;
+  }
+
+  const double w0 = omega[0], dw = Nomega > 1 ? (omega[Nomega - 1] - w0) / (Nomega - 1) : 0;
+  const double a = dw * dt;
+  chirpz_length = L;
+  chirpz_twiddle.resize(L / 2);
+  for (size_t j = 0; j < L / 2; ++j)
+    chirpz_twiddle[j] = polar(1.0, -2 * pi * j / L);
+  chirpz_in.resize(M);
+  for (int m = 0; m < M; ++m)
+    chirpz_in[m] = polar(batch_rescale[m], w0 * m * dt + 0.5 * a * double(m) * m);
+  chirpz_filter.assign(L, 0.0);
+  for (int n = 0; n < std::max(M, Nomega); ++n) {
+    const complex<double> v = polar(1.0, -0.5 * a * double(n) * n);
+    if (n < Nomega) chirpz_filter[n] = v;
+    if (n > 0 && n < M) chirpz_filter[L - n] = v;
+  }
+  fft_radix2(&chirpz_filter[0], L, &chirpz_twiddle[0], false);
+  chirpz_out.resize(Nomega);
+  for (int k = 0; k < Nomega; ++k)
+    chirpz_out[k] = polar(1.0 / L, omega[k] * batch_time0 + 0.5 * a * double(k) * k) * scale;
+}
+
+/* add the chirp-z transform of the M recorded samples to the rows start <= k < end
+   of the DFT, which are stored in C */
+void dft_chunk::flush_time_series_points(complex<double> *C, size_t start, size_t end, int M) {
+  const int Nomega = omega.size();
+  const size_t L = chirpz_length;
+  std::vector<complex<double> > u(L);
+  const double *F = &batch_fields[0];
+  for (size_t k = start; k < end; ++k) {
+    for (int m = 0; m < M; ++m) {
+      const size_t i = k * batch_size + m;
+      const complex<double> f =
+          batch_numcmp == 2 ? complex<double>(F[2 * i], F[2 * i + 1]) : complex<double>(F[i]);
+      u[m] = f * chirpz_in[m];
+    }
+    std::fill(u.begin() + M, u.end(), 0.0);
+    fft_radix2(&u[0], L, &chirpz_twiddle[0], false);
+    for (size_t j = 0; j < L; ++j)
+      u[j] *= chirpz_filter[j];
+    fft_radix2(&u[0], L, &chirpz_twiddle[0], true);
+    for (int i = 0; i < Nomega; ++i)
+      C[(k - start) * Nomega + i] += u[i] * chirpz_out[i];
+  }
+}
+
+/* Switch to recording the fields of up to nsamples timesteps, whose DFT is
+   then computed by FFTs (see prepare_time_series_flush), so that the cost
+   per timestep no longer grows with the number of frequencies.  This needs
+   memory for nsamples field values per point, and equally spaced
+   frequencies. */
+void dft_chunk::record_time_series(int nsamples) {
+  if (nsamples < 1) abort("invalid time-series length %d", nsamples);
+  const int Nomega = omega.size();
+  for (int k = 1; k + 1 < Nomega; ++k) {
+    const double wk = omega[0] + (omega[Nomega - 1] - omega[0]) * k / (Nomega - 1);
+    if (fabs(omega[k] - wk) > 1e-12 * (fabs(omega[0]) + fabs(omega[Nomega - 1])))
+      abort("recording time series for a DFT requires equally spaced frequencies");
+  }
+  flush_dft();
+  time_series = true;
+  batch_size = nsamples;
+}
+
+void record_time_series(dft_chunk *dft_chunks, int nsamples) {
+  for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_dft)
+    cur->record_time_series(nsamples);
 }
 
 void dft_chunk::scale_dft(complex<double> scale) {
+  flush_dft();
   for (size_t i = 0; i < N * omega.size(); ++i)
-    dft[i] *= scale;
+    set_dft_value(i, dft_value(i) * scale);
   if (next_in_dft) next_in_dft->scale_dft(scale);
 }
 
 void dft_chunk::operator-=(const dft_chunk &chunk) {
   if (c != chunk.c || N * omega.size() != chunk.N * chunk.omega.size())
     abort("Mismatched chunks in dft_chunk::operator-=");
+  flush_dft();
+  const_cast<dft_chunk &>(chunk).flush_dft();
 
   for (size_t i = 0; i < N * omega.size(); ++i)
-    dft[i] -= chunk.dft[i];
+    set_dft_value(i, dft_value(i) - chunk.dft_value(i));
 
   if (next_in_dft) {
     if (!chunk.next_in_dft) abort("Mismatched chunk lists in dft_chunk::operator-=");
@@ -288,6 +836,7 @@ size_t dft_chunks_Ntotal(dft_chunk *dft_chunks, size_t *my_start) {
 
 // Note: the file must have been created in parallel mode, typically via fields::open_h5file.
 void save_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file, const char *dprefix) {
+  flush_dfts(dft_chunks);
   size_t istart;
   size_t n = dft_chunks_Ntotal(dft_chunks, &istart);
 
@@ -300,7 +849,15 @@ void save_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file, const
 
   for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_dft) {
     size_t Nchunk = cur->N * cur->omega.size() * 2;
-    file->write_chunk(1, &istart, &Nchunk, (double *)cur->dft);
+    if (Nchunk == 0) continue; // e.g. the anchors of the list
+    if (cur->dft)
+      file->write_chunk(1, &istart, &Nchunk, (double *)cur->dft);
+    else {
+      std::vector<double> buf(Nchunk);
+      for (size_t i = 0; i < Nchunk; ++i)
+        buf[i] = ((float *)cur->dft_single)[i];
+      file->write_chunk(1, &istart, &Nchunk, &buf[0]);
+    }
     istart += Nchunk;
   }
   file->done_writing_chunks();
@@ -311,6 +868,7 @@ void save_dft_hdf5(dft_chunk *dft_chunks, component c, h5file *file, const char
 }
 
 void load_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file, const char *dprefix) {
+  flush_dfts(dft_chunks); // so that buffered timesteps are not added to the loaded data
   size_t istart;
   size_t n = dft_chunks_Ntotal(dft_chunks, &istart);
 
@@ -328,7 +886,15 @@ void load_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file, const
 
   for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_dft) {
     size_t Nchunk = cur->N * cur->omega.size() * 2;
-    file->read_chunk(1, &istart, &Nchunk, (double *)cur->dft);
+    if (Nchunk == 0) continue; // e.g. the anchors of the list
+    if (cur->dft)
+      file->read_chunk(1, &istart, &Nchunk, (double *)cur->dft);
+    else {
+      std::vector<double> buf(Nchunk);
+      file->read_chunk(1, &istart, &Nchunk, &buf[0]);
+      for (size_t i = 0; i < Nchunk; ++i)
+        ((float *)cur->dft_single)[i] = buf[i];
+    }
     istart += Nchunk;
   }
 }
@@ -373,6 +939,8 @@ dft_flux::dft_flux(const dft_flux &f) : where(f.where) {
 }
 
 double *dft_flux::flux() {
+  flush_dfts(E);
+  flush_dfts(H);
   const size_t Nfreq = freq.size();
   double *F = new double[Nfreq];
   for (size_t i = 0; i < Nfreq; ++i)
@@ -381,7 +949,7 @@ double *dft_flux::flux() {
        curE = curE->next_in_dft, curH = curH->next_in_dft)
     for (size_t k = 0; k < curE->N; ++k)
       for (size_t i = 0; i < Nfreq; ++i)
-        F[i] += real(curE->dft[k * Nfreq + i] * conj(curH->dft[k * Nfreq + i]));
+        F[i] += real(curE->dft_value(k * Nfreq + i) * conj(curH->dft_value(k * Nfreq + i)));
   double *Fsum = new double[Nfreq];
   sum_to_all(F, Fsum, int(Nfreq));
   delete[] F;
@@ -496,6 +1064,8 @@ dft_energy::dft_energy(const dft_energy &f) : where(f.where) {
 }
 
 double *dft_energy::electric() {
+  flush_dfts(E);
+  flush_dfts(D);
   const size_t Nfreq = freq.size();
   double *F = new double[Nfreq];
   for (size_t i = 0; i < Nfreq; ++i)
@@ -504,7 +1074,7 @@ double *dft_energy::electric() {
        curE = curE->next_in_dft, curD = curD->next_in_dft)
     for (size_t k = 0; k < curE->N; ++k)
       for (size_t i = 0; i < Nfreq; ++i)
-        F[i] += 0.5 * real(conj(curE->dft[k * Nfreq + i]) * curD->dft[k * Nfreq + i]);
+        F[i] += 0.5 * real(conj(curE->dft_value(k * Nfreq + i)) * curD->dft_value(k * Nfreq + i));
   double *Fsum = new double[Nfreq];
   sum_to_all(F, Fsum, int(Nfreq));
   delete[] F;
@@ -512,6 +1082,8 @@ double *dft_energy::electric() {
 }
 
 double *dft_energy::magnetic() {
+  flush_dfts(H);
+  flush_dfts(B);
   const size_t Nfreq = freq.size();
   double *F = new double[Nfreq];
   for (size_t i = 0; i < Nfreq; ++i)
@@ -520,7 +1092,7 @@ double *dft_energy::magnetic() {
        curH = curH->next_in_dft, curB = curB->next_in_dft)
     for (size_t k = 0; k < curH->N; ++k)
       for (size_t i = 0; i < Nfreq; ++i)
-        F[i] += 0.5 * real(conj(curH->dft[k * Nfreq + i]) * curB->dft[k * Nfreq + i]);
+        F[i] += 0.5 * real(conj(curH->dft_value(k * Nfreq + i)) * curB->dft_value(k * Nfreq + i));
   double *Fsum = new double[Nfreq];
   sum_to_all(F, Fsum, int(Nfreq));
   delete[] F;
@@ -692,19 +1264,19 @@ dft_flux fields::add_dft_flux_plane(const volume &where, const std::vector<doubl
 
 dft_fields::dft_fields(dft_chunk *chunks_, double freq_min, double freq_max, int Nf,
                        const volume &where_)
-    : where(where_) {
+    : where(where_), stride(1) {
   chunks = chunks_;
   freq = meep::linspace(freq_min, freq_max, Nf);
 }
 
 dft_fields::dft_fields(dft_chunk *chunks_, const std::vector<double> freq_, const volume &where_)
-    : where(where_) {
+    : where(where_), stride(1) {
   chunks = chunks_;
   freq = freq_;
 }
 
 dft_fields::dft_fields(dft_chunk *chunks_, const double *freq_, size_t Nfreq, const volume &where_)
-    : freq(Nfreq), where(where_) {
+    : freq(Nfreq), where(where_), stride(1) {
   chunks = chunks_;
   for (size_t i = 0; i < Nfreq; ++i)
     freq[i] = freq_[i];
@@ -721,7 +1293,8 @@ void dft_fields::remove() {
 }
 
 dft_fields fields::add_dft_fields(component *components, int num_components, const volume where,
-                                  const double *freq, size_t Nfreq, bool use_centered_grid) {
+                                  const double *freq, size_t Nfreq, bool use_centered_grid,
+                                  int stride) {
   bool include_dV_and_interp_weights = false;
   bool sqrt_dV_and_interp_weights = false; // default option from meep.hpp (expose to user?)
   std::complex<double> extra_weight = 1.0; // default option from meep.hpp (expose to user?)
@@ -730,9 +1303,11 @@ dft_fields fields::add_dft_fields(component *components, int num_components, con
   for (int nc = 0; nc < num_components; nc++)
     chunks =
         add_dft(components[nc], where, freq, Nfreq, include_dV_and_interp_weights, stored_weight,
-                chunks, sqrt_dV_and_interp_weights, extra_weight, use_centered_grid);
+                chunks, sqrt_dV_and_interp_weights, extra_weight, use_centered_grid, 0, stride);
 
-  return dft_fields(chunks, freq, Nfreq, where);
+  dft_fields fdft(chunks, freq, Nfreq, where);
+  fdft.stride = stride;
+  return fdft;
 }
 
 /***************************************************************/
@@ -752,33 +1327,16 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
   /*****************************************************************/
   size_t start[3] = {0, 0, 0};
   size_t file_count[3] = {1, 1, 1}, array_count[3] = {1, 1, 1};
-  int file_offset[3] = {0, 0, 0};
-  int file_stride[3] = {1, 1, 1};
   ivec isS = S.transform(is, sn) + shift;
   ivec ieS = S.transform(ie, sn) + shift;
-
-  ivec permute(zero_ivec(fc->gv.dim));
-  for (int i = 0; i < 3; ++i)
-    permute.set_direction(fc->gv.yucky_direction(i), i);
-  permute = S.transform_unshifted(permute, sn);
-  LOOP_OVER_DIRECTIONS(permute.dim, d) { permute.set_direction(d, abs(permute.in_direction(d))); }
-
-  for (int i = 0; i < rank; ++i) {
-    direction d = ds[i];
-    int isd = isS.in_direction(d), ied = ieS.in_direction(d);
-    start[i] = (min(isd, ied) - min_corner.in_direction(d)) / 2;
-    file_count[i] = abs(ied - isd) / 2 + 1;
-    if (ied < isd) file_offset[permute.in_direction(d)] = file_count[i] - 1;
-    array_count[i] = (max_corner.in_direction(d) - min_corner.in_direction(d)) / 2 + 1;
-  }
+  ivec file_corner = min(isS, ieS);
 
   for (int i = 0; i < rank; ++i) {
     direction d = ds[i];
-    int j = permute.in_direction(d);
-    for (int k = i + 1; k < rank; ++k)
-      file_stride[j] *= file_count[k];
-    file_offset[j] *= file_stride[j];
-    if (file_offset[j]) file_stride[j] *= -1;
+    int isd = isS.in_direction(d), ied = ieS.in_direction(d), step = 2 * stride.in_direction(d);
+    start[i] = (min(isd, ied) - min_corner.in_direction(d)) / step;
+    file_count[i] = abs(ied - isd) / step + 1;
+    array_count[i] = (max_corner.in_direction(d) - min_corner.in_direction(d)) / step + 1;
   }
 
   /*****************************************************************/
@@ -805,6 +1363,9 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
   complex<double> integral = 0.0;
   component c_conjugate = (component)(ic_conjugate >= 0 ? ic_conjugate : -ic_conjugate);
   LOOP_OVER_IVECS(fc->gv, is, ie, idx) {
+    IVEC_LOOP_ILOC(fc->gv, iloc); // iloc <-- indices of parent point in Yee grid
+    if (!stored_point(iloc)) continue;
+    iloc = S.transform(iloc, sn) + shift; // iloc <-- indices of child point in Yee grid
     IVEC_LOOP_LOC(fc->gv, loc);
     loc = S.transform(loc, sn) + rshift;
     double w = IVEC_LOOP_WEIGHT(s0, s1, e0, e1, dV0 + dV1 * loop_i2);
@@ -817,7 +1378,7 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
                    ? parent->get_eps(loc)
                    : c_conjugate == Permeability
                          ? parent->get_mu(loc)
-                         : dft[omega.size() * (chunk_idx++) + num_freq] / stored_weight);
+                         : dft_value(omega.size() * (chunk_idx++) + num_freq) / stored_weight);
     if (include_dV_and_interp_weights) dft_val /= (sqrt_dV_and_interp_weights ? sqrt(w) : w);
 
     complex<double> mode1val = 0.0, mode2val = 0.0;
@@ -825,9 +1386,11 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
     if (mode2_data) mode2val = eigenmode_amplitude(mode2_data, loc, S.transform(c, sn));
 
     if (file) {
-      int idx2 = ((((file_offset[0] + file_offset[1] + file_offset[2]) + loop_i1 * file_stride[0]) +
-                   loop_i2 * file_stride[1]) +
-                  loop_i3 * file_stride[2]);
+      // the index of the point in this chunk's (row-major) block of the file
+      int idx2 = 0;
+      for (int i = rank - 1, fstride = 1; i >= 0; fstride *= file_count[i--])
+        idx2 += fstride * ((iloc - file_corner).in_direction(ds[i]) /
+                           (2 * stride.in_direction(ds[i])));
 
       dft_val *= interp_w;
 
@@ -835,9 +1398,7 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
       buffer[idx2] = reim ? imag(val) : real(val);
     }
     else if (field_array) {
-      IVEC_LOOP_ILOC(fc->gv, iloc);         // iloc <-- indices of parent point in Yee grid
-      iloc = S.transform(iloc, sn) + shift; // iloc <-- indices of child point in Yee grid
-      iloc -= min_corner;                   // iloc <-- 2*(indices of point in DFT array)
+      iloc -= min_corner; // iloc <-- 2*stride*(indices of point in DFT array)
 
       // the index of point n1 or (n1,n2) or (n1,n2,n3) in a 1D, 2D, or 3D array is
       // (for a 1D array) n1
@@ -845,8 +1406,8 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
       // (for a 3D array) n3 + n2*N3 + n1*N2*N3
       // where NI = number of points in Ith direction.
       int idx2 = 0;
-      for (int i = rank - 1, stride = 1; i >= 0; stride *= array_count[i--])
-        idx2 += stride * (iloc.in_direction(ds[i]) / 2);
+      for (int i = rank - 1, astride = 1; i >= 0; astride *= array_count[i--])
+        idx2 += astride * (iloc.in_direction(ds[i]) / (2 * stride.in_direction(ds[i])));
       field_array[idx2] = interp_w * dft_val;
     }
     else {
@@ -886,7 +1447,8 @@ complex<double> dft_chunk::process_dft_component(int rank, direction *ds, ivec m
 /*     set *pfield_array equal to a newly allocated buffer     */
 /*     populated on return with values of DFT field component  */
 /*     c, equivalent to writing the data to HDF5 and reading   */
-/*     it back into field_array.                               */
+/*     it back into field_array.  (if array_to_master is true, */
+/*     the array is only complete on the master process.)      */
 /*                                                             */
 /*  3. if both HDF5FileName and field_array are null: compute  */
 /*     and return an  overlap integral between                 */
@@ -908,7 +1470,8 @@ complex<double> fields::process_dft_component(dft_chunk **chunklists, int num_ch
                                               component c, const char *HDF5FileName, complex<double> **pfield_array,
                                               int *array_rank, size_t *array_dims, direction *array_dirs,
                                               void *mode1_data, void *mode2_data, component c_conjugate,
-                                              bool *first_component, bool retain_interp_weights) {
+                                              bool *first_component, bool retain_interp_weights,
+                                              bool array_to_master) {
 
   /***************************************************************/
   /***************************************************************/
@@ -917,8 +1480,13 @@ complex<double> fields::process_dft_component(dft_chunk **chunklists, int num_ch
   if (component_index(c) == -1) {
     ic_conjugate = -((int)c);
     num_chunklists = 1;
-    c = chunklists[0]->c;
+    dft_chunk *first = chunklists[0]; // the first chunk that is not an anchor, if any
+    while (first && !first->fc && first->next_in_dft)
+      first = first->next_in_dft;
+    c = first->c;
   }
+  for (int ncl = 0; ncl < num_chunklists; ncl++)
+    meep::flush_dfts(chunklists[ncl]); // not the fields::flush_dfts member
 
   /***************************************************************/
   /* get statistics on the volume slice **************************/
@@ -927,22 +1495,21 @@ complex<double> fields::process_dft_component(dft_chunk **chunklists, int num_ch
   size_t bufsz = 0;
   ivec min_corner = gv.round_vec(where->get_max_corner()) + one_ivec(gv.dim);
   ivec max_corner = gv.round_vec(where->get_min_corner()) - one_ivec(gv.dim);
+  ivec stride = one_ivec(gv.dim);
   for (int ncl = 0; ncl < num_chunklists; ncl++)
     for (dft_chunk *chunk = chunklists[ncl]; chunk; chunk = chunk->next_in_dft) {
-      if (chunk->c != c) continue;
+      if (!chunk->fc || chunk->c != c) continue;
       ivec isS = chunk->S.transform(chunk->is, chunk->sn) + chunk->shift;
       ivec ieS = chunk->S.transform(chunk->ie, chunk->sn) + chunk->shift;
       min_corner = min(min_corner, min(isS, ieS));
       max_corner = max(max_corner, max(isS, ieS));
-      size_t this_bufsz = 1;
-      LOOP_OVER_DIRECTIONS(chunk->fc->gv.dim, d) {
-        this_bufsz *= (chunk->ie.in_direction(d) - chunk->is.in_direction(d)) / 2 + 1;
-      }
-      bufsz = max(bufsz, this_bufsz);
+      stride = max(stride, chunk->stride);
+      bufsz = max(bufsz, chunk->N);
     }
   am_now_working_on(MpiAllTime);
   max_corner = max_to_all(max_corner);
   min_corner = -max_to_all(-min_corner); // i.e., min_to_all
+  stride = max_to_all(stride);
   finished_working();
 
   /***************************************************************/
@@ -954,7 +1521,9 @@ complex<double> fields::process_dft_component(dft_chunk **chunklists, int num_ch
   size_t array_size = 1;
   LOOP_OVER_DIRECTIONS(gv.dim, d) {
     if (rank >= 3) abort("too many dimensions in process_dft_component");
-    size_t n = std::max(0, (max_corner.in_direction(d) - min_corner.in_direction(d)) / 2 + 1);
+    size_t n = std::max(0, (max_corner.in_direction(d) - min_corner.in_direction(d)) /
+                                   (2 * stride.in_direction(d)) +
+                               1);
 
     if (n > 1) {
       ds[rank] = d;
@@ -1002,7 +1571,7 @@ complex<double> fields::process_dft_component(dft_chunk **chunklists, int num_ch
 
     for (int ncl = 0; ncl < num_chunklists; ncl++)
       for (dft_chunk *chunk = chunklists[ncl]; chunk; chunk = chunk->next_in_dft)
-        if (chunk->c == c)
+        if (chunk->fc && chunk->c == c)
           overlap += chunk->process_dft_component(rank, ds, min_corner, max_corner, num_freq, file,
                                                   buffer, reim, field_array, mode1_data, mode2_data,
                                                   ic_conjugate, retain_interp_weights, this);
@@ -1013,24 +1582,29 @@ complex<double> fields::process_dft_component(dft_chunk **chunklists, int num_ch
       delete file;
     }
     else if (field_array) {
-/***************************************************************/
-/* repeatedly call sum_to_all to consolidate full field array  */
-/* on all cores                                                */
-/***************************************************************/
-#define BUFSIZE 1 << 16 // use 64k buffer
-      complex<double> *buf = new complex<double>[BUFSIZE];
-      ptrdiff_t offset = 0;
-      size_t remaining = array_size;
-      while (remaining != 0) {
-        size_t size = (remaining > BUFSIZE ? BUFSIZE : remaining);
-        am_now_working_on(MpiAllTime);
-        sum_to_all(field_array + offset, buf, size);
-        finished_working();
-        memcpy(field_array + offset, buf, size * sizeof(complex<double>));
-        remaining -= size;
-        offset += size;
-      }
-      delete[] buf;
+      // each process sends only the boxes of the array filled in by its own chunks
+      size_t gdims[3] = {1, 1, 1};
+      std::vector<array_box> boxes;
+      for (int i = 0; i < rank; ++i)
+        gdims[i] = dims[i];
+      for (int ncl = 0; ncl < num_chunklists; ncl++)
+        for (dft_chunk *chunk = chunklists[ncl]; chunk; chunk = chunk->next_in_dft) {
+          if (!chunk->fc || chunk->c != c) continue;
+          ivec isS = chunk->S.transform(chunk->is, chunk->sn) + chunk->shift;
+          ivec ieS = chunk->S.transform(chunk->ie, chunk->sn) + chunk->shift;
+          array_box box = {{0, 0, 0}, {1, 1, 1}};
+          for (int i = 0; i < rank; ++i) {
+            direction d = ds[i];
+            int isd = isS.in_direction(d), ied = ieS.in_direction(d);
+            int step = 2 * stride.in_direction(d);
+            box.start[i] = (min(isd, ied) - min_corner.in_direction(d)) / step;
+            box.count[i] = abs(ied - isd) / step + 1;
+          }
+          boxes.push_back(box);
+        }
+      am_now_working_on(MpiAllTime);
+      gather_array_boxes((double *)field_array, gdims, 2, boxes, !array_to_master);
+      finished_working();
     }
   } // for(int reim=0; reim<=reim_max; reim++)
 
@@ -1139,7 +1713,7 @@ void fields::output_dft_components(dft_chunk **chunklists, int num_chunklists, v
         size_t dims[3];
         direction dirs[3];
         process_dft_component(chunklists, num_chunklists, num_freq, c, 0, &array, &rank, dims,
-                              dirs);
+                              dirs, 0, 0, Ex, 0, true, true /* array_to_master */);
         if (rank > 0 && am_master()) {
           array = collapse_array(array, &rank, dims, dirs, dft_volume);
           if (rank == 0) abort("%s:%i: internal error", __FILE__, __LINE__);
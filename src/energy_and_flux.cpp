@@ -184,7 +184,7 @@ double fields::thermo_energy_in_box(const volume &where) {
 
 /* Compute ExH integral in box using current fields, ignoring fact
    that this E and H correspond to different times. */
-double fields::flux_in_box_wrongH(direction d, const volume &where) {
+double fields::flux_in_box_wrongH(direction d, const volume &where, bool parallel) {
   if (coordinate_mismatch(gv.dim, d)) return 0.0;
 
   component cE[2] = {Ey, Ez}, cH[2] = {Hz, Hy};
@@ -207,7 +207,7 @@ double fields::flux_in_box_wrongH(direction d, const volume &where) {
     component cs[2];
     cs[0] = cE[i];
     cs[1] = cH[i];
-    sum += real(integrate(2, cs, dot_integrand, 0, where)) * (1 - 2 * i);
+    sum += real(integrate(2, cs, dot_integrand, 0, where, 0, parallel)) * (1 - 2 * i);
   }
   return sum;
 }
@@ -31,6 +31,15 @@ fields::fields(structure *s, double m, double beta, bool zero_fields_near_cylori
     : S(s->S), gv(s->gv), user_volume(s->user_volume), v(s->v), m(m), beta(beta) {
   shared_chunks = s->shared_chunks;
   components_allocated = false;
+  dft_batch_size = 1;
+  dft_decimation = 1;
+  dft_single_precision = false;
+  dft_anchors = NULL;
+  dft_list_count = 0;
+  output_async = false;
+  output_queue_bytes = size_t(1) << 30;
+  output_deflate_level = 0;
+  output_abs_tolerance = 0;
   synchronized_magnetic_fields = 0;
   outdir = new char[strlen(s->outdir) + 1];
   strcpy(outdir, s->outdir);
@@ -87,6 +96,15 @@ fields::fields(const fields &thef)
     : S(thef.S), gv(thef.gv), user_volume(thef.user_volume), v(thef.v) {
   shared_chunks = thef.shared_chunks;
   components_allocated = thef.components_allocated;
+  dft_batch_size = thef.dft_batch_size;
+  dft_decimation = thef.dft_decimation;
+  dft_single_precision = thef.dft_single_precision;
+  dft_anchors = NULL;
+  dft_list_count = 0;
+  output_async = thef.output_async;
+  output_queue_bytes = thef.output_queue_bytes;
+  output_deflate_level = thef.output_deflate_level;
+  output_abs_tolerance = thef.output_abs_tolerance;
   synchronized_magnetic_fields = thef.synchronized_magnetic_fields;
   outdir = new char[strlen(thef.outdir) + 1];
   strcpy(outdir, thef.outdir);
@@ -129,6 +147,7 @@ fields::fields(const fields &thef)
 }
 
 fields::~fields() {
+  if (output_async) flush_output();
   for (int i = 0; i < num_chunks; i++)
     delete chunks[i];
   delete[] chunks;
@@ -142,6 +161,8 @@ fields::~fields() {
   delete sources;
   delete fluxes;
   delete[] outdir;
+  while (dft_anchors)
+    delete dft_anchors;
 }
 
 void fields::use_real_fields() {
@@ -213,6 +234,7 @@ fields_chunk::fields_chunk(structure_chunk *the_s, const char *od, double m, dou
       beta(beta) {
   s = the_s;
   chunk_idx = chunkidx;
+  step_time = 0;
   s->refcount++;
   outdir = od;
   new_s = NULL;
@@ -270,6 +292,7 @@ fields_chunk::fields_chunk(structure_chunk *the_s, const char *od, double m, dou
 
 fields_chunk::fields_chunk(const fields_chunk &thef, int chunkidx) : gv(thef.gv), v(thef.v) {
   chunk_idx = chunkidx;
+  step_time = 0;
   s = thef.s;
   s->refcount++;
   outdir = thef.outdir;
@@ -386,6 +409,12 @@ void fields_chunk::changing_structure() {
   if (s->refcount > 1) { // this chunk is shared, so make a copy
     s->refcount--;
     s = new structure_chunk(s);
+    // the polarization states must refer to the susceptibilities (sigma) of the copy
+    FOR_FIELD_TYPES(ft) {
+      susceptibility *chiP = s->chiP[ft];
+      for (polarization_state *p = pol[ft]; p && chiP; p = p->next, chiP = chiP->next)
+        p->s = chiP;
+    }
   }
 }
 
@@ -0,0 +1,318 @@
+/* Copyright (C) 2005-2021 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+// Dump/load the time-domain state of the fields to/from an HDF5 file,
+// for checkpointing a run.  Only works if the chunks are the same.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "meep.hpp"
+#include "meep_internals.hpp"
+
+using namespace std;
+
+namespace meep {
+
+/* The state of a fields_chunk in the file is a header (of array sizes,
+   0 for arrays that are not allocated, and flags) and the values of
+   the arrays, which are written to and read from the file directly.
+   As in rebalance.cpp, the same code walks the chunk data for dumping
+   and for loading, so that the two always agree on the layout; it is
+   first walked in COUNT mode to compute the header and the number of
+   values of each chunk. */
+class chunk_state {
+public:
+  enum mode_t { COUNT, DUMP, LOAD };
+  chunk_state(mode_t mode, h5file *file = NULL, size_t start = 0)
+      : mode(mode), file(file), pos(start), hpos(0) {}
+
+  mode_t mode;
+  std::vector<size_t> header;
+  size_t num_values() const { return pos; } // the end of the values of the chunk
+
+  size_t entry(size_t n) { // n, or the value in the file when loading
+    if (mode != LOAD) {
+      header.push_back(n);
+      return n;
+    }
+    if (hpos >= header.size()) abort("chunk mismatch in fields::load");
+    return header[hpos++];
+  }
+  template <class T> void values(T *a, size_t n) { // an existing array of n values
+    const size_t m = entry(n);
+    if (m != n) abort("size mismatch %zd vs. %zd in fields::load", m, n);
+    copy(a, n);
+  }
+  void scalar(double &x) { values(&x, 1); }
+  void scalar(int &i) {
+    double x = i;
+    scalar(x);
+    i = int(x);
+  }
+  void array(realnum *&a, size_t n) { // an array of n values that may be NULL
+    const size_t m = entry(a ? n : 0);
+    if (mode == LOAD) {
+      if (m == 0) {
+        delete[] a;
+        a = NULL;
+        return;
+      }
+      if (m != n) abort("size mismatch %zd vs. %zd in fields::load", m, n);
+      if (!a) a = new realnum[n];
+    }
+    copy(a, m);
+  }
+  template <class T> void vector(std::vector<T> &v) { // resized when loading
+    const size_t m = entry(v.size());
+    if (mode == LOAD) v.resize(m);
+    copy(v.data(), m);
+  }
+
+private:
+  h5file *file;
+  size_t pos;  // the position in the data of the file
+  size_t hpos; // the position in the header when loading
+
+  template <class T> void copy(T *a, size_t n) {
+    if (n == 0) return;
+    if (mode == DUMP) file->write_chunk(1, &pos, &n, a);
+    if (mode == LOAD) file->read_chunk(1, &pos, &n, a);
+    pos += n;
+  }
+  template <class T> void copy(std::complex<T> *a, size_t n) {
+    copy(reinterpret_cast<T *>(a), 2 * n);
+  }
+};
+
+/* The DFT accumulators, including any timesteps that are buffered
+   for the next flush_dft, so that the restarted run is identical. */
+static void walk_dft_chunk(dft_chunk *dc, chunk_state &b) {
+  const size_t n = dc->N * dc->omega.size();
+  if (dc->dft)
+    b.values(dc->dft, n);
+  else
+    b.values(dc->dft_single, n);
+  b.values(dc->dft_phase, dc->omega.size());
+  b.scalar(dc->dft_phase_time);
+  b.scalar(dc->dft_phase_age);
+  if (b.entry(dc->batch_size) != size_t(dc->batch_size))
+    abort("DFT batch size mismatch in fields::load");
+  b.scalar(dc->nbatched);
+  if (dc->nbatched > 0) {
+    b.scalar(dc->batch_numcmp);
+    b.scalar(dc->batch_time0);
+    b.vector(dc->batch_fields);
+    b.vector(dc->batch_phase);
+    b.vector(dc->batch_rescale);
+  }
+}
+
+static void walk_fields_chunk(fields_chunk *fc, chunk_state &b) {
+  const size_t ntot = fc->gv.ntot();
+
+  // for mu=1 non-PML regions, H==B: only store the array once
+  bool H_is_B[NUM_FIELD_COMPONENTS][2];
+  FOR_H_AND_B(hc, bc) DOCMP2 {
+    const bool same = fc->f[hc][cmp] && fc->f[hc][cmp] == fc->f[bc][cmp];
+    H_is_B[hc][cmp] = b.entry(same) != 0;
+    if (same)
+      fc->f[hc][cmp] = NULL;
+    else if (H_is_B[hc][cmp]) { // when loading into separate H and B arrays
+      delete[] fc->f[hc][cmp];
+      fc->f[hc][cmp] = NULL;
+    }
+  }
+  FOR_COMPONENTS(c) DOCMP2 {
+    b.array(fc->f[c][cmp], ntot);
+    b.array(fc->f_u[c][cmp], ntot);
+    b.array(fc->f_w[c][cmp], ntot);
+    b.array(fc->f_cond[c][cmp], ntot);
+    b.array(fc->f_minus_p[c][cmp], ntot);
+    b.array(fc->f_w_prev[c][cmp], ntot);
+  }
+  FOR_H_AND_B(hc, bc) DOCMP2 {
+    if (H_is_B[hc][cmp]) fc->f[hc][cmp] = fc->f[bc][cmp];
+  }
+
+  // internal polarization data (which needs the fields above to be allocated)
+  FOR_FIELD_TYPES(ft) {
+    size_t npol = 0;
+    for (polarization_state *p = fc->pol[ft]; p; p = p->next)
+      ++npol;
+    if (b.entry(npol) != npol) abort("susceptibility mismatch in fields::load");
+    for (polarization_state *p = fc->pol[ft]; p; p = p->next) {
+      const bool have = b.entry(p->data != NULL) != 0;
+      if (b.mode == chunk_state::LOAD) {
+        if (have && !p->data) {
+          p->data = p->s->new_internal_data(fc->f, fc->gv);
+          p->s->init_internal_data(fc->f, fc->dt, fc->gv, p->data);
+        }
+        else if (!have && p->data) {
+          p->s->delete_internal_data(p->data);
+          p->data = NULL;
+        }
+      }
+      if (!have) continue;
+      size_t n;
+      realnum *vals = p->s->internal_data_values(p->data, &n);
+      b.values(vals, n);
+    }
+  }
+
+  size_t ndft = 0;
+  for (dft_chunk *dc = fc->dft_chunks; dc; dc = dc->next_in_chunk)
+    ++ndft;
+  if (b.entry(ndft) != ndft) abort("DFT monitor mismatch in fields::load");
+  for (dft_chunk *dc = fc->dft_chunks; dc; dc = dc->next_in_chunk)
+    walk_dft_chunk(dc, b);
+}
+
+void fields::dump(const char *filename) {
+  if (verbosity > 0) master_printf("creating fields output file \"%s\"...\n", filename);
+  if (synchronized_magnetic_fields || is_phasing())
+    abort("cannot dump the fields while phasing in materials or with synchronized fields");
+  am_now_working_on(FieldOutput);
+
+  // the header of each chunk, and the number of values of each chunk
+  std::vector<chunk_state> states;
+  std::vector<size_t> num_header_(num_chunks, 0), num_values_(num_chunks, 0);
+  for (int i = 0; i < num_chunks; i++) {
+    states.push_back(chunk_state(chunk_state::COUNT));
+    if (chunks[i]->is_mine()) {
+      walk_fields_chunk(chunks[i], states[i]);
+      num_header_[i] = states[i].header.size();
+      num_values_[i] = states[i].num_values();
+    }
+  }
+  std::vector<size_t> num_header(num_chunks), num_values(num_chunks);
+  sum_to_all(num_header_.data(), num_header.data(), num_chunks);
+  sum_to_all(num_values_.data(), num_values.data(), num_chunks);
+  size_t header_total = 0, values_total = 0;
+  for (int i = 0; i < num_chunks; i++) {
+    header_total += num_header[i];
+    values_total += num_values[i];
+  }
+
+  h5file file(filename, h5file::WRITE, true);
+  size_t params[3] = {size_t(t), size_t(is_real), size_t(num_chunks)};
+  size_t len = 3, start = 0;
+  file.create_data("fields_params", 1, &len, false /* append_data */,
+                   false /* single_precision */);
+  if (am_master()) file.write_chunk(1, &start, &len, params);
+  len = 1;
+  file.create_data("dt", 1, &len, false /* append_data */, false /* single_precision */);
+  if (am_master()) file.write_chunk(1, &start, &len, &dt);
+
+  len = num_chunks;
+  file.create_data("num_header", 1, &len, false /* append_data */,
+                   false /* single_precision */);
+  if (am_master()) file.write_chunk(1, &start, &len, num_header.data());
+  file.create_data("num_values", 1, &len, false /* append_data */,
+                   false /* single_precision */);
+  if (am_master()) file.write_chunk(1, &start, &len, num_values.data());
+
+  file.create_data("header", 1, &header_total, false /* append_data */,
+                   false /* single_precision */);
+  for (int i = 0; i < num_chunks; i++) {
+    if (chunks[i]->is_mine() && num_header[i])
+      file.write_chunk(1, &start, &num_header[i], states[i].header.data());
+    start += num_header[i];
+  }
+
+  // the values are written directly from the arrays of the chunks, in double precision
+  file.create_data("values", 1, &values_total, false /* append_data */,
+                   false /* single_precision */);
+  start = 0;
+  for (int i = 0; i < num_chunks; i++) {
+    if (chunks[i]->is_mine()) {
+      chunk_state b(chunk_state::DUMP, &file, start);
+      walk_fields_chunk(chunks[i], b);
+    }
+    start += num_values[i];
+  }
+  finished_working();
+}
+
+void fields::load(const char *filename) {
+  if (verbosity > 0) master_printf("reading fields from file \"%s\"...\n", filename);
+  if (synchronized_magnetic_fields || is_phasing())
+    abort("cannot load the fields while phasing in materials or with synchronized fields");
+  h5file file(filename, h5file::READONLY, true);
+
+  int rank;
+  size_t dims[3], start = 0;
+  size_t params[3];
+  file.read_size("fields_params", &rank, dims, 1);
+  if (rank != 1 || dims[0] != 3) abort("inconsistent data size in fields::load");
+  if (am_master()) file.read_chunk(1, &start, dims, params);
+  double file_dt = 0;
+  file.read_size("dt", &rank, dims, 1);
+  if (rank != 1 || dims[0] != 1) abort("inconsistent data size in fields::load");
+  if (am_master()) file.read_chunk(1, &start, dims, &file_dt);
+  file.prevent_deadlock();
+  broadcast(0, params, 3);
+  file_dt = broadcast(0, file_dt);
+  if (params[2] != size_t(num_chunks)) abort("chunk mismatch in fields::load");
+  if (params[1] != size_t(is_real)) abort("real/complex fields mismatch in fields::load");
+  if (file_dt != dt) abort("timestep mismatch %g vs. %g in fields::load", file_dt, dt);
+
+  std::vector<size_t> num_header(num_chunks), num_values(num_chunks);
+  file.read_size("num_header", &rank, dims, 1);
+  if (rank != 1 || dims[0] != size_t(num_chunks)) abort("chunk mismatch in fields::load");
+  if (am_master()) file.read_chunk(1, &start, dims, num_header.data());
+  file.read_size("num_values", &rank, dims, 1);
+  if (rank != 1 || dims[0] != size_t(num_chunks)) abort("chunk mismatch in fields::load");
+  if (am_master()) file.read_chunk(1, &start, dims, num_values.data());
+  file.prevent_deadlock();
+  broadcast(0, num_header.data(), num_chunks);
+  broadcast(0, num_values.data(), num_chunks);
+
+  std::vector<std::vector<size_t> > headers(num_chunks);
+  file.read_size("header", &rank, dims, 1);
+  for (int i = 0; i < num_chunks; i++) {
+    if (chunks[i]->is_mine() && num_header[i]) {
+      headers[i].resize(num_header[i]);
+      file.read_chunk(1, &start, &num_header[i], headers[i].data());
+    }
+    start += num_header[i];
+  }
+
+  file.read_size("values", &rank, dims, 1);
+  start = 0;
+  for (int i = 0; i < num_chunks; i++) {
+    if (chunks[i]->is_mine()) {
+      chunk_state b(chunk_state::LOAD, &file, start);
+      b.header.swap(headers[i]);
+      walk_fields_chunk(chunks[i], b);
+      if (b.num_values() != start + num_values[i]) abort("chunk mismatch in fields::load");
+      chunks[i]->figure_out_step_plan();
+      FOR_FIELD_TYPES(ft) { // the arrays may have been reallocated: see find_metals
+        delete[] chunks[i]->zeroes[ft];
+        chunks[i]->zeroes[ft] = NULL;
+        chunks[i]->num_zeroes[ft] = 0;
+      }
+    }
+    start += num_values[i];
+  }
+  t = int(params[0]);
+  chunk_connections_valid = false;
+}
+
+} // namespace meep
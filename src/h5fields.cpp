@@ -19,6 +19,9 @@
    very similarly to integrate.cpp (using fields::loop_in_chunks). */
 
 #include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -31,6 +34,12 @@ namespace meep {
 
 /***************************************************************************/
 
+// a chunk of output that is staged for writing by the asynchronous output thread
+struct h5_staged_chunk {
+  size_t start[3], count[3];
+  std::vector<double> data;
+};
+
 typedef struct {
   // information related to the HDF5 dataset (its size, etcetera)
   h5file *file;
@@ -40,6 +49,7 @@ typedef struct {
   size_t bufsz;
   int rank;
   direction ds[3];
+  std::vector<h5_staged_chunk> *staged; // if non-NULL, stage the chunks instead of writing
 
   int reim; // whether to output the real or imaginary part
 
@@ -137,6 +147,19 @@ static void h5_output_chunkloop(fields_chunk *fc, int ichnk, component cgrid, iv
     if (offset[j]) stride[j] *= -1;
   }
 
+  double *buf = data->buf;
+  if (data->staged) {
+    data->staged->push_back(h5_staged_chunk());
+    h5_staged_chunk &chunk = data->staged->back();
+    size_t n = 1;
+    for (int i = 0; i < 3; ++i) {
+      chunk.start[i] = start[i];
+      n *= (chunk.count[i] = count[i]);
+    }
+    chunk.data.resize(n);
+    buf = chunk.data.data();
+  }
+
   //-----------------------------------------------------------------------//
   // Compute the function to output, exactly as in fields::integrate,
   // except that here we store its values in a buffer instead of integrating.
@@ -213,12 +236,21 @@ static void h5_output_chunkloop(fields_chunk *fc, int ichnk, component cgrid, iv
     ptrdiff_t idx2 =
         ((((offset[0] + offset[1] + offset[2]) + loop_i1 * stride[0]) + loop_i2 * stride[1]) +
          loop_i3 * stride[2]);
-    data->buf[idx2] = data->reim ? imag(fun) : real(fun);
+    buf[idx2] = data->reim ? imag(fun) : real(fun);
   }
 
   //-----------------------------------------------------------------------//
 
-  data->file->write_chunk(data->rank, start, count, data->buf);
+  if (!data->staged) data->file->write_chunk(data->rank, start, count, buf);
+}
+
+/* delete a file that was opened by output_hdf5, after any asynchronous
+   output to it has been written */
+static void delete_h5file(h5file *file, bool async, size_t max_bytes) {
+  if (async)
+    h5io_async([file]() { delete file; }, 0, max_bytes);
+  else
+    delete file;
 }
 
 void fields::output_hdf5(h5file *file, const char *dataname, int num_fields,
@@ -237,7 +269,7 @@ void fields::output_hdf5(h5file *file, const char *dataname, int num_fields,
 
   loop_in_chunks(h5_findsize_chunkloop, (void *)&data, where, Centered, true, true);
 
-  file->prevent_deadlock(); // can't hold a lock since *_to_all is collective
+  if (!output_async) file->prevent_deadlock(); // can't hold a lock since *_to_all is collective
   am_now_working_on(MpiAllTime);
   data.max_corner = max_to_all(data.max_corner);
   data.min_corner = -max_to_all(-data.min_corner); // i.e., min_to_all
@@ -259,9 +291,20 @@ void fields::output_hdf5(h5file *file, const char *dataname, int num_fields,
   }
   data.rank = rank;
 
-  file->create_or_extend_data(dataname, rank, dims, append_data, single_precision);
-
-  data.buf = new double[data.bufsz];
+  const int deflate_level = output_deflate_level;
+  const double abs_tolerance = output_abs_tolerance;
+  const bool compress = deflate_level > 0;
+  std::vector<h5_staged_chunk> staged;
+  if (output_async) {
+    data.buf = NULL;
+    data.staged = &staged;
+  }
+  else {
+    if (compress) file->set_compression(deflate_level, abs_tolerance);
+    file->create_or_extend_data(dataname, rank, dims, append_data, single_precision);
+    data.buf = new double[data.bufsz];
+    data.staged = NULL;
+  }
 
   data.num_fields = num_fields;
   data.components = components;
@@ -313,10 +356,51 @@ void fields::output_hdf5(h5file *file, const char *dataname, int num_fields,
   delete[] data.ph;
   delete[] data.cS;
   delete[] data.buf;
-  file->done_writing_chunks();
+  if (output_async) {
+    // the rest (including the file creation) is done by the output thread
+    size_t bytes = 0;
+    for (size_t i = 0; i < staged.size(); ++i)
+      bytes += staged[i].data.size() * sizeof(double);
+    std::shared_ptr<std::vector<h5_staged_chunk> > chunks =
+        std::make_shared<std::vector<h5_staged_chunk> >(std::move(staged));
+    std::string name(dataname);
+    h5io_async(
+        [=]() {
+          if (compress) file->set_compression(deflate_level, abs_tolerance);
+          file->create_or_extend_data(name.c_str(), rank, dims, append_data, single_precision);
+          for (size_t i = 0; i < chunks->size(); ++i)
+            file->write_chunk(rank, (*chunks)[i].start, (*chunks)[i].count,
+                              (*chunks)[i].data.data());
+          file->done_writing_chunks();
+        },
+        bytes, output_queue_bytes);
+  }
+  else
+    file->done_writing_chunks();
   finished_working();
 }
 
+void fields::set_output_async(bool async, size_t max_queued_bytes) {
+  // the HDF5 calls are collective, and can't be made from the output thread
+  if (async && count_processors() > 1)
+    abort("asynchronous output is only supported for a single process");
+  if (!async) flush_output();
+  output_async = async;
+  output_queue_bytes = max_queued_bytes;
+}
+
+void fields::flush_output() { h5io_wait(); }
+
+void fields::set_output_compression(int deflate_level, double abs_tolerance) {
+  if (deflate_level < 0 || deflate_level > 9)
+    abort("invalid HDF5 deflate level %d (must be 0-9)", deflate_level);
+  if (abs_tolerance < 0) abort("invalid HDF5 compression tolerance %g", abs_tolerance);
+  if (abs_tolerance > 0 && deflate_level == 0)
+    abort("HDF5 compression tolerance %g requires a deflate level > 0", abs_tolerance);
+  output_deflate_level = deflate_level;
+  output_abs_tolerance = abs_tolerance;
+}
+
 /***************************************************************************/
 
 void fields::output_hdf5(const char *dataname, int num_fields, const component *components,
@@ -341,7 +425,7 @@ void fields::output_hdf5(const char *dataname, int num_fields, const component *
                 single_precision, frequency);
     delete[] dataname2;
   }
-  if (delete_file) delete file;
+  if (delete_file) delete_h5file(file, output_async, output_queue_bytes);
 }
 
 /***************************************************************************/
@@ -369,7 +453,7 @@ void fields::output_hdf5(const char *dataname, int num_fields, const component *
   output_hdf5(file, dataname, num_fields, components, rintegrand_fun, (void *)&data, 0, where,
               append_data, single_precision, frequency);
 
-  if (delete_file) delete file;
+  if (delete_file) delete_h5file(file, output_async, output_queue_bytes);
 }
 
 /***************************************************************************/
@@ -405,7 +489,7 @@ void fields::output_hdf5(component c, const volume &where, h5file *file, bool ap
                 frequency);
   }
 
-  if (delete_file) delete file;
+  if (delete_file) delete_h5file(file, output_async, output_queue_bytes);
 }
 
 /***************************************************************************/
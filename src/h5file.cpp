@@ -18,8 +18,13 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string.h>
+#include <math.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
-#include "meep.hpp"
+#include "meep_internals.hpp"
 
 #define CHECK(condition, message)                                                                  \
   do {                                                                                             \
@@ -73,6 +78,18 @@ typedef int hid_t;
 static int h5io_critical_section_tag = 0;
 #endif
 
+/* Parallel writes of compressed (filtered) datasets, which must be
+   collective, are only supported starting with HDF5 1.10.2. */
+#if defined(HAVE_H5PSET_FAPL_MPIO) &&                                                              \
+    !(H5_VERS_MAJOR > 1 || (H5_VERS_MAJOR == 1 && H5_VERS_MINOR > 10) ||                           \
+      (H5_VERS_MAJOR == 1 && H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 2))
+#define NO_PARALLEL_FILTERS 1
+#endif
+
+/* Compressed datasets are stored in chunks of at most this many elements
+   (~1MB per chunk after compression), the unit that HDF5 compresses. */
+#define COMPRESSED_CHUNK_SIZE (1 << 20)
+
 /*****************************************************************************/
 /* Normally, HDF5 prints out all sorts of error messages, e.g. if a dataset
    can't be found, in addition to returning an error code.  The following
@@ -94,6 +111,111 @@ using namespace std;
 
 namespace meep {
 
+/*****************************************************************************/
+/* Asynchronous output (see fields::set_output_async): a queue of jobs that
+   are run in order by a background I/O thread.  HDF5 is not thread-safe,
+   so every h5file operation of the other threads first waits for all of
+   the queued jobs to finish (in get_id and close_id, through which all
+   file access goes, and in the chunk I/O on the current dataset).  The
+   queue is bounded by the bytes of staged data that the jobs own, so that
+   output can't run away with the memory if the disk is too slow.  The
+   remaining jobs are run at exit by an atexit handler, registered after
+   HDF5's own so that it runs before HDF5 is shut down (the destructor of
+   the static queue would run too late). */
+
+static void h5io_atexit();
+
+class h5io_queue {
+public:
+  h5io_queue() : queued_bytes(0), busy(false), stop(false) {}
+  ~h5io_queue() { shutdown(); }
+
+  // run the remaining jobs and stop the thread
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    ready.notify_all();
+    if (worker.joinable()) worker.join(); // after running the remaining jobs
+  }
+
+  void push(const std::function<void()> &job, size_t bytes, size_t max_bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stop) { // (at exit) run the job synchronously
+      lock.unlock();
+      job();
+      return;
+    }
+    if (!worker.joinable()) {
+#ifdef HAVE_HDF5
+      H5open(); // registers HDF5's atexit cleanup (if not yet done) before ours
+#endif
+      std::atexit(h5io_atexit);
+      worker = std::thread(&h5io_queue::run, this);
+    }
+    done.wait(lock, [&] { return queued_bytes == 0 || queued_bytes + bytes <= max_bytes; });
+    jobs.push_back(job);
+    sizes.push_back(bytes);
+    queued_bytes += bytes;
+    ready.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (std::this_thread::get_id() == worker_id) return; // jobs may use h5file methods
+    done.wait(lock, [&] { return jobs.empty() && !busy; });
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    worker_id = std::this_thread::get_id();
+    for (;;) {
+      ready.wait(lock, [&] { return stop || !jobs.empty(); });
+      if (jobs.empty()) return;
+      std::function<void()> job = jobs.front();
+      const size_t bytes = sizes.front();
+      jobs.pop_front();
+      sizes.pop_front();
+      busy = true;
+      lock.unlock();
+      job();
+      job = nullptr; // free the staged data before accounting for it
+      lock.lock();
+      busy = false;
+      queued_bytes -= bytes;
+      done.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable ready, done;
+  std::deque<std::function<void()> > jobs;
+  std::deque<size_t> sizes;
+  size_t queued_bytes;
+  bool busy, stop;
+  std::thread worker;
+  std::thread::id worker_id;
+};
+
+static h5io_queue h5io;
+
+static void h5io_atexit() { h5io.shutdown(); }
+
+// a chunk of a compressed dataset, whose (collective) parallel write is deferred
+struct deferred_chunk {
+  int rank, type;
+  std::vector<size_t> start, count;
+  std::vector<char> data;
+};
+
+void h5io_async(const std::function<void()> &job, size_t bytes, size_t max_bytes) {
+  h5io.push(job, bytes, max_bytes);
+}
+
+void h5io_wait() { h5io.wait(); }
+
 bool h5file::dataset_exists(const char *name) {
 #if HAVE_HDF5
   hid_t data_id;
@@ -107,6 +229,7 @@ bool h5file::dataset_exists(const char *name) {
 
 // lazy file creation & locking
 void *h5file::get_id() {
+  h5io_wait();
   if (HID(id) < 0) {
     if (parallel) all_wait();
 
@@ -136,6 +259,7 @@ void *h5file::get_id() {
 void h5file::prevent_deadlock() { IF_EXCLUSIVE(if (parallel) close_id(), (void)0); }
 
 void h5file::close_id() {
+  h5io_wait();
   unset_cur();
   if (HID(id) >= 0)
     if (mode == WRITE) mode = READWRITE; // don't re-create on re-open
@@ -161,6 +285,10 @@ h5file::h5file(const char *filename_, access_mode m, bool parallel_) {
   strcpy(filename, filename_);
   mode = m;
   parallel = parallel_;
+  deflate_level = 0;
+  abs_tolerance = 0;
+  cur_filtered = false;
+  deferred_chunks = new std::vector<deferred_chunk>;
 }
 
 h5file::~h5file() {
@@ -175,6 +303,17 @@ h5file::~h5file() {
   delete[] filename;
   free(cur_id);
   free(id);
+  delete (std::vector<deferred_chunk> *)deferred_chunks;
+}
+
+void h5file::set_compression(int deflate_level_, double abs_tolerance_) {
+  if (deflate_level_ < 0 || deflate_level_ > 9)
+    abort("invalid HDF5 deflate level %d (must be 0-9)", deflate_level_);
+  if (abs_tolerance_ < 0) abort("invalid HDF5 compression tolerance %g", abs_tolerance_);
+  if (abs_tolerance_ > 0 && deflate_level_ == 0)
+    abort("HDF5 compression tolerance %g requires a deflate level > 0", abs_tolerance_);
+  deflate_level = deflate_level_;
+  abs_tolerance = abs_tolerance_;
 }
 
 bool h5file::ok() { return (HID(get_id()) >= 0); }
@@ -205,10 +344,13 @@ bool h5file::is_cur(const char *dataname) {
 }
 
 void h5file::unset_cur() {
+  if (!((std::vector<deferred_chunk> *)deferred_chunks)->empty())
+    abort("bug: write_chunk of compressed data without done_writing_chunks");
 #ifdef HAVE_HDF5
   if (HID(cur_id) >= 0) H5Dclose(HID(cur_id));
 #endif
   HID(cur_id) = -1;
+  cur_filtered = false;
   if (cur_dataname) cur_dataname[0] = 0;
 }
 
@@ -217,6 +359,11 @@ void h5file::set_cur(const char *dataname, void *data_id) {
   if (HID(cur_id) >= 0 && HID(cur_id) != HID(data_id)) H5Dclose(HID(cur_id));
 #endif
   HID(cur_id) = HID(data_id);
+#ifdef HAVE_HDF5
+  hid_t prop_id = H5Dget_create_plist(HID(cur_id));
+  cur_filtered = H5Pget_nfilters(prop_id) > 0;
+  H5Pclose(prop_id);
+#endif
   if (!is_cur(dataname)) {
     if (!cur_dataname || strlen(dataname) > strlen(cur_dataname))
       cur_dataname = (char *)realloc(cur_dataname, strlen(dataname) + 1);
@@ -496,6 +643,40 @@ void h5file::create_data(const char *dataname, int rank, const size_t *dims, boo
       dims_copy[rank1] = 1;
     }
 
+    bool compress = rank > 0 && N > 0 && deflate_level > 0;
+#ifdef NO_PARALLEL_FILTERS
+    if (compress && parallel) {
+      if (verbosity > 0)
+        master_printf("HDF5 1.10.2 or later is required for parallel compression of %s\n",
+                      dataname);
+      compress = false;
+    }
+#endif
+    if (compress) {
+      /* compressed data must be chunked: split the largest dimension in half
+         until the chunks are small enough */
+      hsize_t *chunk_dims = new hsize_t[rank + append_data];
+      hsize_t Nchunk = N;
+      for (i = 0; i < rank; ++i)
+        chunk_dims[i] = dims[i];
+      while (Nchunk > COMPRESSED_CHUNK_SIZE) {
+        int imax = 0;
+        for (i = 1; i < rank; ++i)
+          if (chunk_dims[i] > chunk_dims[imax]) imax = i;
+        chunk_dims[imax] = (chunk_dims[imax] + 1) / 2;
+        Nchunk = 1;
+        for (i = 0; i < rank; ++i)
+          Nchunk *= chunk_dims[i];
+      }
+      if (append_data) chunk_dims[rank] = (128 + (Nchunk - 1)) / Nchunk;
+      H5Pset_chunk(prop_id, rank + append_data, chunk_dims);
+      delete[] chunk_dims;
+
+      H5Pset_shuffle(prop_id); // group the bytes of equal significance, for deflate
+      CHECK(H5Zfilter_avail(H5Z_FILTER_DEFLATE), "HDF5 has no deflate (zlib) filter");
+      H5Pset_deflate(prop_id, deflate_level);
+    }
+
     delete[] dims_copy;
 
     hid_t type_id = single_precision ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE;
@@ -613,7 +794,7 @@ void h5file::create_or_extend_data(const char *dataname, int rank, const size_t
 */
 static void _write_chunk(hid_t data_id, h5file::extending_s *cur, int rank,
                          const size_t *chunk_start, const size_t *chunk_dims,
-                         hid_t datatype, void *data) {
+                         hid_t datatype, void *data, hid_t xfer_id = H5P_DEFAULT) {
 #ifdef HAVE_HDF5
   int i;
   bool do_write = true;
@@ -673,7 +854,9 @@ static void _write_chunk(hid_t data_id, h5file::extending_s *cur, int rank,
   /*******************************************************************/
   /* Write the data, then free all the stuff we've allocated. */
 
-  if (do_write) H5Dwrite(data_id, datatype, mem_space_id, space_id, H5P_DEFAULT, (void *)data);
+  // (collective writes must be done by all processes, even with no data)
+  if (do_write || xfer_id != H5P_DEFAULT)
+    H5Dwrite(data_id, datatype, mem_space_id, space_id, xfer_id, (void *)data);
 
   H5Sclose(mem_space_id);
   H5Sclose(space_id);
@@ -682,26 +865,118 @@ static void _write_chunk(hid_t data_id, h5file::extending_s *cur, int rank,
 #endif
 }
 
+/* Lossy compression (abs_tolerance > 0): the data written to compressed
+   datasets are rounded to integer multiples of a power of two <= 2*abs_tolerance,
+   so that their low-order mantissa bits are zero and compress well.  Unlike
+   a quantization relative to the data in each chunk (e.g. the scale-offset
+   filter), this is idempotent, so that the error doesn't grow when HDF5
+   recompresses a chunk that is written in several pieces. */
+template <class T>
+static T *quantize_chunk(T *data, int rank, const size_t *chunk_dims, double abs_tolerance,
+                         std::vector<T> &buf) {
+  size_t n = rank ? 1 : chunk_dims[0];
+  for (int i = 0; i < rank; ++i)
+    n *= chunk_dims[i];
+  const double step = ldexp(1.0, int(floor(log2(2 * abs_tolerance))));
+  buf.resize(n);
+  for (size_t i = 0; i < n; ++i)
+    buf[i] = T(step * floor(data[i] / step + 0.5));
+  return buf.data();
+}
+
+// the memory datatypes of the write_chunk overloads, indexed by deferred_chunk::type
+static hid_t chunk_datatype(int type) {
+  return type == 0 ? H5T_NATIVE_FLOAT : (type == 1 ? H5T_NATIVE_DOUBLE : SIZE_T_H5T);
+}
+
+bool h5file::defer_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
+                         const void *data, int type) {
+#ifdef HAVE_H5PSET_FAPL_MPIO
+  if (!parallel || !cur_filtered) return false;
+  deferred_chunk chunk;
+  chunk.rank = rank;
+  chunk.type = type;
+  chunk.start.assign(chunk_start, chunk_start + rank);
+  chunk.count.assign(chunk_dims, chunk_dims + (rank ? rank : 1));
+  size_t n = rank ? 1 : chunk_dims[0];
+  for (int i = 0; i < rank; ++i)
+    n *= chunk_dims[i];
+  const size_t elsize = type == 0 ? sizeof(float) : (type == 1 ? sizeof(double) : sizeof(size_t));
+  chunk.data.assign((const char *)data, (const char *)data + n * elsize);
+  ((std::vector<deferred_chunk> *)deferred_chunks)->push_back(chunk);
+  return true;
+#else
+  (void)rank;
+  (void)chunk_start;
+  (void)chunk_dims;
+  (void)data;
+  (void)type;
+  return false;
+#endif
+}
+
+/* Collectively write the deferred chunks: every process must call H5Dwrite
+   the same number of times, with empty selections once it runs out. */
+void h5file::write_deferred_chunks() {
+#ifdef HAVE_H5PSET_FAPL_MPIO
+  if (!parallel || !cur_filtered) return;
+  std::vector<deferred_chunk> &chunks = *(std::vector<deferred_chunk> *)deferred_chunks;
+  const int n = max_to_all(int(chunks.size()));
+  extending_s *cur = get_extending(cur_dataname);
+  hid_t space_id = H5Dget_space(HID(cur_id));
+  const int rank = H5Sget_simple_extent_ndims(space_id) - (cur != NULL);
+  H5Sclose(space_id);
+  std::vector<size_t> zeros(rank > 0 ? rank : 1, 0);
+  hid_t xfer_id = H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(xfer_id, H5FD_MPIO_COLLECTIVE);
+  for (int i = 0; i < n; ++i) {
+    if (size_t(i) < chunks.size())
+      _write_chunk(HID(cur_id), cur, chunks[i].rank, chunks[i].start.data(),
+                   chunks[i].count.data(), chunk_datatype(chunks[i].type), chunks[i].data.data(),
+                   xfer_id);
+    else
+      _write_chunk(HID(cur_id), cur, rank, zeros.data(), zeros.data(), H5T_NATIVE_DOUBLE, NULL,
+                   xfer_id);
+  }
+  H5Pclose(xfer_id);
+  chunks.clear();
+#endif
+}
+
 void h5file::write_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
                          float *data) {
+  h5io_wait();
+  std::vector<float> buf;
+  if (cur_filtered && abs_tolerance > 0)
+    data = quantize_chunk(data, rank, chunk_dims, abs_tolerance, buf);
+  if (defer_chunk(rank, chunk_start, chunk_dims, data, 0)) return;
   _write_chunk(HID(cur_id), get_extending(cur_dataname), rank, chunk_start, chunk_dims,
-               H5T_NATIVE_FLOAT, data);
+               chunk_datatype(0), data);
 }
 
 void h5file::write_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
                          double *data) {
+  h5io_wait();
+  std::vector<double> buf;
+  if (cur_filtered && abs_tolerance > 0)
+    data = quantize_chunk(data, rank, chunk_dims, abs_tolerance, buf);
+  if (defer_chunk(rank, chunk_start, chunk_dims, data, 1)) return;
   _write_chunk(HID(cur_id), get_extending(cur_dataname), rank, chunk_start, chunk_dims,
-               H5T_NATIVE_DOUBLE, data);
+               chunk_datatype(1), data);
 }
 
 void h5file::write_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
                          size_t *data) {
-  _write_chunk(HID(cur_id), get_extending(cur_dataname), rank, chunk_start, chunk_dims, SIZE_T_H5T,
-               (void *)data);
+  h5io_wait();
+  if (defer_chunk(rank, chunk_start, chunk_dims, data, 2)) return;
+  _write_chunk(HID(cur_id), get_extending(cur_dataname), rank, chunk_start, chunk_dims,
+               chunk_datatype(2), (void *)data);
 }
 
 // collective call after completing all write_chunk calls
 void h5file::done_writing_chunks() {
+  h5io_wait();
+  write_deferred_chunks();
   /* hackery: in order to not deadlock when writing extensible datasets
      with a non-parallel version of HDF5, we need to close the file
      and release the lock after writing extensible chunks  ...here,
@@ -825,18 +1100,21 @@ static void _read_chunk(hid_t data_id, int rank, const size_t *chunk_start,
 
 void h5file::read_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
                         float *data) {
+  h5io_wait();
   _read_chunk(HID(cur_id), rank, chunk_start, chunk_dims,
               H5T_NATIVE_FLOAT, data);
 }
 
 void h5file::read_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
                         double *data) {
+  h5io_wait();
   _read_chunk(HID(cur_id), rank, chunk_start, chunk_dims,
               H5T_NATIVE_DOUBLE, data);
 }
 
 void h5file::read_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
                         size_t *data) {
+  h5io_wait();
   _read_chunk(HID(cur_id), rank, chunk_start, chunk_dims, SIZE_T_H5T, (void *)data);
 }
 
@@ -129,7 +129,7 @@ static void integrate_chunkloop(fields_chunk *fc, int ichunk, component cgrid, i
 
 complex<double> fields::integrate(int num_fvals, const component *components,
                                   field_function integrand, void *integrand_data_,
-                                  const volume &where, double *maxabs) {
+                                  const volume &where, double *maxabs, bool parallel) {
   // check if components are all on the same grid:
   bool same_grid = true;
   for (int i = 1; i < num_fvals; ++i)
@@ -193,8 +193,8 @@ complex<double> fields::integrate(int num_fvals, const component *components,
   delete[] data.ph;
   delete[] data.cS;
 
-  if (maxabs) *maxabs = max_to_all(data.maxabs);
-  data.sum = sum_to_all(data.sum);
+  if (maxabs) *maxabs = parallel ? max_to_all(data.maxabs) : data.maxabs;
+  if (parallel) data.sum = sum_to_all(data.sum);
 
   return complex<double>(real(data.sum), imag(data.sum));
 }
@@ -209,11 +209,12 @@ static complex<double> rfun_wrap(const complex<double> *fvals, const vec &loc, v
 }
 
 double fields::integrate(int num_fvals, const component *components, field_rfunction integrand,
-                         void *integrand_data_, const volume &where, double *maxabs) {
+                         void *integrand_data_, const volume &where, double *maxabs,
+                         bool parallel) {
   rfun_wrap_data data;
   data.integrand = integrand;
   data.integrand_data = integrand_data_;
-  return real(integrate(num_fvals, components, rfun_wrap, &data, where, maxabs));
+  return real(integrate(num_fvals, components, rfun_wrap, &data, where, maxabs, parallel));
 }
 
 double fields::max_abs(int num_fvals, const component *components, field_function integrand,
@@ -157,6 +157,15 @@ public:
     (void)data;
     return 0;
   }
+  /* The values in the internal data that must be preserved in order to
+     move it to another process, as an array of *n realnum values; the
+     rest (e.g. pointers into the data) is reconstructed by calling
+     new_internal_data and init_internal_data on the other process. */
+  virtual realnum *internal_data_values(void *data, size_t *n) const {
+    (void)data;
+    *n = 0;
+    return 0;
+  }
 
   /* The following methods are used in boundaries.cpp to set up any
      extra communications that may be necessary at chunk boundaries
@@ -254,6 +263,7 @@ public:
   virtual void init_internal_data(realnum *W[NUM_FIELD_COMPONENTS][2], realnum dt,
                                   const grid_volume &gv, void *data) const;
   virtual void *copy_internal_data(void *data) const;
+  virtual realnum *internal_data_values(void *data, size_t *n) const;
 
   virtual int num_cinternal_notowned_needed(component c, void *P_internal_data) const;
   virtual realnum *cinternal_notowned_ptr(int inotowned, component c, int cmp, int n,
@@ -301,6 +311,7 @@ public:
   virtual void init_internal_data(realnum *W[NUM_FIELD_COMPONENTS][2], realnum dt,
                                   const grid_volume &gv, void *data) const;
   virtual void *copy_internal_data(void *data) const;
+  virtual realnum *internal_data_values(void *data, size_t *n) const;
 
   virtual bool needs_P(component c, int cmp, realnum *W[NUM_FIELD_COMPONENTS][2]) const;
   virtual void update_P(realnum *W[NUM_FIELD_COMPONENTS][2],
@@ -348,6 +359,7 @@ public:
   virtual void init_internal_data(realnum *W[NUM_FIELD_COMPONENTS][2], realnum dt,
                                   const grid_volume &gv, void *data) const;
   virtual void *copy_internal_data(void *data) const;
+  virtual realnum *internal_data_values(void *data, size_t *n) const;
   virtual void delete_internal_data(void *data) const;
 
   virtual int num_cinternal_notowned_needed(component c, void *P_internal_data) const;
@@ -415,10 +427,27 @@ public:
   void prevent_deadlock(); // hackery for exclusive mode
   bool dataset_exists(const char *name);
 
+  /* compress the datasets (of rank > 0) created from now on, with the shuffle
+     and deflate filters at level deflate_level (1-9, or 0 for no compression) and,
+     if abs_tolerance > 0 (which requires deflate_level > 0), by rounding the
+     floating-point data written to them with an absolute error <= abs_tolerance
+     (before any single-precision rounding) */
+  void set_compression(int deflate_level, double abs_tolerance = 0);
+
 private:
   access_mode mode;
   char *filename;
   bool parallel;
+  int deflate_level;
+  double abs_tolerance;
+  bool cur_filtered; // whether the current dataset is compressed
+
+  /* with parallel HDF5, compressed datasets must be written collectively, so
+     their chunks are deferred (and copied) until done_writing_chunks */
+  void *deferred_chunks;
+  bool defer_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
+                   const void *data, int type);
+  void write_deferred_chunks();
 
   bool is_cur(const char *dataname);
   void unset_cur();
@@ -606,6 +635,11 @@ public:
 
   int n_proc() const { return the_proc; } // Says which proc owns me!
   int is_mine() const { return the_is_mine; }
+  // change the owner; the caller is responsible for moving the data (see rebalance.cpp)
+  void set_n_proc(int proc) {
+    the_proc = proc;
+    the_is_mine = proc == my_rank();
+  }
 
   void remove_susceptibilities();
 
@@ -896,6 +930,8 @@ public:
   }
   virtual std::complex<double> frequency() const { return 0.0; }
   virtual void set_frequency(std::complex<double> f) { (void)f; }
+  // highest frequency with significant spectral content, or infinity if unknown
+  virtual double max_frequency() const { return infinity; }
 
 private:
   double current_time;
@@ -917,6 +953,8 @@ public:
   virtual bool is_equal(const src_time &t) const;
   virtual std::complex<double> frequency() const { return freq; }
   virtual void set_frequency(std::complex<double> f) { freq = real(f); }
+  // the spectrum beyond this is below the exp(-s^2/2) truncation error of the source
+  virtual double max_frequency() const { return fabs(freq) + cutoff / (2 * pi * width * width); }
   std::complex<double> fourier_transform(const double f);
 
 private:
@@ -937,6 +975,11 @@ public:
   virtual bool is_equal(const src_time &t) const;
   virtual std::complex<double> frequency() const { return freq; }
   virtual void set_frequency(std::complex<double> f) { freq = f; }
+  // the tanh turn-on has a spectrum ~ exp(-pi^2 width df), and an abrupt
+  // turn-on (width == 0) has an unbounded spectrum
+  virtual double max_frequency() const {
+    return width == 0 ? infinity : fabs(real(freq)) + slowness / (pi * width);
+  }
 
 private:
   std::complex<double> freq;
@@ -1014,9 +1057,18 @@ public:
   dft_chunk(fields_chunk *fc_, ivec is_, ivec ie_, vec s0_, vec s1_, vec e0_, vec e1_, double dV0_,
             double dV1_, component c_, bool use_centered_grid, std::complex<double> phase_factor,
             ivec shift_, const symmetry &S_, int sn_, const void *data_);
+  // an empty chunk (N = 0, fc = NULL) of the DFT list list_id_ (see fields::dft_anchors)
+  dft_chunk(component c_, const std::vector<double> &omega_, int list_id_);
   ~dft_chunk();
 
-  void update_dft(double time);
+  void update_dft(double time, double rescale = 1.0);
+  void flush_dft(); // add any timesteps buffered by update_dft to dft
+
+  /* update_dft in three steps, where update_points for disjoint ranges of
+     points can be called in parallel (it only writes their rows of dft) */
+  bool start_update(double time, double rescale = 1.0); // false if no fields
+  void update_points(size_t start, size_t end);
+  void finish_update();
 
   void scale_dft(std::complex<double> scale);
 
@@ -1038,10 +1090,25 @@ public:
 
   size_t N;                   // number of spatial points (on epsilon grid)
   std::complex<double> *dft; // N x Nomega array of DFT values.
+  // instead of dft (which is then NULL), for DFTs stored in single precision
+  std::complex<float> *dft_single;
+  std::complex<double> dft_value(size_t i) const {
+    return dft ? dft[i] : std::complex<double>(dft_single[i]);
+  }
+  void set_dft_value(size_t i, std::complex<double> v) {
+    if (dft)
+      dft[i] = v;
+    else
+      dft_single[i] = std::complex<float>(v);
+  }
 
   class dft_chunk *next_in_chunk; // per-fields_chunk list of DFT chunks
   class dft_chunk *next_in_dft;   // next for this particular DFT vol./component
 
+  int list_id; // the fields::add_dft call that created this chunk
+  // for an anchor (fc == NULL, see fields::dft_anchors), the list of anchors
+  class dft_chunk **anchor_list;
+
   /* There are several types of weight factors associated with DFT fields: */
   /*  (a) To accelerate the computation of things like Poynting flux, it   */
   /*      is convenient to store certain DFT field components with built-in*/
@@ -1087,14 +1154,58 @@ public:
   symmetry S;
   int sn;
 
-  // cache of exp(iwt) * scale, of length Nomega
+  // cache of exp(iwt) * scale, of length Nomega, advanced from one sample to
+  // the next by multiplying with dft_phase_step = exp(iw dt decimation_factor)
   std::complex<double> *dft_phase;
+  std::vector<std::complex<double> > dft_phase_step;
+  double dft_phase_time; // time of the current dft_phase
+  int dft_phase_age;     // number of recurrence steps since the exact dft_phase
 
   ptrdiff_t avg1, avg2; // index offsets for average to get epsilon grid
 
+  // per-point weight (dV, interpolation, and averaging factors) and index
+  // into the field arrays, of length N
+  std::vector<double> weight;
+  std::vector<ptrdiff_t> index;
+
+  /* update_dft buffers the weighted fields and the phases of batch_size
+     timesteps, which flush_dft then adds to dft with a single matrix
+     multiplication (see fields::set_dft_batch_size) */
+  int batch_size, nbatched, batch_numcmp;
+  std::vector<double> batch_fields;                // N x batch_size (x 2 for complex fields)
+  std::vector<std::complex<double> > batch_phase; // batch_size x Nomega
+
   int vc; // component descriptor from the original volume
+
+  int decimation_factor; // accumulate only every decimation_factor timesteps
+
+  /* With time_series (see record_time_series), the batches are long records
+     of the fields at equally spaced times, which flush_dft adds to dft by a
+     chirp-z transform (computed with FFTs) at each point, so that there is
+     no per-frequency work at each timestep. */
+  bool time_series;
+  void record_time_series(int nsamples);
+  double batch_time0;                // time of the first sample of the batch
+  std::vector<double> batch_rescale; // rescale factor of each sample of the batch
+  size_t chirpz_length;              // FFT length for the batch, or 0 to use batch_phase
+  std::vector<std::complex<double> > chirpz_in, chirpz_filter, chirpz_out, chirpz_twiddle;
+
+  /* only every stride-th grid point (per direction, of the symmetry-transformed
+     grid, starting at the corner of the DFT volume) is stored, where is and ie
+     lie on this coarser grid; stride is 1 in empty dimensions */
+  ivec stride;
+  bool stored_point(const ivec &iloc) const; // whether iloc (in the chunk) is stored
+
+private:
+  void flush_points(size_t start, size_t end, int M);
+  void add_points(std::complex<double> *C, size_t start, size_t end, int M);
+  void prepare_time_series_flush(int M);
+  void flush_time_series_points(std::complex<double> *C, size_t start, size_t end, int M);
 };
 
+void flush_dfts(dft_chunk *dft_chunks); // flush_dft for a next_in_dft list
+// record_time_series for a next_in_dft list
+void record_time_series(dft_chunk *dft_chunks, int nsamples);
 void save_dft_hdf5(dft_chunk *dft_chunks, component c, h5file *file, const char *dprefix = 0);
 void load_dft_hdf5(dft_chunk *dft_chunks, component c, h5file *file, const char *dprefix = 0);
 void save_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file, const char *dprefix = 0);
@@ -1124,6 +1235,13 @@ public:
     if (H && fl.H) *H -= *fl.H;
   }
 
+  // record the fields of up to nsamples timesteps before each (FFT-based) DFT
+  // update, which is much faster for many equally spaced frequencies
+  void record_time_series(int nsamples) {
+    meep::record_time_series(E, nsamples);
+    meep::record_time_series(H, nsamples);
+  }
+
   void save_hdf5(fields &f, const char *fname, const char *dprefix = 0, const char *prefix = 0);
   void load_hdf5(fields &f, const char *fname, const char *dprefix = 0, const char *prefix = 0);
 
@@ -1240,9 +1358,23 @@ public:
      by other output routine to efficiently get far field on a grid of pts */
   void farfield_lowlevel(std::complex<double> *F, const vec &x);
 
-  /* Return a newly allocated array with all far fields */
+  /* Return a newly allocated array with all far fields (complete only on
+     the master process if master_only) */
   double *get_farfields_array(const volume &where, int &rank, size_t *dims, size_t &N,
-                              double resolution);
+                              double resolution, bool master_only = false);
+
+  /* the near-field points of this process, packed for farfield_from_points,
+     which is like farfield_lowlevel for the given (e.g. all) near-field points */
+  std::vector<double> near_field_points();
+  void farfield_from_points(std::complex<double> *EH, const vec &x,
+                            const std::vector<double> &pts);
+
+  /* compute the (process-local) far fields of get_farfields_array on the grid of
+     dims[0] x dims[1] x dims[2] points with spacing dx from the corner of where, with
+     FFT convolutions if the grid is planar and if that is estimated to be faster than
+     the direct sum; returns false (leaving EH unchanged) otherwise */
+  bool farfields_fft(double *EH, const volume &where, const size_t dims[3],
+                     const direction dirs[3], const double dx[3]);
 
   /* output far fields on a grid to an HDF5 file */
   void save_farfields(const char *fname, const char *prefix, const volume &where,
@@ -1270,6 +1402,10 @@ public:
   direction periodic_d[2];
   int periodic_n[2];
   double periodic_k[2], period[2];
+  bool use_fft; // whether get_farfields_array may use farfields_fft (default true)
+  /* whether to sum over all of the periodic copies (from a Floquet expansion)
+     instead of periodic_n copies in each periodic direction (default false) */
+  bool lattice_sum;
 
   std::vector<sourcedata> near_sourcedata(const vec &x_0, double* farpt_list, size_t nfar_pts, std::complex<double>* dJ);
 };
@@ -1316,6 +1452,7 @@ public:
   std::vector<double> freq;
   dft_chunk *chunks;
   volume where;
+  int stride; // every stride-th grid point is stored (see fields::add_dft_fields)
 };
 
 enum in_or_out { Incoming = 0, Outgoing };
@@ -1376,6 +1513,7 @@ public:
   structure_chunk *s;
   const char *outdir;
   int chunk_idx;
+  double step_time; // wall time spent timestepping this chunk, for load balancing
 
   fields_chunk(structure_chunk *, const char *outdir, double m, double beta,
                bool zero_fields_near_cylorigin, int chunkidx);
@@ -1460,7 +1598,8 @@ private:
   // boundaries.cpp
   void alloc_extra_connections(field_type, connect_phase, in_or_out, size_t);
   // dft.cpp
-  void update_dfts(double timeE, double timeH);
+  void start_dft_updates(double timeE, double timeH, int current_step,
+                         std::vector<dft_chunk *> &started);
 
   void changing_structure();
 };
@@ -1555,6 +1694,15 @@ private:
 /***************************************************************/
 typedef vec (*kpoint_func)(double freq, int mode, void *user_data);
 
+// a block of an array slice computed on one process (see get_array_slice_boxes):
+// the count[0] x count[1] x count[2] entries of the slice starting at start[],
+// as a row-major array (of complex numbers for a complex slice) that must be
+// deallocated via delete[]
+struct array_slice_box {
+  size_t start[3], count[3];
+  double *data;
+};
+
 class fields {
 public:
   int num_chunks;
@@ -1588,6 +1736,19 @@ public:
   boundary_condition boundaries[2][5];
   char *outdir;
   bool components_allocated;
+  int dft_batch_size; // see set_dft_batch_size
+  int dft_decimation; // see set_dft_decimation
+  bool dft_single_precision; // see set_dft_single_precision
+  /* the dft_chunk lists of add_dft start with an empty "anchor" chunk on
+     every process, which stays when the other chunks are moved between
+     processes (see move_chunk), so that the lists of the DFT objects remain
+     valid; the anchors are linked by next_in_chunk */
+  dft_chunk *dft_anchors;
+  int dft_list_count; // the number of add_dft lists so far (for dft_chunk::list_id)
+  bool output_async; // see set_output_async
+  size_t output_queue_bytes; // see set_output_async
+  int output_deflate_level; // see set_output_compression
+  double output_abs_tolerance; // see set_output_compression
 
   // fields.cpp methods:
   fields(structure *, double m = 0, double beta = 0, bool zero_fields_near_cylorigin = true);
@@ -1604,6 +1765,7 @@ public:
   // time.cpp
   std::vector<double> time_spent_on(time_sink);
   double mean_time_spent_on(time_sink);
+  std::vector<double> time_spent_on_chunks();
   void print_times();
   // boundaries.cpp
   void set_boundary(boundary_side, direction, boundary_condition);
@@ -1640,6 +1802,14 @@ public:
   h5file *open_h5file(const char *name, h5file::access_mode mode = h5file::WRITE,
                       const char *prefix = NULL, bool timestamp = false);
   const char *h5file_name(const char *name, const char *prefix = NULL, bool timestamp = false);
+  /* write the HDF5 output from now on in a background thread: output_hdf5 only
+     copies the data into a staging buffer, and waits only if more than
+     max_queued_bytes of staged data are not yet written (aborts for > 1 process) */
+  void set_output_async(bool async = true, size_t max_queued_bytes = size_t(1) << 30);
+  void flush_output(); // wait until all of the asynchronous output is written
+  /* compress the datasets written by output_hdf5 from now on (and any later
+     datasets in the same files), as in h5file::set_compression */
+  void set_output_compression(int deflate_level, double abs_tolerance = 0);
 
   void output_times(const char *fname);
 
@@ -1666,45 +1836,69 @@ public:
   // given a subvolume, return a column-major array containing
   // the given function of the field components in that subvolume
   // if slice is non-null, it must be a user-allocated buffer
-  // of the correct size.
+  // of the correct size, into which the slice is written directly;
+  // if strides is also non-null, strides[i] is the distance (in
+  // elements, possibly negative) between consecutive entries of
+  // the buffer along the i-th slice dimension, so that e.g. a
+  // transposed or sub-sampled view of a larger array can be filled.
   // otherwise, a new buffer is allocated and returned; it
   // must eventually be caller-deallocated via delete[].
   double *get_array_slice(const volume &where, std::vector<component> components,
                           field_rfunction rfun, void *fun_data, double *slice = 0,
-                          double frequency = 0,
-                          bool snap = false);
+                          double frequency = 0, bool snap = false,
+                          const ptrdiff_t *strides = 0);
 
   std::complex<double> *get_complex_array_slice(const volume &where,
                                                 std::vector<component> components,
                                                 field_function fun, void *fun_data,
                                                 std::complex<double> *slice = 0,
-                                                double frequency = 0,
-                                                bool snap = false);
+                                                double frequency = 0, bool snap = false,
+                                                const ptrdiff_t *strides = 0);
 
   // alternative entry points for when you have no field
   // function, i.e. you want just a single component or
   // derived component.)
   double *get_array_slice(const volume &where, component c, double *slice = 0,
-                          double frequency = 0, bool snap = false);
+                          double frequency = 0, bool snap = false,
+                          const ptrdiff_t *strides = 0);
   double *get_array_slice(const volume &where, derived_component c, double *slice = 0,
-                          double frequency = 0, bool snap = false);
+                          double frequency = 0, bool snap = false,
+                          const ptrdiff_t *strides = 0);
   std::complex<double> *get_complex_array_slice(const volume &where, component c,
                                                 std::complex<double> *slice = 0,
-                                                double frequency = 0,
-                                                bool snap = false);
+                                                double frequency = 0, bool snap = false,
+                                                const ptrdiff_t *strides = 0);
+
+  // like get_array_slice (or get_complex_array_slice if complex_data),
+  // but without any communication and without allocating the whole
+  // slice: return the blocks of the slice computed from the chunks of
+  // this process, with the rank and dimensions of the slice given by
+  // get_array_slice_dimensions (with collapse_empty_dimensions = !snap).
+  // the sum of the blocks of all processes is the slice (the blocks
+  // are disjoint, except where the interpolation across an empty
+  // dimension of where involves two chunks).
+  std::vector<array_slice_box> get_array_slice_boxes(const volume &where, component c,
+                                                     double frequency = 0, bool snap = false,
+                                                     bool complex_data = false);
+  std::vector<array_slice_box> get_array_slice_boxes(const volume &where, derived_component c,
+                                                     double frequency = 0, bool snap = false);
 
   // like get_array_slice, but for *sources* instead of fields
   std::complex<double> *get_source_slice(const volume &where, component source_slice_component,
                                          std::complex<double> *slice = 0);
 
   // master routine for all above entry points
+  // (if boxes is non-NULL, the blocks of get_array_slice_boxes are
+  // returned in it instead of computing the slice in vslice)
   void *do_get_array_slice(const volume &where, std::vector<component> components,
                            field_function fun, field_rfunction rfun, void *fun_data, void *vslice,
-                           double frequency = 0, bool snap = false);
+                           double frequency = 0, bool snap = false,
+                           const ptrdiff_t *strides = 0,
+                           std::vector<array_slice_box> *boxes = 0);
 
   /* fetch and return coordinates and integration weights of grid points covered by an array slice, */
   /* packed into a vector with format [NX, xtics[:], NY, ytics[:], NZ, ztics[:], weights[:] ] */
-  std::vector<double> get_array_metadata(const volume &where);
+  std::vector<double> get_array_metadata(const volume &where, int stride = 1);
 
   // step.cpp methods:
   double last_step_output_wall_time;
@@ -1793,9 +1987,11 @@ public:
 
   // integrate.cpp
   std::complex<double> integrate(int num_fields, const component *components, field_function fun,
-                                 void *fun_data_, const volume &where, double *maxabs = 0);
+                                 void *fun_data_, const volume &where, double *maxabs = 0,
+                                 bool parallel = true);
   double integrate(int num_fields, const component *components, field_rfunction fun,
-                   void *fun_data_, const volume &where, double *maxabs = 0);
+                   void *fun_data_, const volume &where, double *maxabs = 0,
+                   bool parallel = true);
   std::complex<double> integrate2(const fields &fields2, int num_fields1,
                                   const component *components1, int num_fields2,
                                   const component *components2, field_function integrand,
@@ -1829,7 +2025,7 @@ public:
                      std::complex<double> stored_weight = 1.0, dft_chunk *chunk_next = 0,
                      bool sqrt_dV_and_interp_weights = false,
                      std::complex<double> extra_weight = 1.0, bool use_centered_grid = true,
-                     int vc = 0);
+                     int vc = 0, int stride = 1);
   dft_chunk *add_dft(component c, const volume &where, const std::vector<double> freq,
                      bool include_dV_and_interp_weights = true,
                      std::complex<double> stored_weight = 1.0, dft_chunk *chunk_next = 0,
@@ -1852,7 +2048,18 @@ public:
   }
   dft_chunk *add_dft(const volume_list *where, const std::vector<double> freq,
                      bool include_dV = true);
-  void update_dfts();
+  void update_dfts(bool decimate = true);
+  void flush_dfts();
+  // accumulate the DFTs in batches of this many timesteps (1 = at every timestep)
+  void set_dft_batch_size(int batch_size);
+  /* accumulate the DFTs added from now on only every decimation timesteps,
+     where 0 chooses the largest factor that avoids aliasing for each DFT
+     (given its frequencies and the bandwidth of the current sources) */
+  void set_dft_decimation(int decimation);
+  /* accumulate the DFTs added from now on in single precision (each batch of
+     timesteps is summed in double precision and then rounded once) */
+  void set_dft_single_precision(bool single_precision = true);
+  int dft_decimation_factor(const double *freq, size_t Nfreq) const;
   dft_flux add_dft_flux(const volume_list *where, const double *freq, size_t Nfreq,
                         bool use_symmetry = true, bool centered_grid = true);
   dft_flux add_dft_flux(const volume_list *where, const std::vector<double> freq,
@@ -1890,17 +2097,21 @@ public:
 
   dft_fields add_dft_fields(component *components, int num_components, const volume where,
                             double freq_min, double freq_max, int Nfreq,
-                            bool use_centered_grid = true) {
+                            bool use_centered_grid = true, int stride = 1) {
     return add_dft_fields(components, num_components, where, linspace(freq_min, freq_max, Nfreq),
-                          use_centered_grid);
+                          use_centered_grid, stride);
   }
   dft_fields add_dft_fields(component *components, int num_components, const volume where,
-                            const std::vector<double> freq, bool use_centered_grid = true) {
+                            const std::vector<double> freq, bool use_centered_grid = true,
+                            int stride = 1) {
     return add_dft_fields(components, num_components, where, freq.data(), freq.size(),
-                          use_centered_grid);
+                          use_centered_grid, stride);
   }
+  /* stride > 1: store only every stride-th grid point in each non-empty direction
+     (add_dft supports this only without include_dV_and_interp_weights) */
   dft_fields add_dft_fields(component *components, int num_components, const volume where,
-                            const double *freq, size_t Nfreq, bool use_centered_grid = true);
+                            const double *freq, size_t Nfreq, bool use_centered_grid = true,
+                            int stride = 1);
 
   /********************************************************/
   /* process_dft_component is an intermediate-level       */
@@ -1916,7 +2127,8 @@ public:
                                              size_t *dims = 0, direction *dirs = 0,
                                              void *mode1_data = 0, void *mode2_data = 0,
                                              component c_conjugate = Ex, bool *first_component = 0,
-                                             bool retain_interp_weights = true);
+                                             bool retain_interp_weights = true,
+                                             bool array_to_master = false);
 
   // output DFT fields to HDF5 file
   void output_dft_components(dft_chunk **chunklists, int num_chunklists, volume dft_volume,
@@ -2000,7 +2212,7 @@ public:
   double field_energy_in_box(const volume &);
   double field_energy_in_box(component c, const volume &);
   double field_energy();
-  double flux_in_box_wrongH(direction d, const volume &);
+  double flux_in_box_wrongH(direction d, const volume &, bool parallel = true);
   double flux_in_box(direction d, const volume &);
   flux_vol *add_flux_vol(direction d, const volume &where);
   flux_vol *add_flux_plane(const volume &where);
@@ -2030,6 +2242,18 @@ public:
   void set_solve_cw_omega(std::complex<double> omega);
   void unset_solve_cw_omega();
 
+  // rebalance.cpp
+  bool rebalance_chunks(double tolerance = 0.1);
+  // move chunk i (which must not hold sources) to process proc, called on all processes
+  void move_chunk(int i, int proc);
+
+  // fields_dump.cpp
+  /* checkpoint the time-domain state of the fields (including the PML and
+     polarization data and the DFT monitors) to an HDF5 file, and restore it
+     into fields with the same chunks, materials, and DFT monitors */
+  void dump(const char *filename);
+  void load(const char *filename);
+
 private:
   int synchronized_magnetic_fields; // count number of nested synchs
   double last_wall_time;
@@ -2053,6 +2277,7 @@ private:
   void boundary_communications(field_type);
   // step.cpp
   void phase_material();
+  std::vector<int> my_chunks_by_time() const;
   void step_db(field_type ft);
   void step_source(field_type ft, bool including_integrated = false);
   void update_pols(field_type ft);
@@ -2061,7 +2286,6 @@ private:
   void add_volume_source_check(component c, const src_time &src, const volume &where,
                                std::complex<double> A(const vec &), std::complex<double> amp,
                                component c0, direction d, int has_tm, int has_te);
-
 public:
   // monitor.cpp
   std::complex<double> get_field(component c, const ivec &iloc, bool parallel = true) const;
@@ -2086,25 +2310,69 @@ public:
   }
   ~flux_vol() { delete next; }
 
+  // The sum over processes is started in update() and only waited
+  // for in flux(), so that it overlaps with the following timestep.
   void update_half() {
     cur_flux_half = flux_wrongE();
     if (next) next->update_half();
   }
   void update() {
-    cur_flux = (flux_wrongE() + cur_flux_half) * 0.5;
+    sum_req.wait();
+    my_flux = (flux_wrongE() + cur_flux_half) * 0.5;
+    sum_req.sum_to_all(&my_flux, &cur_flux, 1);
     if (next) next->update();
   }
 
-  double flux() { return cur_flux; }
+  double flux() {
+    sum_req.wait();
+    return cur_flux;
+  }
 
   flux_vol *next;
 
 private:
-  double flux_wrongE() { return f->flux_in_box_wrongH(d, where); }
+  double flux_wrongE() { return f->flux_in_box_wrongH(d, where, false); }
   fields *f;
   direction d;
   volume where;
-  double cur_flux, cur_flux_half;
+  double cur_flux, cur_flux_half, my_flux;
+  reduction_request sum_req;
+};
+
+// Non-blocking evaluation of a field component at a point, for criteria
+// that are checked every timestep (e.g. stopping when the fields decay):
+// update() starts the sum over processes of the current value, and value()
+// returns the sum started by the last update(), waiting for it only if it
+// has not completed yet, so that the reduction overlaps with the timestep.
+// c is a component or a derived_component (as for fields::get_field); the
+// values of derived components, Dielectric, and Permeability are not sums of
+// per-process values, so they are computed by a blocking get_field instead.
+class field_point_probe {
+public:
+  field_point_probe(const fields *f, int c, const vec &loc) : f(f), c(c), loc(loc) {
+    my_val = val = 0;
+  }
+
+  void update() {
+    req.wait();
+    if (c < NUM_FIELD_COMPONENTS) {
+      my_val = f->get_field(component(c), loc, false);
+      req.sum_to_all(&my_val, &val, 1);
+    }
+    else
+      val = f->get_field(c, loc);
+  }
+  std::complex<double> value() {
+    req.wait();
+    return val;
+  }
+
+private:
+  const fields *f;
+  int c;
+  vec loc;
+  std::complex<double> my_val, val;
+  reduction_request req;
 };
 
 // The following is a utility function to parse the executable name use it
@@ -21,6 +21,7 @@
 #include <complex>
 #include <stddef.h>
 #include <stdexcept>
+#include <vector>
 
 namespace meep {
 
@@ -97,6 +98,35 @@ void or_to_all(const int *in, int *out, int size);
 void bw_or_to_all(const size_t *in, size_t *out, int size);
 bool and_to_all(bool in);
 void and_to_all(const int *in, int *out, int size);
+// concatenate the arrays of all processes in order of rank (on the master only,
+// or on all processes); unlike sum_to_all, each process sends only its own data
+std::vector<double> gather_to_master(const std::vector<double> &in);
+std::vector<double> gather_to_all(const std::vector<double> &in);
+
+/* Non-blocking reductions (MPI_Iallreduce, if the MPI library supports
+   it): the sum_to_all etc. methods start a reduction and return
+   immediately, and the result in "out" is only valid after wait() (or
+   after test() returns true).  The "in" and "out" arrays must not be
+   touched until then.  Starting a new reduction first waits for the
+   previous one, and the destructor waits for any pending reduction. */
+class reduction_request {
+public:
+  reduction_request() : req(NULL) {}
+  ~reduction_request() { wait(); }
+
+  void sum_to_all(const double *in, double *out, int size);
+  void sum_to_all(const std::complex<double> *in, std::complex<double> *out, int size);
+  void max_to_all(const double *in, double *out, int size);
+  void or_to_all(const int *in, int *out, int size);
+
+  bool test(); // true if the reduction is complete (or none was started)
+  void wait(); // block until the reduction is complete
+
+private:
+  void *req; // MPI_Request *, or NULL if no reduction is pending
+  reduction_request(const reduction_request &);
+  reduction_request &operator=(const reduction_request &);
+};
 
 // IO routines:
 void master_printf(const char *fmt, ...) PRINTF_ATTR(1, 2);
@@ -118,6 +148,7 @@ void end_global_communications(void);
 void end_divide_parallel(void);
 
 int my_global_rank(void);
+void get_node_ids(int *node_ids);
 
 } /* namespace meep */
 
@@ -16,6 +16,7 @@
 */
 
 #include <string.h>
+#include <functional>
 #include "meep.hpp"
 
 namespace meep {
@@ -88,6 +89,9 @@ const int num_bandpts = 32;
 
 symmetry r_to_minus_r_symmetry(int m);
 
+// area (in pixels) of the face shared by two chunk volumes, from structure.cpp
+double shared_face_area(const grid_volume &gv1, const grid_volume &gv2);
+
 // functions in step_generic.cpp:
 
 void step_curl(realnum *f, component c, const realnum *g1, const realnum *g2,
@@ -170,4 +174,30 @@ void green2d(std::complex<double> *EH, const vec &x, double freq, double eps, do
 void greencyl(std::complex<double> *EH, const vec &x, double freq, double eps, double mu,
               const vec &x0, component c0, std::complex<double> f0, double m, double tol);
 
+// from dft.cpp: in-place FFT of a, of length n = 2^k, with the n/2 twiddle
+// factors w[j] = exp(-2 pi i j / n) (or their conjugates if inverse)
+void fft_radix2(std::complex<double> *a, size_t n, const std::complex<double> *w, bool inverse);
+
+// from array_slice.cpp: sum an array over all processes, in place
+double *array_to_all(double *array, size_t array_size);
+
+// a box (start, count) of entries of a row-major array of dimensions dims[3]
+struct array_box {
+  size_t start[3], count[3];
+};
+
+// from array_slice.cpp: consolidate an array of which each process has filled in only
+// the entries in its own (disjoint) boxes, on all processes or only on the master
+void gather_array_boxes(double *array, const size_t dims[3], size_t elem_size,
+                        const std::vector<array_box> &boxes, bool to_all = true);
+// ... or of an array with arbitrary strides (in units of elem_size), rather than row-major
+void gather_array_boxes(double *array, const ptrdiff_t strides[3], size_t elem_size,
+                        const std::vector<array_box> &boxes, bool to_all = true);
+
+// from h5file.cpp: run job (which calls h5file methods, and owns bytes of staged data)
+// in a background I/O thread, waiting first until at most max_bytes are queued
+void h5io_async(const std::function<void()> &job, size_t bytes, size_t max_bytes);
+// wait until all of the asynchronous jobs have finished
+void h5io_wait();
+
 } // namespace meep
@@ -14,7 +14,16 @@
 %  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 #include <algorithm>
+#include <string>
 #include <vector>
 #include "meepgeom.hpp"
 #include "meep_internals.hpp"
@@ -1810,6 +1819,252 @@ void add_absorbing_layer(absorber_list alist, double thickness, int direction, i
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
+/***************************************************************/
+/* structure cache: the result of set_materials_from_geometry  */
+/* is dumped (with structure::dump) to a file named by a hash  */
+/* of everything that it depends on, and is loaded from that   */
+/* file instead of being recomputed when the same structure is */
+/* set up again (e.g. in runs that only change the sources).   */
+/***************************************************************/
+static std::string structure_cache_dir; // empty if there is no cache
+
+void set_structure_cache_directory(const char *dirname) {
+  structure_cache_dir = dirname ? dirname : "";
+}
+
+// 64-bit FNV-1a hash of the inputs of set_materials_from_geometry
+class structure_hash {
+public:
+  structure_hash() : h(UINT64_C(14695981039346656037)), cacheable(true) {}
+  uint64_t h;
+  bool cacheable; // false for inputs that cannot be hashed or are not stored by structure::dump
+
+  void bytes(const void *data, size_t n) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < n; ++i)
+      h = (h ^ p[i]) * UINT64_C(1099511628211);
+  }
+  void integer(long long i) { bytes(&i, sizeof(i)); }
+  void number(double x) {
+    if (x == 0) x = 0; // the same hash for -0
+    bytes(&x, sizeof(x));
+  }
+  void v3(const vector3 &v) {
+    number(v.x);
+    number(v.y);
+    number(v.z);
+  }
+  void cv3(const cvector3 &v) {
+    number(v.x.re);
+    number(v.x.im);
+    number(v.y.re);
+    number(v.y.im);
+    number(v.z.re);
+    number(v.z.im);
+  }
+  void grid(const meep::grid_volume &gv) {
+    integer(gv.dim);
+    number(gv.a);
+    LOOP_OVER_DIRECTIONS(gv.dim, d) {
+      number(gv.origin_in_direction(d));
+      integer(gv.num_direction(d));
+    }
+  }
+  void susceptibilities(const susceptibility_list &slist) {
+    integer(slist.size());
+    for (const susceptibility &sus : slist) {
+      v3(sus.sigma_offdiag);
+      v3(sus.sigma_diag);
+      v3(sus.bias);
+      number(sus.frequency);
+      number(sus.gamma);
+      number(sus.alpha);
+      number(sus.noise_amp);
+      integer(sus.drude);
+      integer(sus.saturated_gyrotropy);
+      integer(sus.is_file);
+      if (!sus.transitions.empty()) cacheable = false; // multilevel atoms
+    }
+  }
+  void medium(const medium_struct &m) {
+    v3(m.epsilon_diag);
+    cv3(m.epsilon_offdiag);
+    v3(m.mu_diag);
+    cv3(m.mu_offdiag);
+    susceptibilities(m.E_susceptibilities);
+    susceptibilities(m.H_susceptibilities);
+    const vector3 unstored[6] = {m.E_chi2_diag, m.E_chi3_diag,         m.H_chi2_diag,
+                                 m.H_chi3_diag, m.D_conductivity_diag, m.B_conductivity_diag};
+    for (int i = 0; i < 6; ++i)
+      if (unstored[i].x != 0 || unstored[i].y != 0 || unstored[i].z != 0) cacheable = false;
+  }
+  void material(const material_data *md) {
+    if (!md) { // the default material
+      integer(-1);
+      return;
+    }
+    integer(md->which_subclass);
+    switch (md->which_subclass) {
+      case material_data::MEDIUM: medium(md->medium); break;
+      case material_data::MATERIAL_FILE: {
+        medium(md->medium);
+        size_t n = 1;
+        for (int i = 0; i < 3; ++i) {
+          integer(md->epsilon_dims[i]);
+          n *= md->epsilon_dims[i];
+        }
+        if (md->epsilon_data) bytes(md->epsilon_data, n * sizeof(double));
+        break;
+      }
+      case material_data::MATERIAL_GRID: {
+        v3(md->grid_size);
+        const size_t n =
+            size_t(md->grid_size.x) * size_t(md->grid_size.y) * size_t(md->grid_size.z);
+        if (md->weights) bytes(md->weights, n * sizeof(double));
+        medium(md->medium_1);
+        medium(md->medium_2);
+        number(md->beta);
+        number(md->eta);
+        integer(md->do_averaging);
+        integer(md->material_grid_kinds);
+        break;
+      }
+      case material_data::PERFECT_METAL: break;
+      default: cacheable = false; // MATERIAL_USER: an arbitrary function
+    }
+  }
+  void object(const geometric_object &o) {
+    material((material_type)o.material);
+    v3(o.center);
+    integer(o.which_subclass);
+    switch (o.which_subclass) {
+      case geometric_object::BLOCK: {
+        const block *b = o.subclass.block_data;
+        v3(b->e1);
+        v3(b->e2);
+        v3(b->e3);
+        v3(b->size);
+        integer(b->which_subclass);
+        if (b->which_subclass == block::ELLIPSOID)
+          v3(b->subclass.ellipsoid_data->inverse_semi_axes);
+        break;
+      }
+      case geometric_object::SPHERE: number(o.subclass.sphere_data->radius); break;
+      case geometric_object::CYLINDER: {
+        const cylinder *c = o.subclass.cylinder_data;
+        v3(c->axis);
+        number(c->radius);
+        number(c->height);
+        integer(c->which_subclass);
+        if (c->which_subclass == cylinder::CONE) number(c->subclass.cone_data->radius2);
+        if (c->which_subclass == cylinder::WEDGE) {
+          number(c->subclass.wedge_data->wedge_angle);
+          v3(c->subclass.wedge_data->wedge_start);
+        }
+        break;
+      }
+      case geometric_object::PRISM: {
+        const prism *p = o.subclass.prism_data;
+        integer(p->vertices.num_items);
+        for (int i = 0; i < p->vertices.num_items; ++i)
+          v3(p->vertices.items[i]);
+        number(p->height);
+        v3(p->axis);
+#if defined(LIBCTL_MAJOR_VERSION) &&                                                               \
+    (LIBCTL_MAJOR_VERSION > 4 || (LIBCTL_MAJOR_VERSION == 4 && LIBCTL_MINOR_VERSION >= 5))
+        number(p->sidewall_angle);
+#endif
+        break;
+      }
+      case geometric_object::COMPOUND_GEOMETRIC_OBJECT: {
+        const geometric_object_list &l =
+            o.subclass.compound_geometric_object_data->component_objects;
+        integer(l.num_items);
+        for (int i = 0; i < l.num_items; ++i)
+          object(l.items[i]);
+        break;
+      }
+      default: cacheable = false;
+    }
+  }
+};
+
+/* the name of the cache file for the structure s and the arguments of
+   set_materials_from_geometry, or "" if there is no cache or if the
+   structure can't be cached */
+static std::string structure_cache_file(meep::structure *s, geometric_object_list g,
+                                        vector3 center, bool use_anisotropic_averaging,
+                                        double tol, int maxeval, material_type default_mat,
+                                        absorber_list alist, material_type_list extra_materials) {
+  if (structure_cache_dir.empty()) return "";
+  structure_hash h;
+  const char version[] = "meep structure cache 2"; // change if the dump format changes
+  h.bytes(version, sizeof(version));
+  h.grid(s->gv); // the file can be loaded into any chunks of this grid_volume
+  h.grid(s->user_volume);
+  h.v3(center);
+  h.integer(use_anisotropic_averaging);
+  h.number(tol);
+  h.integer(maxeval);
+  h.integer(ensure_periodicity);
+  h.material(default_mat);
+  h.integer(g.num_items);
+  for (int i = 0; i < g.num_items; ++i)
+    h.object(g.items[i]);
+  h.integer(extra_materials.num_items);
+  for (int i = 0; i < extra_materials.num_items; ++i)
+    h.material(extra_materials.items[i]);
+  if (alist && !alist->empty()) h.cacheable = false; // conductivities are not dumped
+  if (!h.cacheable) {
+    if (meep::verbosity > 0)
+      master_printf("structure cache not used: user-defined materials, nonlinearities, "
+                    "conductivities, absorbers, and multilevel atoms are not cached\n");
+    return "";
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "/structure-%016llx.h5", (unsigned long long)h.h);
+  return structure_cache_dir + name;
+}
+
+static void save_structure_cache(meep::structure *s, const std::string &fname) {
+  /* dump to a new temporary file, so that other runs never see an incomplete file;
+     another run may save the same structure at the same time, in which case
+     failing to rename (or finding fname already there) is harmless */
+  std::vector<char> tmpname(fname.size() + 8);
+  bool ok = true;
+  if (meep::am_master()) {
+    mkdir(structure_cache_dir.c_str(), 00777);
+    snprintf(&tmpname[0], tmpname.size(), "%s.XXXXXX", fname.c_str());
+    const int fd = mkstemp(&tmpname[0]);
+    ok = fd >= 0;
+    if (ok) {
+      fchmod(fd, 0644); // (mkstemp creates the file readable only by the owner)
+      close(fd);
+    }
+  }
+  if (!meep::broadcast(0, ok)) {
+    if (meep::verbosity > 0)
+      master_printf("structure cache not saved: can't create a file in \"%s\"\n",
+                    structure_cache_dir.c_str());
+    return;
+  }
+  meep::broadcast(0, &tmpname[0], int(tmpname.size()));
+  s->dump(&tmpname[0]);
+  meep::all_wait();
+  if (meep::am_master()) {
+    struct stat st;
+    if (stat(fname.c_str(), &st) == 0) { // saved by another run in the meantime
+      remove(&tmpname[0]);
+    }
+    else if (rename(&tmpname[0], fname.c_str())) {
+      if (meep::verbosity > 0)
+        master_printf("structure cache file \"%s\" not saved: %s\n", fname.c_str(),
+                      strerror(errno));
+      remove(&tmpname[0]);
+    }
+  }
+}
+
 void set_materials_from_geometry(meep::structure *s, geometric_object_list g, vector3 center,
                                  bool use_anisotropic_averaging, double tol, int maxeval,
                                  bool _ensure_periodicity, material_type _default_material,
@@ -1863,6 +2118,20 @@ void set_materials_from_geometry(meep::structure *s, geometric_object_list g, ve
                   resolution);
   }
 
+  const std::string cache_file =
+      structure_cache_file(s, g, center, use_anisotropic_averaging, tol, maxeval,
+                           _default_material, alist, extra_materials);
+  if (!cache_file.empty()) {
+    FILE *f = meep::am_master() ? fopen(cache_file.c_str(), "r") : NULL;
+    if (f) fclose(f);
+    if (meep::broadcast(0, f != NULL)) {
+      s->remove_susceptibilities();
+      s->load(cache_file.c_str());
+      if (meep::verbosity > 0) master_printf("-----------\n");
+      return;
+    }
+  }
+
   geom_epsilon geps(g, extra_materials, gv.pad().surroundings());
 
   /***************************************************************/
@@ -1890,6 +2159,7 @@ void set_materials_from_geometry(meep::structure *s, geometric_object_list g, ve
   s->set_materials(geps, use_anisotropic_averaging, tol, maxeval);
   s->remove_susceptibilities();
   geps.add_susceptibilities(s);
+  if (!cache_file.empty()) save_structure_cache(s, cache_file);
 
   if (meep::verbosity > 0) master_printf("-----------\n");
 }
@@ -1999,6 +2269,7 @@ std::vector<meep::volume> fragment_stats::pml_3d_vols;
 std::vector<meep::volume> fragment_stats::absorber_vols;
 material_type_list fragment_stats::extra_materials = material_type_list();
 bool fragment_stats::split_chunks_evenly = false;
+bool fragment_stats::split_chunks_hilbert = false;
 bool fragment_stats::eps_averaging = false;
 
 static geom_box make_box_from_cell(vector3 cell_size) {
@@ -2057,6 +2328,7 @@ fragment_stats compute_fragment_stats(
   fragment_stats::absorber_vols = absorber_vols_;
   fragment_stats::extra_materials = extra_materials_;
   fragment_stats::eps_averaging = eps_averaging;
+  fragment_stats::init_cost_weights();
 
   init_libctl(default_mat, ensure_per, gv, cell_size, cell_center, &geom_);
   geom_box box = make_box_from_cell(cell_size);
@@ -2297,13 +2569,254 @@ void fragment_stats::compute() {
 
 // Return the estimated time in seconds this fragment will take to run
 // based on a cost function obtained via linear regression on a dataset
-// of random simulations.
+// of random simulations (or on calibration runs, see calibrate_cost_weights).
 double fragment_stats::cost() const {
-  return (num_anisotropic_eps_pixels * 1.15061674e-04 + num_anisotropic_mu_pixels * 1.26843801e-04 +
-          num_nonlinear_pixels * 1.67029547e-04 + num_susceptibility_pixels * 2.24790864e-04 +
-          num_nonzero_conductivity_pixels * 4.61260934e-05 + num_dft_pixels * 1.47283950e-04 +
-          num_1d_pml_pixels * 9.92955372e-05 + num_2d_pml_pixels * 1.36901107e-03 +
-          num_3d_pml_pixels * 6.63939607e-04 + num_pixels_in_box * 3.46518274e-04);
+  return (num_anisotropic_eps_pixels * cost_weights[ANISOTROPIC_EPS_COST] +
+          num_anisotropic_mu_pixels * cost_weights[ANISOTROPIC_MU_COST] +
+          num_nonlinear_pixels * cost_weights[NONLINEAR_COST] +
+          num_susceptibility_pixels * cost_weights[SUSCEPTIBILITY_COST] +
+          num_nonzero_conductivity_pixels * cost_weights[CONDUCTIVITY_COST] +
+          num_dft_pixels * cost_weights[DFT_COST] + num_1d_pml_pixels * cost_weights[PML_1D_COST] +
+          num_2d_pml_pixels * cost_weights[PML_2D_COST] +
+          num_3d_pml_pixels * cost_weights[PML_3D_COST] +
+          num_pixels_in_box * cost_weights[PIXEL_COST]);
+}
+
+/******************************************************************************/
+/* Calibration of the cost weights                                            */
+/******************************************************************************/
+
+double fragment_stats::cost_weights[fragment_stats::NUM_COST_WEIGHTS] = {
+    1.15061674e-04, 1.26843801e-04, 1.67029547e-04, 2.24790864e-04, 4.61260934e-05,
+    9.92955372e-05, 1.36901107e-03, 6.63939607e-04, 1.47283950e-04, 3.46518274e-04};
+
+const char *fragment_stats::cost_weight_names[fragment_stats::NUM_COST_WEIGHTS] = {
+    "anisotropic_eps", "anisotropic_mu", "nonlinear", "susceptibility", "conductivity",
+    "pml_1d",          "pml_2d",         "pml_3d",    "dft",            "pixels_in_box"};
+
+// the file of calibrated weights: $MEEP_COST_WEIGHTS if set, otherwise ~/.meep_cost_weights
+static std::string cost_weights_filename(const char *filename) {
+  if (filename) return filename;
+  const char *s = getenv("MEEP_COST_WEIGHTS");
+  if (s) return s;
+  s = getenv("HOME");
+  return std::string(s ? s : ".") + "/.meep_cost_weights";
+}
+
+// read the calibrated weights (if any) once, before they are first used
+void fragment_stats::init_cost_weights() {
+  static bool initialized = false;
+  if (!initialized) {
+    initialized = true;
+    load_cost_weights();
+  }
+}
+
+/* Read the weights from a file of "name value" lines (with names as in
+   cost_weight_names, and # for comments), keeping the current value of
+   any weight not in the file.  The file is only read by the master
+   process, so that every process divides the cell in the same way.
+   Returns false if the file could not be read. */
+bool fragment_stats::load_cost_weights(const char *filename) {
+  std::string fname = cost_weights_filename(filename);
+  double w[NUM_COST_WEIGHTS + 1];
+  std::copy(cost_weights, cost_weights + NUM_COST_WEIGHTS, w);
+  w[NUM_COST_WEIGHTS] = 0; // whether the file was read
+  if (meep::am_master()) {
+    FILE *f = fopen(fname.c_str(), "r");
+    if (f) {
+      char line[256], name[64];
+      double val;
+      while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%63s %lg", name, &val) != 2 || name[0] == '#') continue;
+        int i = 0;
+        while (i < NUM_COST_WEIGHTS && strcmp(name, cost_weight_names[i]))
+          ++i;
+        if (i < NUM_COST_WEIGHTS)
+          w[i] = val;
+        else
+          master_printf("warning: unknown cost weight %s in %s\n", name, fname.c_str());
+      }
+      fclose(f);
+      w[NUM_COST_WEIGHTS] = 1;
+    }
+  }
+  meep::broadcast(0, w, NUM_COST_WEIGHTS + 1);
+  if (!w[NUM_COST_WEIGHTS]) return false;
+  std::copy(w, w + NUM_COST_WEIGHTS, cost_weights);
+  if (meep::verbosity > 0) master_printf("read chunk cost weights from %s\n", fname.c_str());
+  return true;
+}
+
+void fragment_stats::save_cost_weights(const char *filename) {
+  std::string fname = cost_weights_filename(filename);
+  if (meep::am_master()) {
+    FILE *f = fopen(fname.c_str(), "w");
+    if (!f) meep::abort("cannot write cost weights to %s", fname.c_str());
+    fprintf(f, "# Meep chunk cost weights (per pixel), "
+               "from fragment_stats::calibrate_cost_weights\n");
+    for (int i = 0; i < NUM_COST_WEIGHTS; ++i)
+      fprintf(f, "%s %.8e\n", cost_weight_names[i], cost_weights[i]);
+    fclose(f);
+  }
+  if (meep::verbosity > 0) master_printf("wrote chunk cost weights to %s\n", fname.c_str());
+}
+
+namespace {
+
+// A uniform medium with (optionally) all the off-diagonal elements of
+// epsilon and/or mu nonzero, for the calibration runs.
+class calibration_medium : public meep::material_function {
+public:
+  calibration_medium(bool offdiag_eps, bool offdiag_mu)
+      : offdiag_eps(offdiag_eps), offdiag_mu(offdiag_mu) {}
+  virtual bool has_mu() { return offdiag_mu; }
+  virtual double chi1p1(meep::field_type ft, const meep::vec &r) {
+    (void)r;
+    return ft == meep::E_stuff || ft == meep::D_stuff ? 2.0 : 1.0;
+  }
+  virtual void eff_chi1inv_row(meep::component c, double chi1inv_row[3], const meep::volume &v,
+                               double tol, int maxeval) {
+    (void)v;
+    (void)tol;
+    (void)maxeval;
+    const bool electric = meep::is_electric(c);
+    // the row of inv([a b b; b a b; b b a]) = [a+b -b -b; ...] / ((a-b)(a+2b))
+    const double a = electric ? 2.0 : 1.0;
+    const double b = (electric ? offdiag_eps : offdiag_mu) ? 0.1 : 0.0;
+    const int i = meep::component_direction(c) - meep::X;
+    for (int j = 0; j < 3; ++j)
+      chi1inv_row[j] = (j == i ? a + b : -b) / ((a - b) * (a + 2 * b));
+  }
+
+private:
+  bool offdiag_eps, offdiag_mu;
+};
+
+double calibration_one(const meep::vec &r) {
+  (void)r;
+  return 1.0;
+}
+
+double calibration_chi3(const meep::vec &r) {
+  (void)r;
+  return 1e-3;
+}
+
+double calibration_conductivity(const meep::vec &r) {
+  (void)r;
+  return 0.1;
+}
+
+enum calibration_run {
+  PLAIN_RUN,
+  ANISOTROPIC_EPS_RUN,
+  ANISOTROPIC_MU_RUN,
+  NONLINEAR_RUN,
+  SUSCEPTIBILITY_RUN,
+  CONDUCTIVITY_RUN,
+  PML_1D_RUN,
+  PML_2D_RUN,
+  PML_3D_RUN,
+  DFT_RUN,
+  NUM_CALIBRATION_RUNS
+};
+
+const int calibration_dft_freqs = 10;
+
+/* Wall time per timestep of an n x n x n cell (in a single chunk) in which
+   every pixel has the feature of the given run.  Every process returns the
+   time measured by the master process. */
+double calibration_time(calibration_run run, int n, int num_steps) {
+  const double a = 10, L = n / a;
+  const meep::grid_volume gv = meep::vol3d(L, L, L, a);
+  // PML in 1, 2, or 3 directions, covering all but the 2 middle pixels along each direction
+  const double dpml = L / 2 - 1 / a;
+  meep::boundary_region br;
+  if (run == PML_1D_RUN)
+    br = meep::pml(dpml, meep::X);
+  else if (run == PML_2D_RUN)
+    br = meep::pml(dpml, meep::X) + meep::pml(dpml, meep::Y);
+  else if (run == PML_3D_RUN)
+    br = meep::pml(dpml);
+  calibration_medium medium(run == ANISOTROPIC_EPS_RUN, run == ANISOTROPIC_MU_RUN);
+  meep::structure s(gv, medium, br, meep::identity(), 1);
+  if (run == NONLINEAR_RUN) s.set_chi3(calibration_chi3);
+  if (run == SUSCEPTIBILITY_RUN)
+    s.add_susceptibility(calibration_one, meep::E_stuff, meep::lorentzian_susceptibility(1.0, 0.1));
+  if (run == CONDUCTIVITY_RUN) {
+    s.set_conductivity(meep::Dx, calibration_conductivity);
+    s.set_conductivity(meep::Dy, calibration_conductivity);
+    s.set_conductivity(meep::Dz, calibration_conductivity);
+  }
+
+  meep::fields f(&s);
+  f.add_point_source(meep::Ex, meep::continuous_src_time(1.0), gv.center());
+  if (run == DFT_RUN) f.add_dft(meep::Ex, gv.surroundings(), 0.5, 1.5, calibration_dft_freqs);
+  f.step(); // allocate everything before timing
+  const double start = meep::wall_time();
+  for (int i = 0; i < num_steps; ++i)
+    f.step();
+  return meep::broadcast(0, (meep::wall_time() - start) / num_steps);
+}
+
+} // namespace
+
+/* Measure the weights of cost() on this machine, by timing short runs of
+   an n x n x n cell in which every pixel has one of the features counted
+   by fragment_stats, and save them to filename (default: see
+   cost_weights_filename).  Each weight is the time per pixel relative to
+   the plain run, per element as counted by fragment_stats (e.g. per
+   nonzero off-diagonal element of epsilon), and all of the weights are
+   rescaled so that the weight of a plain pixel is unchanged, since only
+   the relative weights matter for splitting the cell. */
+void fragment_stats::calibrate_cost_weights(const char *filename, int n, int num_steps) {
+  if (n < 4 || num_steps < 1)
+    meep::abort("invalid size %d or steps %d for calibration", n, num_steps);
+  const int saved_verbosity = meep::verbosity;
+  meep::verbosity = 0;
+  double t[NUM_CALIBRATION_RUNS];
+  for (int run = 0; run < NUM_CALIBRATION_RUNS; ++run)
+    t[run] = calibration_time(calibration_run(run), n, num_steps);
+  meep::verbosity = saved_verbosity;
+
+  // number of elements (per pixel) counted by fragment_stats for each run
+  const double pixels = double(n) * n * n;
+  const double elements[NUM_COST_WEIGHTS] = {3, 3, 3, 1, 3, 1, 1, 1, calibration_dft_freqs, 1};
+  const calibration_run runs[NUM_COST_WEIGHTS] = {
+      ANISOTROPIC_EPS_RUN, ANISOTROPIC_MU_RUN, NONLINEAR_RUN, SUSCEPTIBILITY_RUN, CONDUCTIVITY_RUN,
+      PML_1D_RUN,          PML_2D_RUN,         PML_3D_RUN,    DFT_RUN,            PLAIN_RUN};
+  const double scale = cost_weights[PIXEL_COST] / (t[PLAIN_RUN] / pixels);
+  for (int i = 0; i < NUM_COST_WEIGHTS; ++i) {
+    if (runs[i] == PLAIN_RUN) continue; // unchanged by the rescaling (up to roundoff)
+    double dt = t[runs[i]] - t[PLAIN_RUN];
+    double count = pixels * elements[i];
+    if (runs[i] >= PML_1D_RUN && runs[i] <= PML_3D_RUN) {
+      /* with PML in k directions, C(k,j) (n-2)^j 2^(k-j) n^(3-k) pixels are
+         in the overlap of j PML regions: subtract the cost of those with
+         j < k, using the weights that were already computed for them */
+      const int k = runs[i] - PML_1D_RUN + 1;
+      for (int j = 1; j <= k; ++j) {
+        const double binomial = k == 3 && (j == 1 || j == 2) ? 3 : (k == 2 && j == 1 ? 2 : 1);
+        const double pml_pixels =
+            binomial * pow(n - 2.0, j) * pow(2.0, k - j) * pow(double(n), 3 - k);
+        if (j < k)
+          dt -= pml_pixels * cost_weights[PML_1D_COST + j - 1] / scale;
+        else
+          count = pml_pixels;
+      }
+    }
+    // timing noise can make a cheap feature look slightly faster than a plain pixel
+    cost_weights[i] = std::max(0.0, dt) / count * scale;
+  }
+
+  if (meep::verbosity > 0) {
+    master_printf("calibrated chunk cost weights (%g s per plain pixel-step):\n",
+                  t[PLAIN_RUN] / pixels);
+    for (int i = 0; i < NUM_COST_WEIGHTS; ++i)
+      master_printf("  %s: %g\n", cost_weight_names[i], cost_weights[i]);
+  }
+  save_cost_weights(filename);
 }
 
 void fragment_stats::print_stats() const {
@@ -69,10 +69,35 @@ struct fragment_stats {
   static std::vector<meep::volume> absorber_vols;
   static material_type_list extra_materials;
   static bool split_chunks_evenly;
+  static bool split_chunks_hilbert;
   static bool eps_averaging;
 
   static bool has_non_medium_material();
 
+  // Weights of the pixel counts in cost(), in the order of print_stats.  The
+  // defaults can be replaced by weights measured on the current machine with
+  // calibrate_cost_weights, which are saved to a file that is read the first
+  // time that a cell is split into chunks by cost.
+  enum {
+    ANISOTROPIC_EPS_COST,
+    ANISOTROPIC_MU_COST,
+    NONLINEAR_COST,
+    SUSCEPTIBILITY_COST,
+    CONDUCTIVITY_COST,
+    PML_1D_COST,
+    PML_2D_COST,
+    PML_3D_COST,
+    DFT_COST,
+    PIXEL_COST,
+    NUM_COST_WEIGHTS
+  };
+  static double cost_weights[NUM_COST_WEIGHTS];
+  static const char *cost_weight_names[NUM_COST_WEIGHTS];
+  static void init_cost_weights();
+  static bool load_cost_weights(const char *filename = NULL);
+  static void save_cost_weights(const char *filename = NULL);
+  static void calibrate_cost_weights(const char *filename = NULL, int n = 32, int num_steps = 20);
+
   size_t num_anisotropic_eps_pixels;
   size_t num_anisotropic_mu_pixels;
   size_t num_nonlinear_pixels;
@@ -154,6 +179,10 @@ inline vector3 make_vector3(double x = 0.0, double y = 0.0, double z = 0.0) {
 }
 
 void set_dimensions(int dims);
+/* if dirname is not NULL, set_materials_from_geometry stores the structure in
+   (and loads it from) a file in this directory, named by a hash of the geometry,
+   materials, grid, and subpixel-averaging parameters (but not of the chunks) */
+void set_structure_cache_directory(const char *dirname);
 void set_materials_from_geometry(meep::structure *s, geometric_object_list g,
                                  vector3 center = make_vector3(),
                                  bool use_anisotropic_averaging = true,
@@ -17,6 +17,7 @@
 
 /* this file implements multilevel atomic materials for Meep */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "meep.hpp"
@@ -222,6 +223,12 @@ void *multilevel_susceptibility::copy_internal_data(void *data) const {
   return (void *)dnew;
 }
 
+realnum *multilevel_susceptibility::internal_data_values(void *data, size_t *n) const {
+  multilevel_data *d = (multilevel_data *)data;
+  *n = (d->sz_data - offsetof(multilevel_data, data)) / sizeof(realnum);
+  return d->data;
+}
+
 int multilevel_susceptibility::num_cinternal_notowned_needed(component c,
                                                              void *P_internal_data) const {
   multilevel_data *d = (multilevel_data *)P_internal_data;
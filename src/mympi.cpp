@@ -18,6 +18,8 @@
 #include <cstdlib>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
+#include <algorithm>
 
 #include "meep.hpp"
 #include "config.h"
@@ -483,6 +485,121 @@ void and_to_all(const int *in, int *out, int size) {
 #endif
 }
 
+/* Concatenate the arrays "in" of all processes, in order of rank, on
+   all processes (MPI_Allgatherv) or only on the master (MPI_Gatherv).
+   The data are sent in rounds so that the MPI counts fit in an int. */
+static std::vector<double> gather_arrays(const std::vector<double> &in, bool to_all) {
+#ifdef HAVE_MPI
+  const int nprocs = count_processors();
+  std::vector<unsigned long long> sizes(nprocs);
+  unsigned long long mysize = in.size();
+  MPI_Allgather(&mysize, 1, MPI_UNSIGNED_LONG_LONG, &sizes[0], 1, MPI_UNSIGNED_LONG_LONG, mycomm);
+  std::vector<size_t> start(nprocs + 1, 0);
+  for (int p = 0; p < nprocs; ++p)
+    start[p + 1] = start[p] + sizes[p];
+  const bool receive = to_all || am_master();
+  std::vector<double> out(receive ? start[nprocs] : 0);
+
+  const size_t maxsend = INT_MAX / nprocs;
+  std::vector<int> counts(nprocs), displs(nprocs);
+  std::vector<double> buf;
+  for (size_t pos = 0; pos < *std::max_element(sizes.begin(), sizes.end()); pos += maxsend) {
+    int total = 0;
+    for (int p = 0; p < nprocs; ++p) {
+      counts[p] = int(sizes[p] > pos ? std::min(maxsend, size_t(sizes[p] - pos)) : 0);
+      displs[p] = total;
+      total += counts[p];
+    }
+    buf.resize(receive ? total : 0);
+    const double *sendbuf = counts[my_rank()] ? &in[pos] : NULL;
+    double *recvbuf = buf.empty() ? NULL : &buf[0];
+    if (to_all)
+      MPI_Allgatherv((void *)sendbuf, counts[my_rank()], MPI_DOUBLE, recvbuf, &counts[0],
+                     &displs[0], MPI_DOUBLE, mycomm);
+    else
+      MPI_Gatherv((void *)sendbuf, counts[my_rank()], MPI_DOUBLE, recvbuf, &counts[0], &displs[0],
+                  MPI_DOUBLE, 0, mycomm);
+    if (receive)
+      for (int p = 0; p < nprocs; ++p)
+        if (counts[p]) memcpy(&out[start[p] + pos], &buf[displs[p]], counts[p] * sizeof(double));
+  }
+  return out;
+#else
+  UNUSED(to_all);
+  return in;
+#endif
+}
+
+std::vector<double> gather_to_all(const std::vector<double> &in) { return gather_arrays(in, true); }
+
+std::vector<double> gather_to_master(const std::vector<double> &in) {
+  return gather_arrays(in, false);
+}
+
+#if defined(HAVE_MPI) && MPI_VERSION >= 3
+static void *start_iallreduce(const void *in, void *out, int size, MPI_Datatype type, MPI_Op op) {
+  MPI_Request *req = new MPI_Request;
+  MPI_Iallreduce((void *)in, out, size, type, op, mycomm, req);
+  return (void *)req;
+}
+#endif
+
+void reduction_request::sum_to_all(const double *in, double *out, int size) {
+  wait();
+#if defined(HAVE_MPI) && MPI_VERSION >= 3
+  req = start_iallreduce(in, out, size, MPI_DOUBLE, MPI_SUM);
+#else
+  meep::sum_to_all(in, out, size);
+#endif
+}
+
+void reduction_request::sum_to_all(const complex<double> *in, complex<double> *out, int size) {
+  sum_to_all((const double *)in, (double *)out, 2 * size);
+}
+
+void reduction_request::max_to_all(const double *in, double *out, int size) {
+  wait();
+#if defined(HAVE_MPI) && MPI_VERSION >= 3
+  req = start_iallreduce(in, out, size, MPI_DOUBLE, MPI_MAX);
+#elif defined(HAVE_MPI)
+  MPI_Allreduce((void *)in, out, size, MPI_DOUBLE, MPI_MAX, mycomm);
+#else
+  memcpy(out, in, sizeof(double) * size);
+#endif
+}
+
+void reduction_request::or_to_all(const int *in, int *out, int size) {
+  wait();
+#if defined(HAVE_MPI) && MPI_VERSION >= 3
+  req = start_iallreduce(in, out, size, MPI_INT, MPI_LOR);
+#else
+  meep::or_to_all(in, out, size);
+#endif
+}
+
+bool reduction_request::test() {
+#ifdef HAVE_MPI
+  if (req) {
+    int done;
+    MPI_Test((MPI_Request *)req, &done, MPI_STATUS_IGNORE);
+    if (!done) return false;
+    delete (MPI_Request *)req;
+    req = NULL;
+  }
+#endif
+  return true;
+}
+
+void reduction_request::wait() {
+#ifdef HAVE_MPI
+  if (req) {
+    MPI_Wait((MPI_Request *)req, MPI_STATUS_IGNORE);
+    delete (MPI_Request *)req;
+    req = NULL;
+  }
+#endif
+}
+
 void all_wait() {
 #ifdef HAVE_MPI
   MPI_Barrier(mycomm);
@@ -753,6 +870,41 @@ void end_divide_parallel(void) {
 #endif
 }
 
+/* Fill node_ids[0..count_processors()-1] with an integer identifying the
+   shared-memory node (i.e. the machine) of each process, so that callers
+   can tell which processes communicate without going over the network.
+   The id of a node is the lowest rank among its processes. */
+void get_node_ids(int *node_ids) {
+#ifdef HAVE_MPI
+  int node_id = my_rank();
+#if MPI_VERSION >= 3
+  MPI_Comm nodecomm;
+  MPI_Comm_split_type(mycomm, MPI_COMM_TYPE_SHARED, my_rank(), MPI_INFO_NULL, &nodecomm);
+  int me = my_rank();
+  MPI_Allreduce(&me, &node_id, 1, MPI_INT, MPI_MIN, nodecomm);
+  MPI_Comm_free(&nodecomm);
+#else
+  // no MPI_Comm_split_type: fall back to comparing processor names
+  char name[MPI_MAX_PROCESSOR_NAME];
+  int len;
+  memset(name, 0, MPI_MAX_PROCESSOR_NAME);
+  MPI_Get_processor_name(name, &len);
+  char *names = new char[MPI_MAX_PROCESSOR_NAME * count_processors()];
+  MPI_Allgather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, names, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+                mycomm);
+  for (int i = 0; i < count_processors(); ++i)
+    if (!strncmp(name, names + i * MPI_MAX_PROCESSOR_NAME, MPI_MAX_PROCESSOR_NAME)) {
+      node_id = i;
+      break;
+    }
+  delete[] names;
+#endif
+  MPI_Allgather(&node_id, 1, MPI_INT, node_ids, 1, MPI_INT, mycomm);
+#else
+  node_ids[0] = 0;
+#endif
+}
+
 int my_global_rank() {
 #ifdef HAVE_MPI
   int rank;
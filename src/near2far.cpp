@@ -24,6 +24,10 @@
 #include <assert.h>
 #include "config.h"
 #include <math.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
 
 using namespace std;
 
@@ -33,7 +37,7 @@ dft_near2far::dft_near2far(dft_chunk *F_, double fmin, double fmax, int Nf, doub
                            const volume &where_, const direction periodic_d_[2],
                            const int periodic_n_[2], const double periodic_k_[2],
                            const double period_[2])
-    : F(F_), eps(eps_), mu(mu_), where(where_) {
+    : F(F_), eps(eps_), mu(mu_), where(where_), use_fft(true), lattice_sum(false) {
   freq = meep::linspace(fmin, fmax, Nf);
   for (int i = 0; i < 2; ++i) {
     periodic_d[i] = periodic_d_[i];
@@ -47,7 +51,7 @@ dft_near2far::dft_near2far(dft_chunk *F_, const std::vector<double> freq_, doubl
                            const volume &where_, const direction periodic_d_[2],
                            const int periodic_n_[2], const double periodic_k_[2],
                            const double period_[2])
-    : F(F_), eps(eps_), mu(mu_), where(where_) {
+    : F(F_), eps(eps_), mu(mu_), where(where_), use_fft(true), lattice_sum(false) {
   freq = freq_;
   for (int i = 0; i < 2; ++i) {
     periodic_d[i] = periodic_d_[i];
@@ -61,7 +65,7 @@ dft_near2far::dft_near2far(dft_chunk *F_, const double *freq_, size_t Nfreq, dou
                            double mu_, const volume &where_, const direction periodic_d_[2],
                            const int periodic_n_[2], const double periodic_k_[2],
                            const double period_[2])
-    : F(F_), eps(eps_), mu(mu_), where(where_) {
+    : F(F_), eps(eps_), mu(mu_), where(where_), use_fft(true), lattice_sum(false) {
   freq.resize(Nfreq);
   for (size_t i = 0; i < Nfreq; ++i)
     freq[i] = freq_[i];
@@ -73,7 +77,9 @@ dft_near2far::dft_near2far(dft_chunk *F_, const double *freq_, size_t Nfreq, dou
   }
 }
 
-dft_near2far::dft_near2far(const dft_near2far &f) : F(f.F), eps(f.eps), mu(f.mu), where(f.where) {
+dft_near2far::dft_near2far(const dft_near2far &f)
+    : F(f.F), eps(f.eps), mu(f.mu), where(f.where), use_fft(f.use_fft),
+      lattice_sum(f.lattice_sum) {
   freq = f.freq;
   for (int i = 0; i < 2; ++i) {
     periodic_d[i] = f.periodic_d[i];
@@ -205,22 +211,15 @@ static std::complex<double> hankel(int n, double x) {
 }
 #endif /* !HAVE_LIBGSL */
 
-/* like green3d, but 2d Green's functions */
-void green2d(std::complex<double> *EH, const vec &x, double freq, double eps, double mu,
-             const vec &x0, component c0, std::complex<double> f0) {
-  vec rhat = x - x0;
-  double r = abs(rhat);
-  rhat = rhat / r;
-
-  if (rhat.dim != D2) abort("wrong dimensionality in green2d");
-
-  double omega = 2 * pi * freq;
+/* the 2d Green's functions of green2d at the unit vector rhat, distance r, and
+   frequency omega, given the Hankel functions Hn = hankel(n, k*r) * f0 for n < 2
+   (H2 is computed by the recurrence H2 = 2 H1 / kr - H0) */
+static void green2d_hankel(std::complex<double> *EH, const vec &rhat, double r, double omega,
+                           double eps, double mu, component c0, std::complex<double> H0,
+                           std::complex<double> H1) {
   double k = omega * sqrt(eps * mu);
   std::complex<double> ik = std::complex<double>(0.0, k);
-  double kr = k * r;
   double Z = sqrt(mu / eps);
-  std::complex<double> H0 = hankel(0, kr) * f0;
-  std::complex<double> H1 = hankel(1, kr) * f0;
   std::complex<double> ikH1 = 0.25 * ik * H1;
 
   if (component_direction(c0) == meep::Z) {
@@ -242,7 +241,7 @@ void green2d(std::complex<double> *EH, const vec &x, double freq, double eps, do
     }
   }
   else { /* in-plane source */
-    std::complex<double> H2 = hankel(2, kr) * f0;
+    std::complex<double> H2 = (2 / (k * r)) * H1 - H0;
 
     vec p = zero_vec(rhat.dim);
     p.set_direction(component_direction(c0), 1);
@@ -273,6 +272,20 @@ void green2d(std::complex<double> *EH, const vec &x, double freq, double eps, do
   }
 }
 
+/* like green3d, but 2d Green's functions */
+void green2d(std::complex<double> *EH, const vec &x, double freq, double eps, double mu,
+             const vec &x0, component c0, std::complex<double> f0) {
+  vec rhat = x - x0;
+  double r = abs(rhat);
+  rhat = rhat / r;
+
+  if (rhat.dim != D2) abort("wrong dimensionality in green2d");
+
+  double omega = 2 * pi * freq;
+  double kr = omega * sqrt(eps * mu) * r;
+  green2d_hankel(EH, rhat, r, omega, eps, mu, c0, hankel(0, kr) * f0, hankel(1, kr) * f0);
+}
+
 // cylindrical Green's function constructed by integrating green3d as the source
 // term rotates around the z axis with exp(im*phi) dependence, integrated to a tolerance tol.
 // (note: this is the Green's function divided by 2pi*x0.r(), to compensate for a 2piR factor
@@ -338,16 +351,208 @@ void greencyl(std::complex<double> *EH, const vec &x, double freq, double eps, d
   }
 }
 
+/***************************************************************/
+/* Lattice sums for periodic near-to-far transformations: the  */
+/* sum of the Green's functions over all of the Bloch-periodic */
+/* copies of the near-field points is the Floquet expansion    */
+/*   sum_m i/(2 A beta_m) exp(i k_m.(x-x0) + i beta_m |z-z0|)  */
+/* (A = the area or length of a unit cell, k_m = the Floquet   */
+/* wavevectors, beta_m = sqrt(k^2 - k_m^2)), i.e. a sum of     */
+/* plane waves.  The amplitudes of the plane waves depend only */
+/* on the sources, and are computed once for all far points.   */
+/* The evanescent waves decay as exp(-Im(beta_m) |z-z0|), so   */
+/* only a few of them are needed if the far points are not     */
+/* too close to the near-field points.                         */
+/***************************************************************/
+
+#define LATTICE_SUM_DECAY 32 // drop modes that decay by more than exp(-LATTICE_SUM_DECAY)
+
+class lattice_sum_fields {
+public:
+  /* the plane-wave amplitudes of the near-field points pts (of near_field_points),
+     for far points in where, summed over all processes if collective */
+  lattice_sum_fields(const dft_near2far &n2f, const std::vector<double> &pts,
+                     const volume &where, bool collective)
+      : freq(n2f.freq), eps(n2f.eps), mu(n2f.mu) {
+    const ndim dim = where.dim;
+    if (dim != D2 && dim != D3) abort("lattice_sum is only supported in 2d or 3d");
+    int nper = 0; // the periodic directions are dp[0], ..., dp[nper-1]
+    for (int j = 0; j < 2; ++j) {
+      dp[j] = NO_DIRECTION;
+      period[j] = 1.0;
+      phase[j] = 0.0;
+    }
+    for (int j = 0; j < 2; ++j)
+      if (n2f.periodic_d[j] != NO_DIRECTION) {
+        dp[nper] = n2f.periodic_d[j];
+        period[nper] = n2f.period[j];
+        phase[nper++] = n2f.periodic_k[j];
+      }
+    if (nper != (dim == D2 ? 1 : 2))
+      abort("lattice_sum requires a near2far surface that is periodic in %d directions",
+            dim == D2 ? 1 : 2);
+    dn = NO_DIRECTION;
+    LOOP_OVER_DIRECTIONS(dim, d) {
+      if (d != dp[0] && d != dp[1]) dn = d;
+    }
+
+    const size_t Nfreq = freq.size(), stride = 8 + 2 * Nfreq;
+    double z0min = infinity, z0max = -infinity;
+    for (size_t n = 0; n + stride <= pts.size(); n += stride) {
+      z0min = std::min(z0min, pts[n + dn]);
+      z0max = std::max(z0max, pts[n + dn]);
+    }
+    if (collective) {
+      z0min = -max_to_all(-z0min);
+      z0max = max_to_all(z0max);
+    }
+    modes.resize(Nfreq);
+    if (z0min > z0max) return; // no near-field points
+
+    double dist;
+    if (where.in_direction_min(dn) > z0max) {
+      side = 1;
+      zc = z0max;
+      dist = where.in_direction_min(dn) - z0max;
+    }
+    else if (where.in_direction_max(dn) < z0min) {
+      side = -1;
+      zc = z0min;
+      dist = z0min - where.in_direction_max(dn);
+    }
+    else
+      abort("lattice_sum requires far-field points on one side of the near-field points");
+
+    const double kappa = LATTICE_SUM_DECAY / dist; // maximum Im(beta)
+    size_t nmodes = 0;
+    for (size_t i = 0; i < Nfreq; ++i) {
+      const double k = 2 * pi * freq[i] * sqrt(eps * mu);
+      const double ktmax = sqrt(k * k + kappa * kappa);
+      int mlo[2], mhi[2];
+      for (int j = 0; j < 2; ++j) {
+        mlo[j] = j < nper ? int(ceil((-ktmax * period[j] - phase[j]) / (2 * pi))) : 0;
+        mhi[j] = j < nper ? int(floor((ktmax * period[j] - phase[j]) / (2 * pi))) : 0;
+      }
+      if (double(mhi[0] - mlo[0] + 1) * (mhi[1] - mlo[1] + 1) * Nfreq > 1e7)
+        abort("far-field points are too close to the near-field points for lattice_sum");
+      for (int m0 = mlo[0]; m0 <= mhi[0]; ++m0)
+        for (int m1 = mlo[1]; m1 <= mhi[1]; ++m1) {
+          mode md;
+          md.kt[0] = (phase[0] + 2 * pi * m0) / period[0];
+          md.kt[1] = nper == 2 ? (phase[1] + 2 * pi * m1) / period[1] : 0.0;
+          const double beta2 = k * k - md.kt[0] * md.kt[0] - md.kt[1] * md.kt[1];
+          if (beta2 < -kappa * kappa) continue;
+          md.beta = beta2 >= 0 ? std::complex<double>(sqrt(beta2), 0)
+                               : std::complex<double>(0, sqrt(-beta2));
+          for (int a = 0; a < 3; ++a)
+            md.J[a] = md.M[a] = 0.0;
+          modes[i].push_back(md);
+        }
+      nmodes += modes[i].size();
+    }
+
+    /* the amplitudes J and M are the Fourier components of the electric and
+       magnetic currents, relative to the plane z = zc */
+    for (size_t n = 0; n + stride <= pts.size(); n += stride) {
+      const double *p = &pts[n];
+      const component c0 = component(int(p[6]));
+      const int a = component_direction(c0);
+      const bool electric = is_electric(c0);
+      const double rho[2] = {p[dp[0]], dp[1] == NO_DIRECTION ? 0.0 : p[dp[1]]};
+      for (size_t i = 0; i < Nfreq; ++i) {
+        const std::complex<double> f0(p[8 + 2 * i], p[9 + 2 * i]);
+        for (size_t im = 0; im < modes[i].size(); ++im) {
+          mode &md = modes[i][im];
+          const std::complex<double> ph =
+              exp(std::complex<double>(0, -(md.kt[0] * rho[0] + md.kt[1] * rho[1])) -
+                  std::complex<double>(0, side * (p[dn] - zc)) * md.beta);
+          (electric ? md.J : md.M)[a] += f0 * ph;
+        }
+      }
+    }
+    if (collective) {
+      std::vector<std::complex<double> > JM;
+      JM.reserve(6 * nmodes);
+      for (size_t i = 0; i < Nfreq; ++i)
+        for (size_t im = 0; im < modes[i].size(); ++im)
+          for (int a = 0; a < 3; ++a) {
+            JM.push_back(modes[i][im].J[a]);
+            JM.push_back(modes[i][im].M[a]);
+          }
+      if (!JM.empty()) array_to_all((double *)JM.data(), 2 * JM.size());
+      size_t j = 0;
+      for (size_t i = 0; i < Nfreq; ++i)
+        for (size_t im = 0; im < modes[i].size(); ++im)
+          for (int a = 0; a < 3; ++a) {
+            modes[i][im].J[a] = JM[j++];
+            modes[i][im].M[a] = JM[j++];
+          }
+    }
+  }
+
+  /* the far fields EH[6 * Nfreq] at x (as in farfield_lowlevel) */
+  void fields(std::complex<double> *EH, const vec &x) const {
+    const size_t Nfreq = freq.size();
+    const std::complex<double> I(0, 1);
+    for (size_t i = 0; i < 6 * Nfreq; ++i)
+      EH[i] = 0.0;
+    for (size_t i = 0; i < Nfreq; ++i) {
+      const double omega = 2 * pi * freq[i], k2 = omega * omega * eps * mu;
+      const double area = period[0] * period[1];
+      for (size_t im = 0; im < modes[i].size(); ++im) {
+        const mode &md = modes[i][im];
+        std::complex<double> K[3] = {0.0, 0.0, 0.0};
+        K[dp[0]] = md.kt[0];
+        if (dp[1] != NO_DIRECTION) K[dp[1]] = md.kt[1];
+        K[dn] = side * md.beta;
+        const std::complex<double> P =
+            I / (2 * area * md.beta) *
+            exp(I * (md.kt[0] * x.in_direction(dp[0]) +
+                     (dp[1] == NO_DIRECTION ? 0.0 : md.kt[1] * x.in_direction(dp[1])) +
+                     side * md.beta * (x.in_direction(dn) - zc)));
+        const std::complex<double> KJ = K[0] * md.J[0] + K[1] * md.J[1] + K[2] * md.J[2];
+        const std::complex<double> KM = K[0] * md.M[0] + K[1] * md.M[1] + K[2] * md.M[2];
+        for (int a = 0; a < 3; ++a) {
+          const int b = (a + 1) % 3, c = (a + 2) % 3;
+          const std::complex<double> KxJ = K[b] * md.J[c] - K[c] * md.J[b];
+          const std::complex<double> KxM = K[b] * md.M[c] - K[c] * md.M[b];
+          EH[6 * i + a] += P * (I * omega * mu * (md.J[a] - K[a] * KJ / k2) - I * KxM);
+          EH[6 * i + 3 + a] += P * (I * omega * eps * (md.M[a] - K[a] * KM / k2) + I * KxJ);
+        }
+      }
+    }
+  }
+
+private:
+  struct mode {
+    double kt[2];              // Floquet wavevector along the periodic directions
+    std::complex<double> beta; // wavevector along dn, sqrt(k^2 - kt^2)
+    std::complex<double> J[3], M[3]; // amplitudes of the electric and magnetic currents
+  };
+  std::vector<double> freq;
+  double eps, mu;
+  direction dp[2], dn; // periodic and non-periodic directions
+  double period[2], phase[2];
+  double side, zc; // side (+1 or -1) of the far points relative to the plane z = zc
+  std::vector<std::vector<mode> > modes; // the modes of each frequency
+};
+
 void dft_near2far::farfield_lowlevel(std::complex<double> *EH, const vec &x) {
+  if (lattice_sum) {
+    lattice_sum_fields(*this, near_field_points(), volume(x, x), false).fields(EH, x);
+    return;
+  }
   if (x.dim != D3 && x.dim != D2 && x.dim != Dcyl)
     abort("only 2d or 3d or cylindrical far-field computation is supported");
   greenfunc green = x.dim == D2 ? green2d : green3d;
+  flush_dfts(F);
 
   const size_t Nfreq = freq.size();
   for (size_t i = 0; i < 6 * Nfreq; ++i)
     EH[i] = 0.0;
 
   for (dft_chunk *f = F; f; f = f->next_in_dft) {
+    if (!f->fc) continue; // an anchor of the list (see fields::dft_anchors)
     assert(Nfreq == f->omega.size());
 
     component c0 = component(f->vc); /* equivalent source component */
@@ -373,10 +578,10 @@ void dft_near2far::farfield_lowlevel(std::complex<double> *EH, const vec &x) {
             double phase = phase0 + i1 * periodic_k[1];
             std::complex<double> cphase = std::polar(1.0, phase);
             if (x.dim == Dcyl)
-              greencyl(EH6, x, freq[i], eps, mu, xs, c0, f->dft[Nfreq * idx_dft + i], f->fc->m,
-                       1e-3);
+              greencyl(EH6, x, freq[i], eps, mu, xs, c0, f->dft_value(Nfreq * idx_dft + i),
+                       f->fc->m, 1e-3);
             else
-              green(EH6, x, freq[i], eps, mu, xs, c0, f->dft[Nfreq * idx_dft + i]);
+              green(EH6, x, freq[i], eps, mu, xs, c0, f->dft_value(Nfreq * idx_dft + i));
             for (int j = 0; j < 6; ++j)
               EH[i * 6 + j] += EH6[j] * cphase;
           }
@@ -398,8 +603,668 @@ std::complex<double> *dft_near2far::farfield(const vec &x) {
   return EH;
 }
 
+/***************************************************************/
+/* FFT-accelerated far fields on a regular grid.  If the grid  */
+/* of far-field points is a plane (or line) of constant        */
+/* coordinate in some "normal" direction, the near-field       */
+/* points fall into a few layers (one for each equivalent-     */
+/* source component, normal coordinate, and Yee offset), and   */
+/* each layer lies on a regular lattice of spacing 1/a in the  */
+/* transverse directions.  The far fields of a layer on a      */
+/* regular lattice of points in the far-field plane are then a */
+/* discrete convolution of the layer's currents with the       */
+/* Green's function, which we compute with zero-padded FFTs,   */
+/* and the far fields at the requested points are interpolated */
+/* from this lattice with P-point Lagrange interpolation.  The */
+/* far-field lattice spacing (a fraction of the near-field     */
+/* spacing) is chosen so that the interpolation error is       */
+/* below ~1e-6 for propagating fields.                         */
+/***************************************************************/
+
+#define N2F_INTERP_ORDER 8 // P, the number of lattice points per direction in the interpolation
+
+// in-place 2d FFT of an L[0] x L[1] row-major array, given the twiddle factors of each dimension
+static void fft_2d(complex<double> *a, const size_t L[2], const vector<complex<double> > w[2],
+                   bool inverse) {
+  if (L[1] > 1)
+    for (size_t i0 = 0; i0 < L[0]; ++i0)
+      fft_radix2(a + i0 * L[1], L[1], w[1].data(), inverse);
+  if (L[0] > 1) {
+    vector<complex<double> > col(L[0]);
+    for (size_t i1 = 0; i1 < L[1]; ++i1) {
+      for (size_t i0 = 0; i0 < L[0]; ++i0)
+        col[i0] = a[i0 * L[1] + i1];
+      fft_radix2(col.data(), L[0], w[0].data(), inverse);
+      for (size_t i0 = 0; i0 < L[0]; ++i0)
+        a[i0 * L[1] + i1] = col[i0];
+    }
+  }
+}
+
+static size_t next_pow2(size_t n) {
+  size_t L = 1;
+  while (L < n)
+    L *= 2;
+  return L;
+}
+
+bool dft_near2far::farfields_fft(double *EH, const volume &where, const size_t dims[3],
+                                 const direction dirs[3], const double dx[3]) {
+  if (!use_fft || lattice_sum || (where.dim != D2 && where.dim != D3)) return false;
+  greenfunc green = where.dim == D2 ? green2d : green3d;
+  flush_dfts(F);
+
+  // the choice of method is made collectively, since the direct sum may synchronize the processes
+  bool ok = true;
+  const size_t Nfreq = freq.size();
+  const int ndirs = where.dim == D2 ? 2 : 3;
+  double a = 0;
+  for (dft_chunk *f = F; f && a == 0; f = f->next_in_dft)
+    if (f->fc) a = f->fc->gv.a;
+  a = max_to_all(a);
+  if (a == 0) return false; // no near-field points
+  const double d = 1 / a;   // the spacing of the near-field grid
+  const int P = N2F_INTERP_ORDER;
+
+  /* the near-field points, including their periodic images, with
+     their coordinates in units of half a pixel */
+  struct point {
+    const dft_chunk *f;
+    size_t idx_dft;
+    complex<double> phase;
+    int h[3];
+  };
+  vector<point> pts;
+  for (dft_chunk *f = F; f; f = f->next_in_dft) {
+    if (!f->fc) continue; // an anchor of the list (see fields::dft_anchors)
+    vec rshift(f->shift * (0.5 * f->fc->gv.inva));
+    size_t idx_dft = 0;
+    LOOP_OVER_IVECS(f->fc->gv, f->is, f->ie, idx) {
+      IVEC_LOOP_LOC(f->fc->gv, x0);
+      x0 = f->S.transform(x0, f->sn) + rshift;
+      for (int i0 = -periodic_n[0]; ok && i0 <= periodic_n[0]; ++i0)
+        for (int i1 = -periodic_n[1]; i1 <= periodic_n[1]; ++i1) {
+          vec xs(x0);
+          if (periodic_d[0] != NO_DIRECTION)
+            xs.set_direction(periodic_d[0], x0.in_direction(periodic_d[0]) + i0 * period[0]);
+          if (periodic_d[1] != NO_DIRECTION)
+            xs.set_direction(periodic_d[1], x0.in_direction(periodic_d[1]) + i1 * period[1]);
+          point p = {f, idx_dft, polar(1.0, i0 * periodic_k[0] + i1 * periodic_k[1]), {0, 0, 0}};
+          for (int r = 0; r < ndirs; ++r) {
+            double h = 2 * xs.in_direction(dirs[r]) / d;
+            p.h[r] = my_round(h);
+            if (fabs(h - p.h[r]) > 1e-6) ok = false; // not on the grid
+          }
+          pts.push_back(p);
+        }
+      idx_dft++;
+    }
+  }
+
+  /* the normal direction is the direction of constant far-field
+     coordinate in which the near-field points have the fewest
+     distinct coordinates (i.e. the fewest layers) */
+  int rn = -1;
+  size_t nbest = 0;
+  for (int r = 0; r < ndirs; ++r)
+    if (dims[r] == 1) {
+      std::set<int> hs;
+      for (const point &p : pts)
+        hs.insert(p.h[r]);
+      if (rn < 0 || hs.size() < nbest) {
+        rn = r;
+        nbest = hs.size();
+      }
+    }
+  if (rn < 0) return false;
+  int rt[2] = {-1, -1}; // the transverse directions (only rt[1] in 2d)
+  for (int r = 0, t = 3 - ndirs; r < ndirs; ++r)
+    if (r != rn) rt[t++] = r;
+  const double zfar = where.in_direction_min(dirs[rn]);
+
+  /* the layers of near-field points, keyed by the equivalent-source
+     component, the normal coordinate, and the transverse Yee offsets */
+  struct layer {
+    component c0;
+    int hn, hmin[2], hmax[2];
+    vector<size_t> pts;
+  };
+  std::map<std::tuple<int, int, int, int>, layer> layers;
+  for (size_t n = 0; n < pts.size(); ++n) {
+    const point &p = pts[n];
+    int h[2];
+    for (int t = 0; t < 2; ++t)
+      h[t] = rt[t] < 0 ? 0 : p.h[rt[t]];
+    layer &l = layers[std::make_tuple(p.f->vc, p.h[rn], h[0] & 1, h[1] & 1)];
+    if (l.pts.empty()) {
+      l.c0 = component(p.f->vc);
+      l.hn = p.h[rn];
+      for (int t = 0; t < 2; ++t)
+        l.hmin[t] = l.hmax[t] = h[t];
+    }
+    for (int t = 0; t < 2; ++t) {
+      l.hmin[t] = std::min(l.hmin[t], h[t]);
+      l.hmax[t] = std::max(l.hmax[t], h[t]);
+    }
+    l.pts.push_back(n);
+  }
+  for (auto &kl : layers) // too close for the interpolation (or the Green's function)
+    if (fabs(zfar - kl.second.hn * 0.5 * d) < P * d) ok = false;
+
+  /* the lattice of far-field points: No[t] points with spacing
+     delta[t] = d / q[t] starting at O[t], or just the far-field
+     coordinate in directions where the grid has a single point */
+  double kmax = 0;
+  for (size_t i = 0; i < Nfreq; ++i)
+    kmax = std::max(kmax, 2 * pi * fabs(freq[i]) * sqrt(eps * mu));
+  int q[2] = {1, 1};
+  size_t No[2] = {1, 1}, Ms[2] = {1, 1}, L[2] = {1, 1};
+  double O[2] = {0, 0}, delta[2] = {d, d};
+  for (int t = 0; t < 2; ++t) {
+    if (rt[t] < 0) continue;
+    const int r = rt[t];
+    O[t] = where.in_direction_min(dirs[r]);
+    if (dims[r] > 1) {
+      q[t] = std::max(1, int(ceil(kmax * d / 0.4)));
+      delta[t] = d / q[t];
+      O[t] -= (P / 2 - 1) * delta[t];
+      No[t] = size_t(floor((dx[r] * (dims[r] - 1)) / delta[t])) + P + 1;
+    }
+    for (auto &kl : layers)
+      Ms[t] = std::max(Ms[t], size_t((kl.second.hmax[t] - kl.second.hmin[t]) / 2) * q[t] + 1);
+    L[t] = next_pow2(No[t] + Ms[t] - 1);
+  }
+  const size_t Ltot = L[0] * L[1];
+
+  /* estimated cost, in units of Green's-function evaluations per
+     frequency (each of which costs about as much as 20 log2(L) FFT
+     butterflies), compared to the direct sum over all pairs of points */
+  const size_t N = dims[0] * dims[1] * dims[2];
+  const double log2L = log2(double(Ltot));
+  const double cost_fft = layers.empty() ? 0.0
+                                         : layers.size() * Ltot * (1 + 0.05 * log2L) +
+                                               0.05 * Ltot * log2L +
+                                               0.01 * N * (No[0] > 1 ? P : 1) * (No[1] > 1 ? P : 1);
+  if (!and_to_all(ok) || sum_to_all(cost_fft) >= sum_to_all(double(N) * pts.size())) return false;
+  if (verbosity > 1)
+    master_printf("get_farfields_array: FFT near-to-far transform with %d layers on a %zux%zu "
+                  "lattice\n",
+                  int(layers.size()), L[0], L[1]);
+
+  /* interpolation weights from the lattice to the far-field points */
+  vector<size_t> base[2];
+  vector<double> wts[2];
+  int np[2];
+  for (int t = 0; t < 2; ++t) {
+    const size_t n = rt[t] < 0 ? 1 : dims[rt[t]];
+    np[t] = No[t] > 1 ? P : 1;
+    base[t].resize(n);
+    wts[t].resize(n * np[t]);
+    for (size_t i = 0; i < n; ++i) {
+      if (np[t] == 1) {
+        base[t][i] = 0;
+        wts[t][i] = 1;
+        continue;
+      }
+      const double u = (where.in_direction_min(dirs[rt[t]]) + i * dx[rt[t]] - O[t]) / delta[t];
+      const int b = std::min(std::max(int(floor(u)), P / 2 - 1), int(No[t]) - 1 - P / 2);
+      const double s = u - (b - (P / 2 - 1));
+      base[t][i] = b - (P / 2 - 1);
+      for (int j = 0; j < P; ++j) {
+        double w = 1;
+        for (int k = 0; k < P; ++k)
+          if (k != j) w *= (s - k) / (j - k);
+        wts[t][i * P + j] = w;
+      }
+    }
+  }
+
+  if (layers.empty()) { // no near-field points on this process
+    for (size_t n = 0; n < 12 * N * Nfreq; ++n)
+      EH[n] = 0;
+    return true;
+  }
+
+  vector<complex<double> > tw[2];
+  for (int t = 0; t < 2; ++t) {
+    tw[t].resize(L[t] / 2);
+    for (size_t j = 0; j < L[t] / 2; ++j)
+      tw[t][j] = polar(1.0, -2 * pi * j / L[t]);
+  }
+
+  vector<complex<double> > A(Ltot), K(6 * Ltot), acc(6 * Ltot);
+  for (size_t i = 0; i < Nfreq; ++i) {
+    std::fill(acc.begin(), acc.end(), 0.0);
+    for (auto &kl : layers) {
+      const layer &l = kl.second;
+
+      // the currents of the layer, on the lattice (padded with zeros)
+      std::fill(A.begin(), A.end(), 0.0);
+      for (size_t n : l.pts) {
+        const point &p = pts[n];
+        size_t m[2];
+        for (int t = 0; t < 2; ++t)
+          m[t] = rt[t] < 0 ? 0 : size_t((p.h[rt[t]] - l.hmin[t]) / 2) * q[t];
+        A[m[0] * L[1] + m[1]] += p.f->dft_value(Nfreq * p.idx_dft + i) * p.phase;
+      }
+      fft_2d(A.data(), L, tw, false);
+
+      /* the Green's function from lattice point m to far-field
+         lattice point n depends only on k = n - m, for
+         -(Ms-1) <= k <= No-1, and is stored at index k mod L */
+      std::fill(K.begin(), K.end(), 0.0);
+      const int k0min = -int(Ms[0] - 1), k0max = int(No[0]) - 1;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int k0 = k0min; k0 <= k0max; ++k0) {
+        vec x(where.dim);
+        complex<double> EH6[6];
+        x.set_direction(dirs[rn], zfar - l.hn * 0.5 * d);
+        if (rt[0] >= 0) x.set_direction(dirs[rt[0]], O[0] - l.hmin[0] * 0.5 * d + k0 * delta[0]);
+        const size_t i0 = (k0 + L[0]) % L[0];
+        for (int k1 = -int(Ms[1] - 1); k1 < int(No[1]); ++k1) {
+          x.set_direction(dirs[rt[1]], O[1] - l.hmin[1] * 0.5 * d + k1 * delta[1]);
+          green(EH6, x, freq[i], eps, mu, zero_vec(where.dim), l.c0, 1.0);
+          const size_t idx = i0 * L[1] + (k1 + L[1]) % L[1];
+          for (int j = 0; j < 6; ++j)
+            K[j * Ltot + idx] = EH6[j];
+        }
+      }
+      for (int j = 0; j < 6; ++j) {
+        complex<double> *Kj = &K[j * Ltot], *accj = &acc[j * Ltot];
+        bool nonzero = false;
+        for (size_t n = 0; n < Ltot && !nonzero; ++n)
+          nonzero = Kj[n] != 0.0;
+        if (!nonzero) continue; // this field component is not produced by c0
+        fft_2d(Kj, L, tw, false);
+        for (size_t n = 0; n < Ltot; ++n)
+          accj[n] += Kj[n] * A[n];
+      }
+    }
+    for (int j = 0; j < 6; ++j)
+      fft_2d(&acc[j * Ltot], L, tw, true);
+
+    // interpolate from the lattice to the far-field points
+    const double scale = 1.0 / Ltot;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+    for (size_t idx = 0; idx < N; ++idx) {
+      size_t ir[3] = {idx / (dims[1] * dims[2]), (idx / dims[2]) % dims[1], idx % dims[2]};
+      size_t it[2];
+      for (int t = 0; t < 2; ++t)
+        it[t] = rt[t] < 0 ? 0 : ir[rt[t]];
+      complex<double> EH6[6];
+      for (int s0 = 0; s0 < np[0]; ++s0)
+        for (int s1 = 0; s1 < np[1]; ++s1) {
+          const double w = wts[0][it[0] * np[0] + s0] * wts[1][it[1] * np[1] + s1];
+          const size_t n = (base[0][it[0]] + s0) * L[1] + base[1][it[1]] + s1;
+          for (int j = 0; j < 6; ++j)
+            EH6[j] += w * acc[j * Ltot + n];
+        }
+      for (int j = 0; j < 6; ++j) {
+        EH[((j * 2 + 0) * N + idx) * Nfreq + i] = real(EH6[j]) * scale;
+        EH[((j * 2 + 1) * N + idx) * Nfreq + i] = imag(EH6[j]) * scale;
+      }
+    }
+  }
+  return true;
+}
+
+/* The near-field points of this process, packed into an array of
+   doubles so that they can be sent to the other processes: for each
+   point, its coordinates (5 directions and the dimension), the
+   equivalent-source component, the angular index m of the fields (in
+   cylindrical coordinates), and the DFT fields at all frequencies. */
+std::vector<double> dft_near2far::near_field_points() {
+  flush_dfts(F);
+  const size_t Nfreq = freq.size();
+  std::vector<double> pts;
+  for (dft_chunk *f = F; f; f = f->next_in_dft) {
+    if (!f->fc) continue; // an anchor of the list (see fields::dft_anchors)
+    vec rshift(f->shift * (0.5 * f->fc->gv.inva));
+    size_t idx_dft = 0;
+    LOOP_OVER_IVECS(f->fc->gv, f->is, f->ie, idx) {
+      IVEC_LOOP_LOC(f->fc->gv, x0);
+      x0 = f->S.transform(x0, f->sn) + rshift;
+      for (int d = 0; d < 5; ++d)
+        pts.push_back(x0.in_direction(direction(d)));
+      pts.push_back(x0.dim);
+      pts.push_back(f->vc);
+      pts.push_back(f->fc->m);
+      for (size_t i = 0; i < Nfreq; ++i) {
+        std::complex<double> v = f->dft_value(Nfreq * idx_dft + i);
+        pts.push_back(real(v));
+        pts.push_back(imag(v));
+      }
+      idx_dft++;
+    }
+  }
+  return pts;
+}
+
+/* like farfield_lowlevel, but for the near-field points pts from near_field_points */
+void dft_near2far::farfield_from_points(std::complex<double> *EH, const vec &x,
+                                        const std::vector<double> &pts) {
+  if (x.dim != D3 && x.dim != D2 && x.dim != Dcyl)
+    abort("only 2d or 3d or cylindrical far-field computation is supported");
+  greenfunc green = x.dim == D2 ? green2d : green3d;
+
+  const size_t Nfreq = freq.size();
+  for (size_t i = 0; i < 6 * Nfreq; ++i)
+    EH[i] = 0.0;
+
+  const size_t stride = 8 + 2 * Nfreq;
+  for (size_t n = 0; n + stride <= pts.size(); n += stride) {
+    const double *p = &pts[n];
+    vec x0 = vec(ndim(int(p[5])));
+    for (int d = 0; d < 5; ++d)
+      x0.set_direction(direction(d), p[d]);
+    component c0 = component(int(p[6]));
+    vec xs(x0);
+    for (int i0 = -periodic_n[0]; i0 <= periodic_n[0]; ++i0) {
+      if (periodic_d[0] != NO_DIRECTION)
+        xs.set_direction(periodic_d[0], x0.in_direction(periodic_d[0]) + i0 * period[0]);
+      double phase0 = i0 * periodic_k[0];
+      for (int i1 = -periodic_n[1]; i1 <= periodic_n[1]; ++i1) {
+        if (periodic_d[1] != NO_DIRECTION)
+          xs.set_direction(periodic_d[1], x0.in_direction(periodic_d[1]) + i1 * period[1]);
+        double phase = phase0 + i1 * periodic_k[1];
+        std::complex<double> cphase = std::polar(1.0, phase), EH6[6];
+        for (size_t i = 0; i < Nfreq; ++i) {
+          std::complex<double> f0(p[8 + 2 * i], p[9 + 2 * i]);
+          if (x.dim == Dcyl)
+            greencyl(EH6, x, freq[i], eps, mu, xs, c0, f0, p[7], 1e-3);
+          else
+            green(EH6, x, freq[i], eps, mu, xs, c0, f0);
+          for (int j = 0; j < 6; ++j)
+            EH[i * 6 + j] += EH6[j] * cphase;
+        }
+      }
+    }
+  }
+}
+
+/***************************************************************/
+/* Batched Green's functions for the direct sum over near-     */
+/* field points in get_farfields_array: the points (and their  */
+/* periodic images) are grouped by source component in         */
+/* structure-of-arrays form, and the 3d Green's functions of a */
+/* group are summed in branch-free loops over GREEN_LANES      */
+/* points at a time, which the compiler can vectorize.  In 2d, */
+/* the Hankel functions are interpolated from a table.         */
+/***************************************************************/
+
+#define GREEN_LANES 8    // number of points in each vectorized batch
+#define GREEN_MAX_KR 1e8 // maximum argument of green_sincos
+
+/* sin and cos of 0 <= x <= GREEN_MAX_KR, without branches (so that it can be
+   vectorized), with the range reduction and polynomials of the Cephes library */
+static inline void green_sincos(double x, double &s, double &c) {
+  const double magic = 6755399441055744.0; // 1.5 * 2^52, for rounding to integers
+  const double q = (x * (2 / pi) + magic) - magic;       // nearest multiple of pi/2
+  const double m = q - 4 * ((q * 0.25 + magic) - magic); // quadrant, in -2..2
+  // pi/2 = 1.5707962512969970703125 + 7.5497894158615963533e-8 + 5.390302858158119e-15
+  const double r = ((x - q * 1.5707962512969970703125) - q * 7.5497894158615963533e-8) -
+                   q * 5.390302858158119e-15;
+  const double z = r * r;
+  const double sr = r + r * z *
+                            (((((1.58962301576546568060e-10 * z - 2.50507477628578072866e-8) * z +
+                                2.75573136213857245213e-6) * z - 1.98412698295895385996e-4) * z +
+                              8.33333333332211858878e-3) * z - 1.66666666666666307295e-1);
+  const double cr = 1 - 0.5 * z + z * z *
+                                      (((((-1.13585365213876817300e-11 * z +
+                                           2.08757008419747316778e-9) * z -
+                                          2.75573141792967388112e-7) * z +
+                                         2.48015872888517045348e-5) * z -
+                                        1.38888888888730564116e-3) * z +
+                                       4.16666666666665929218e-2);
+  const bool odd = fabs(m) == 1;
+  s = odd ? cr : sr;
+  c = odd ? sr : cr;
+  s = (m < 0 || m > 1.5) ? -s : s;
+  c = (m > 0.5 || m < -1.5) ? -c : c;
+}
+
+/* Hankel functions H_n(x) = hankel(n, x) for n = 0, 1 and x >= HANKEL_TABLE_XMIN,
+   by cubic interpolation of the smooth functions g_n = sqrt(x) H_n(x) exp(-ix) on a
+   uniform grid in u = 1/x.  This covers every kr at once (and hence every
+   frequency), and the grid is refined until the interpolation error at the
+   midpoints of the grid is < 1e-11. */
+#define HANKEL_TABLE_XMIN 4.0
+class hankel_table {
+public:
+  hankel_table() {
+    for (n = 256;; n *= 2) {
+      h = 1 / (HANKEL_TABLE_XMIN * n);
+      for (int k = 0; k < 2; ++k) {
+        g[k].resize(n + 3);
+        g[k][0] = std::polar(sqrt(2 / pi), -(k * 0.5 + 0.25) * pi); // x -> infinity
+        for (size_t i = 1; i < n + 3; ++i)
+          g[k][i] = exact(k, 1 / (i * h));
+      }
+      double err = 0;
+      for (size_t i = 0; i < n; ++i) {
+        const double x = 1 / ((i + 0.5) * h);
+        std::complex<double> gi[2];
+        interpolate(x, gi);
+        for (int k = 0; k < 2; ++k)
+          err = std::max(err, abs(gi[k] - exact(k, x)));
+      }
+      if (err < 1e-11 || n >= (1 << 20)) break;
+    }
+  }
+
+  void operator()(double x, std::complex<double> H[2]) const {
+    interpolate(x, H);
+    double s, c;
+    green_sincos(x, s, c);
+    for (int k = 0; k < 2; ++k)
+      H[k] *= std::complex<double>(c, s) / sqrt(x);
+  }
+
+private:
+  size_t n;                            // number of grid intervals
+  double h;                            // grid spacing in u
+  std::vector<std::complex<double> > g[2]; // g_n at u = 0, h, ..., (n + 2) h
+
+  static std::complex<double> exact(int k, double x) {
+    return sqrt(x) * hankel(k, x) * std::polar(1.0, -x);
+  }
+  void interpolate(double x, std::complex<double> gi[2]) const {
+    const double t = 1 / (x * h);
+    const size_t i = size_t(std::min(std::max(t - 1, 0.0), double(n - 1)));
+    const double s = t - i; // 4-point Lagrange interpolation at nodes i..i+3
+    const double w[4] = {-(s - 1) * (s - 2) * (s - 3) / 6, s * (s - 2) * (s - 3) / 2,
+                         -s * (s - 1) * (s - 3) / 2, s * (s - 1) * (s - 2) / 6};
+    for (int k = 0; k < 2; ++k)
+      gi[k] = w[0] * g[k][i] + w[1] * g[k][i + 1] + w[2] * g[k][i + 2] + w[3] * g[k][i + 3];
+  }
+};
+
+static const hankel_table &get_hankel_table() {
+  static const hankel_table table; // built on first use (thread-safe)
+  return table;
+}
+
+/* the near-field points of one source component, in structure-of-arrays form */
+struct green_group {
+  component c0;
+  size_t n;                 // number of points (the arrays are padded to GREEN_LANES)
+  std::vector<double> x[3]; // coordinates (x, y, z) of the points
+  std::vector<double> fr, fi; // source amplitudes, Nfreq x (padded number of points)
+};
+
+/* group the near-field points pts of near_field_points (including their periodic
+   images) by component, and set rmax to the maximum distance of a point from the
+   origin; returns false if there are cylindrical points (for greencyl) */
+static bool green_groups(std::vector<green_group> &groups, double &rmax, const dft_near2far &n2f,
+                         const std::vector<double> &pts) {
+  const size_t Nfreq = n2f.freq.size(), stride = 8 + 2 * Nfreq;
+  int group_of[NUM_FIELD_COMPONENTS];
+  for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c)
+    group_of[c] = -1;
+  std::vector<std::vector<std::complex<double> > > f0; // point-major amplitudes of each group
+  groups.clear();
+  rmax = 0;
+  for (size_t n = 0; n + stride <= pts.size(); n += stride) {
+    const double *p = &pts[n];
+    if (ndim(int(p[5])) == Dcyl) return false;
+    const component c0 = component(int(p[6]));
+    if (group_of[c0] < 0) {
+      group_of[c0] = groups.size();
+      groups.push_back(green_group());
+      groups.back().c0 = c0;
+      f0.push_back(std::vector<std::complex<double> >());
+    }
+    green_group &g = groups[group_of[c0]];
+    for (int i0 = -n2f.periodic_n[0]; i0 <= n2f.periodic_n[0]; ++i0)
+      for (int i1 = -n2f.periodic_n[1]; i1 <= n2f.periodic_n[1]; ++i1) {
+        double xs[5] = {p[0], p[1], p[2], p[3], p[4]};
+        if (n2f.periodic_d[0] != NO_DIRECTION) xs[n2f.periodic_d[0]] += i0 * n2f.period[0];
+        if (n2f.periodic_d[1] != NO_DIRECTION) xs[n2f.periodic_d[1]] += i1 * n2f.period[1];
+        for (int d = 0; d < 3; ++d)
+          g.x[d].push_back(xs[d]);
+        rmax = std::max(rmax, sqrt(xs[0] * xs[0] + xs[1] * xs[1] + xs[2] * xs[2]));
+        const std::complex<double> cphase =
+            std::polar(1.0, i0 * n2f.periodic_k[0] + i1 * n2f.periodic_k[1]);
+        for (size_t i = 0; i < Nfreq; ++i)
+          f0[group_of[c0]].push_back(std::complex<double>(p[8 + 2 * i], p[9 + 2 * i]) * cphase);
+      }
+  }
+  for (size_t ig = 0; ig < groups.size(); ++ig) {
+    green_group &g = groups[ig];
+    g.n = g.x[0].size();
+    const size_t npad = (g.n + GREEN_LANES - 1) / GREEN_LANES * GREEN_LANES;
+    for (int d = 0; d < 3; ++d) // zero-amplitude copies of the first point
+      g.x[d].resize(npad, g.x[d][0]);
+    g.fr.resize(Nfreq * npad, 0.0);
+    g.fi.resize(Nfreq * npad, 0.0);
+    for (size_t j = 0; j < g.n; ++j)
+      for (size_t i = 0; i < Nfreq; ++i) {
+        g.fr[i * npad + j] = real(f0[ig][j * Nfreq + i]);
+        g.fi[i * npad + j] = imag(f0[ig][j * Nfreq + i]);
+      }
+  }
+  return true;
+}
+
+/* add the 3d fields EH[6] at x of the points of g at frequency index i (as in green3d) */
+static void green3d_group(std::complex<double> *EH, const double x[3], double freq, double eps,
+                          double mu, const green_group &g, size_t i) {
+  const size_t npad = g.x[0].size();
+  const double n = sqrt(eps * mu), k = 2 * pi * freq * n, Z = sqrt(mu / eps);
+  const bool electric = is_electric(g.c0);
+  const double a0 = k * n / (4 * pi) / (electric ? eps : mu);
+  double p[3] = {0, 0, 0};
+  p[component_direction(g.c0)] = 1;
+  const double *xs = g.x[0].data(), *ys = g.x[1].data(), *zs = g.x[2].data();
+  const double *fr = &g.fr[i * npad], *fi = &g.fi[i * npad];
+
+  /* the sums of expfac * (term1 * p + term2 * rhat) and of expfac * term3 * (rhat x p),
+     in the notation of green3d (real and imaginary parts), for each lane */
+  double acc[12][GREEN_LANES];
+  for (int m = 0; m < 12; ++m)
+    for (int l = 0; l < GREEN_LANES; ++l)
+      acc[m][l] = 0;
+  for (size_t j0 = 0; j0 < npad; j0 += GREEN_LANES) {
+    /* the distances are computed in a separate loop, since sqrt (which may set
+       errno) prevents the vectorization of the loop that contains it */
+    double r[GREEN_LANES];
+    for (int l = 0; l < GREEN_LANES; ++l) {
+      const size_t j = j0 + l;
+      const double dx = x[0] - xs[j], dy = x[1] - ys[j], dz = x[2] - zs[j];
+      r[l] = dx * dx + dy * dy + dz * dz;
+    }
+    for (int l = 0; l < GREEN_LANES; ++l)
+      r[l] = sqrt(r[l]);
+    for (int l = 0; l < GREEN_LANES; ++l) {
+      const size_t j = j0 + l;
+      const double dx = x[0] - xs[j], dy = x[1] - ys[j], dz = x[2] - zs[j];
+      const double ir = 1 / r[l];
+      const double rhat[3] = {dx * ir, dy * ir, dz * ir};
+      const double kr = k * r[l], q = 1 / kr;
+      double s, c;
+      green_sincos(kr, s, c);
+      const double a = a0 * ir;
+      const double er = -a * (s * fr[j] + c * fi[j]), ei = a * (c * fr[j] - s * fi[j]);
+      const double pdotrhat = p[0] * rhat[0] + p[1] * rhat[1] + p[2] * rhat[2];
+      const double t1r = 1 - q * q, t1i = q;
+      const double t2r = (3 * q * q - 1) * pdotrhat, t2i = -3 * q * pdotrhat;
+      const double e3r = er - ei * q, e3i = ei + er * q;
+      const double rhatcrossp[3] = {rhat[1] * p[2] - rhat[2] * p[1],
+                                    rhat[2] * p[0] - rhat[0] * p[2],
+                                    rhat[0] * p[1] - rhat[1] * p[0]};
+      for (int d = 0; d < 3; ++d) {
+        const double cr = t1r * p[d] + t2r * rhat[d], ci = t1i * p[d] + t2i * rhat[d];
+        acc[2 * d][l] += er * cr - ei * ci;
+        acc[2 * d + 1][l] += er * ci + ei * cr;
+        acc[6 + 2 * d][l] += e3r * rhatcrossp[d];
+        acc[7 + 2 * d][l] += e3i * rhatcrossp[d];
+      }
+    }
+  }
+
+  std::complex<double> A[3], B[3];
+  for (int d = 0; d < 3; ++d) {
+    double sum[4] = {0, 0, 0, 0};
+    for (int l = 0; l < GREEN_LANES; ++l) {
+      sum[0] += acc[2 * d][l];
+      sum[1] += acc[2 * d + 1][l];
+      sum[2] += acc[6 + 2 * d][l];
+      sum[3] += acc[7 + 2 * d][l];
+    }
+    A[d] = std::complex<double>(sum[0], sum[1]);
+    B[d] = std::complex<double>(sum[2], sum[3]);
+  }
+  for (int d = 0; d < 3; ++d) {
+    EH[d] += electric ? A[d] : -B[d] * Z;
+    EH[3 + d] += electric ? B[d] / Z : A[d];
+  }
+}
+
+/* add the 2d fields EH[6] at x of the points of g at frequency index i (as in green2d) */
+static void green2d_group(std::complex<double> *EH, const double x[3], double freq, double eps,
+                          double mu, const green_group &g, size_t i) {
+  const size_t npad = g.x[0].size();
+  const double omega = 2 * pi * freq, k = omega * sqrt(eps * mu);
+  const hankel_table &hankel_interp = get_hankel_table();
+  for (size_t j = 0; j < g.n; ++j) {
+    const double dx = x[0] - g.x[0][j], dy = x[1] - g.x[1][j];
+    const double r = sqrt(dx * dx + dy * dy), kr = k * r;
+    std::complex<double> H[2], EH6[6];
+    if (kr >= HANKEL_TABLE_XMIN)
+      hankel_interp(kr, H);
+    else
+      for (int n = 0; n < 2; ++n)
+        H[n] = hankel(n, kr);
+    const std::complex<double> f0(g.fr[i * npad + j], g.fi[i * npad + j]);
+    green2d_hankel(EH6, vec(dx / r, dy / r), r, omega, eps, mu, g.c0, H[0] * f0, H[1] * f0);
+    for (int m = 0; m < 6; ++m)
+      EH[m] += EH6[m];
+  }
+}
+
+/* like farfield_from_points, but for the groups of green_groups; returns false
+   (leaving EH unchanged) if x is too far away for green_sincos */
+static bool farfield_from_groups(std::complex<double> *EH, const vec &x, const dft_near2far &n2f,
+                                 const std::vector<green_group> &groups, double rmax) {
+  const size_t Nfreq = n2f.freq.size();
+  const double fmax = *std::max_element(n2f.freq.begin(), n2f.freq.end());
+  const double xs[3] = {x.in_direction(X), x.in_direction(Y), x.in_direction(Z)};
+  if (2 * pi * fmax * sqrt(n2f.eps * n2f.mu) * (abs(x) + rmax) > GREEN_MAX_KR) return false;
+  for (size_t i = 0; i < 6 * Nfreq; ++i)
+    EH[i] = 0.0;
+  for (size_t ig = 0; ig < groups.size(); ++ig)
+    for (size_t i = 0; i < Nfreq; ++i)
+      (x.dim == D2 ? green2d_group : green3d_group)(EH + 6 * i, xs, n2f.freq[i], n2f.eps, n2f.mu,
+                                                     groups[ig], i);
+  return true;
+}
+
 double *dft_near2far::get_farfields_array(const volume &where, int &rank, size_t *dims, size_t &N,
-                                          double resolution) {
+                                          double resolution, bool master_only) {
   /* compute output grid size etc. */
   double dx[3] = {0, 0, 0};
   direction dirs[3] = {X, Y, Z};
@@ -423,42 +1288,105 @@ double *dft_near2far::get_farfields_array(const volume &where, int &rank, size_t
 
   /* 6 x 2 x N x Nfreq array of fields in row-major order */
   double *EH = new double[6 * 2 * N * Nfreq];
-  double *EH_ = new double[6 * 2 * N * Nfreq]; // temp array for sum_to_all
-
-  /* fields for farfield_lowlevel for a single output point x */
-  std::complex<double> *EH1 = new std::complex<double>[6 * Nfreq];
-
-  double start = wall_time();
-  size_t last_point = 0;
-
-  vec x(where.dim);
-  for (size_t i0 = 0; i0 < dims[0]; ++i0) {
-    x.set_direction(dirs[0], where.in_direction_min(dirs[0]) + i0 * dx[0]);
-    for (size_t i1 = 0; i1 < dims[1]; ++i1) {
-      x.set_direction(dirs[1], where.in_direction_min(dirs[1]) + i1 * dx[1]);
-      for (size_t i2 = 0; i2 < dims[2]; ++i2) {
-        x.set_direction(dirs[2], where.in_direction_min(dirs[2]) + i2 * dx[2]);
-        double t;
-        if (verbosity > 0 && (t = wall_time()) > start + MEEP_MIN_OUTPUT_TIME) {
-          size_t this_point = (dims[1] * i0 + i1) * dims[2] + i2 + 1;
-          master_printf("get_farfields_array working on point %zu of %zu (%d%% done), %g s/point\n",
-                        this_point, N, (int)((double)this_point / N * 100),
-                        (t - start) / (std::max(1, (int)(this_point - last_point))));
-          start = t;
-          last_point = this_point;
+
+  if (farfields_fft(EH, where, dims, dirs, dx))
+    array_to_all(EH, 6 * 2 * N * Nfreq); // sum the fields of each process's near-field points
+  else {
+    /* every process computes the far fields at its own slab of the far-field
+       points, from the plane-wave amplitudes of all of the near-field points (for
+       lattice sums), or from the near-field points themselves, which each process
+       broadcasts in turn in blocks of at most near_block doubles, so that no
+       process needs memory for more than its own points and one block */
+    const int nprocs = count_processors();
+    const size_t start = N * my_rank() / nprocs, end = N * (my_rank() + 1) / nprocs;
+    for (int k = 0; k < 12; ++k)
+      memset(EH + (k * N + start) * Nfreq, 0, (end - start) * Nfreq * sizeof(double));
+
+    const size_t stride = 8 + 2 * Nfreq;
+    const size_t near_block = std::max(size_t(1), (size_t(1) << 20) / stride) * stride;
+    std::vector<double> mine = near_field_points();
+    lattice_sum_fields *lattice = NULL;
+    size_t nblocks = 1;
+    std::vector<size_t> counts(nprocs, 0); // the number of doubles of the points of each process
+    if (lattice_sum) {
+      lattice = new lattice_sum_fields(*this, mine, where, true);
+      mine.clear();
+      counts[0] = 1; // (a single pass over the far-field points)
+    }
+    else {
+      counts[my_rank()] = mine.size();
+      std::vector<size_t> all(nprocs);
+      sum_to_all(counts.data(), all.data(), nprocs);
+      counts.swap(all);
+      nblocks = 0;
+      for (int root = 0; root < nprocs; ++root)
+        nblocks += (counts[root] + near_block - 1) / near_block;
+    }
+
+    double t0 = wall_time(), tlast = t0;
+    size_t iblock = 0;
+    std::vector<double> pts;
+    std::vector<green_group> groups;
+    for (int root = 0; root < nprocs; ++root)
+      for (size_t b0 = 0; b0 < counts[root]; b0 += near_block, ++iblock) {
+        double rmax = 0;
+        bool batched = false;
+        if (!lattice) {
+          const size_t len = std::min(near_block, counts[root] - b0);
+          if (my_rank() == root)
+            pts.assign(mine.begin() + b0, mine.begin() + b0 + len);
+          else
+            pts.resize(len);
+          broadcast(root, pts.data(), int(len));
+          batched = (where.dim == D2 || where.dim == D3) && green_groups(groups, rmax, *this, pts);
         }
-        farfield_lowlevel(EH1, x);
-        if (verbosity > 1) all_wait(); // Allow consistent progress updates from master
-        ptrdiff_t idx = (i0 * dims[1] + i1) * dims[2] + i2;
-        for (size_t i = 0; i < Nfreq; ++i)
-          for (int k = 0; k < 6; ++k) {
-            EH_[((k * 2 + 0) * N + idx) * Nfreq + i] = real(EH1[i * 6 + k]);
-            EH_[((k * 2 + 1) * N + idx) * Nfreq + i] = imag(EH1[i * 6 + k]);
+
+        const size_t block = 256; // points between progress updates
+        for (size_t b = start; b < end; b += block) {
+          const size_t bend = std::min(end, b + block);
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+          for (size_t idx = b; idx < bend; ++idx) {
+            const size_t ir[3] = {idx / (dims[1] * dims[2]), (idx / dims[2]) % dims[1],
+                                  idx % dims[2]};
+            vec x(where.dim);
+            for (int r = 0; r < 3; ++r)
+              x.set_direction(dirs[r], where.in_direction_min(dirs[r]) + ir[r] * dx[r]);
+            std::vector<std::complex<double> > EH1(6 * Nfreq);
+            if (lattice)
+              lattice->fields(EH1.data(), x);
+            else if (!batched || !farfield_from_groups(EH1.data(), x, *this, groups, rmax))
+              farfield_from_points(EH1.data(), x, pts);
+            for (size_t i = 0; i < Nfreq; ++i)
+              for (int k = 0; k < 6; ++k) {
+                EH[((k * 2 + 0) * N + idx) * Nfreq + i] += real(EH1[i * 6 + k]);
+                EH[((k * 2 + 1) * N + idx) * Nfreq + i] += imag(EH1[i * 6 + k]);
+              }
           }
+          double t;
+          if (verbosity > 0 && (t = wall_time()) > tlast + MEEP_MIN_OUTPUT_TIME) {
+            const double done = (iblock + (bend - start) / double(end - start)) / nblocks;
+            master_printf("get_farfields_array working on block %zu of %zu of near-field points, "
+                          "point %zu of %zu (%d%% done), %g s/point\n",
+                          iblock + 1, nblocks, bend - start, end - start, (int)(done * 100),
+                          (t - t0) / (done * (end - start)));
+            tlast = t;
+          }
+        }
       }
-    }
+
+    /* the slabs of all processes, i.e. the boxes {0..11} x {start..end-1} x {0..Nfreq-1} */
+    const size_t EHdims[3] = {12, N, Nfreq};
+    std::vector<array_box> box(1);
+    box[0].start[0] = box[0].start[2] = 0;
+    box[0].start[1] = start;
+    box[0].count[0] = 12;
+    box[0].count[1] = end - start;
+    box[0].count[2] = Nfreq;
+    gather_array_boxes(EH, EHdims, 1, box, !master_only);
+    delete lattice;
   }
-  sum_to_all(EH_, EH, 6 * 2 * N * Nfreq);
 
   /* collapse singleton dimensions */
   int ireduced = 0;
@@ -467,8 +1395,6 @@ double *dft_near2far::get_farfields_array(const volume &where, int &rank, size_t
   }
   rank = ireduced;
 
-  delete[] EH_;
-  delete[] EH1;
   return EH;
 }
 
@@ -478,7 +1404,7 @@ void dft_near2far::save_farfields(const char *fname, const char *prefix, const v
   int rank = 0;
   size_t N = 1;
 
-  double *EH = get_farfields_array(where, rank, dims, N, resolution);
+  double *EH = get_farfields_array(where, rank, dims, N, resolution, true /* master_only */);
   if (!EH) return; /* nothing to output */
 
   const size_t Nfreq = freq.size();
@@ -645,11 +1571,13 @@ std::vector<struct sourcedata> dft_near2far::near_sourcedata(const vec &x_0, dou
   if (x_0.dim != D3 && x_0.dim != D2 && x_0.dim != Dcyl)
     abort("only 2d or 3d or cylindrical far-field computation is supported");
   greenfunc green = x_0.dim == D2 ? green2d : green3d;
+  flush_dfts(F);
 
   const size_t Nfreq = freq.size();
   std::vector<struct sourcedata> temp;
 
   for (dft_chunk *f = F; f; f = f->next_in_dft) {
+    if (!f->fc) continue; // an anchor of the list (see fields::dft_anchors)
     assert(Nfreq == f->omega.size());
     std::vector<ptrdiff_t> idx_arr;
     std::vector<std::complex<double> > amp_arr;
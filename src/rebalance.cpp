@@ -0,0 +1,457 @@
+/* Copyright (C) 2005-2021 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Dynamic load balancing during a run: the chunks are reassigned to
+   the processes according to the wall time that was actually measured
+   for timestepping each chunk (fields_chunk::step_time), and the
+   structure, fields, polarization, and DFT data of every chunk that
+   changes owner is sent to its new process.  The chunk geometry itself is not
+   changed, so this is only useful if there are more chunks than
+   processes (e.g. num_chunks = several times the number of processes). */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <vector>
+
+#include "meep.hpp"
+#include "meep_internals.hpp"
+
+using namespace std;
+
+namespace meep {
+
+/* The data of a chunk as a flat array of doubles.  The same code walks
+   the chunk data for packing and for unpacking, so that the two always
+   agree on the layout.  Packing moves the data into the buffer (every
+   packed array is deallocated), and unpacking allocates the arrays
+   again on the new owner. */
+class chunk_buffer {
+public:
+  chunk_buffer(bool unpacking) : unpacking(unpacking), pos(0) {}
+
+  bool unpacking;
+  std::vector<double> data;
+
+  void scalar(double &x) {
+    if (unpacking)
+      x = data[pos++];
+    else
+      data.push_back(x);
+  }
+  void scalar(std::complex<double> &z) {
+    double re = real(z), im = imag(z);
+    scalar(re);
+    scalar(im);
+    z = std::complex<double>(re, im);
+  }
+  template <class T> void number(T &i) { // an integer
+    double x = i;
+    scalar(x);
+    i = T(x);
+  }
+  void flag(bool &b) {
+    double x = b;
+    scalar(x);
+    b = x != 0;
+  }
+  template <class T> void values(T *a, size_t n) { // an existing array of n values
+    double nd = n;
+    scalar(nd);
+    if (size_t(nd) != n)
+      abort("bug: mismatched array size %zd vs. %zd in chunk_buffer", size_t(nd), n);
+    if (unpacking)
+      for (size_t i = 0; i < n; ++i)
+        a[i] = T(data[pos++]);
+    else
+      data.insert(data.end(), a, a + n);
+  }
+  template <class T> void values(std::complex<T> *a, size_t n) {
+    values(reinterpret_cast<T *>(a), 2 * n);
+  }
+  template <class T> void array(T *&a, size_t n) { // an array of n values that may be NULL
+    bool have = a != NULL;
+    flag(have);
+    if (!have) return;
+    if (unpacking) a = new T[n];
+    values(a, n);
+    if (!unpacking) {
+      delete[] a;
+      a = NULL;
+    }
+  }
+  template <class T> void vector(std::vector<T> &v) { // resized when unpacking
+    double n = v.size();
+    scalar(n);
+    if (unpacking) v.resize(size_t(n));
+    values(v.data(), v.size());
+  }
+  void point(ivec &v) {
+    int dim = v.dim;
+    number(dim);
+    if (unpacking) v = ivec(ndim(dim));
+    FOR_DIRECTIONS(d) {
+      int x = v.in_direction(d);
+      number(x);
+      v.set_direction(d, x);
+    }
+  }
+  void point(vec &v) {
+    int dim = v.dim;
+    number(dim);
+    if (unpacking) v = vec(ndim(dim));
+    FOR_DIRECTIONS(d) {
+      double x = v.in_direction(d);
+      scalar(x);
+      v.set_direction(d, x);
+    }
+  }
+
+private:
+  size_t pos;
+};
+
+static void move_structure_chunk(structure_chunk *s, chunk_buffer &b) {
+  const size_t ntot = s->gv.ntot();
+  FOR_COMPONENTS(c) {
+    b.array(s->chi3[c], ntot);
+    b.array(s->chi2[c], ntot);
+    FOR_DIRECTIONS(d) {
+      b.flag(s->trivial_chi1inv[c][d]);
+      b.array(s->chi1inv[c][d], ntot);
+      b.array(s->conductivity[c][d], ntot);
+      delete[] s->condinv[c][d]; // recomputed by update_condinv on the new owner
+      s->condinv[c][d] = NULL;
+    }
+  }
+  s->condinv_stale = true;
+  for (int d = 0; d < 6; ++d) {
+    double sigsize = s->sigsize[d];
+    b.scalar(sigsize);
+    b.array(s->sig[d], size_t(sigsize));
+    b.array(s->kap[d], size_t(sigsize));
+    b.array(s->siginv[d], size_t(sigsize));
+    s->sigsize[d] = b.unpacking ? int(sigsize) : 0;
+  }
+  FOR_FIELD_TYPES(ft) {
+    for (susceptibility *chiP = s->chiP[ft]; chiP; chiP = chiP->next)
+      FOR_COMPONENTS(c) FOR_DIRECTIONS(d) { b.array(chiP->sigma[c][d], chiP->ntot); }
+  }
+}
+
+static void move_fields_chunk(fields_chunk *fc, chunk_buffer &b) {
+  const size_t ntot = fc->gv.ntot();
+
+  // for mu=1 non-PML regions, H==B: only move the array once
+  bool H_is_B[NUM_FIELD_COMPONENTS][2];
+  FOR_H_AND_B(hc, bc) DOCMP2 {
+    H_is_B[hc][cmp] = fc->f[hc][cmp] && fc->f[hc][cmp] == fc->f[bc][cmp];
+    b.flag(H_is_B[hc][cmp]);
+    if (H_is_B[hc][cmp]) fc->f[hc][cmp] = NULL;
+  }
+  FOR_COMPONENTS(c) DOCMP2 {
+    b.array(fc->f[c][cmp], ntot);
+    b.array(fc->f_u[c][cmp], ntot);
+    b.array(fc->f_w[c][cmp], ntot);
+    b.array(fc->f_cond[c][cmp], ntot);
+    b.array(fc->f_minus_p[c][cmp], ntot);
+    b.array(fc->f_w_prev[c][cmp], ntot);
+  }
+  FOR_H_AND_B(hc, bc) DOCMP2 {
+    if (H_is_B[hc][cmp]) fc->f[hc][cmp] = fc->f[bc][cmp];
+  }
+  delete[] fc->f_rderiv_int; // cache, recomputed on each step
+  fc->f_rderiv_int = NULL;
+  FOR_FIELD_TYPES(ft) { // recomputed by find_metals on the new owner
+    delete[] fc->zeroes[ft];
+    fc->zeroes[ft] = NULL;
+    fc->num_zeroes[ft] = 0;
+  }
+
+  // internal polarization data (which needs the fields above to be allocated)
+  FOR_FIELD_TYPES(ft) {
+    for (polarization_state *p = fc->pol[ft]; p; p = p->next) {
+      bool have = p->data != NULL;
+      b.flag(have);
+      if (!have) continue;
+      if (b.unpacking) {
+        p->data = p->s->new_internal_data(fc->f, fc->gv);
+        p->s->init_internal_data(fc->f, fc->dt, fc->gv, p->data);
+      }
+      size_t n;
+      realnum *vals = p->s->internal_data_values(p->data, &n);
+      b.values(vals, n);
+      if (!b.unpacking) {
+        p->s->delete_internal_data(p->data);
+        p->data = NULL;
+      }
+    }
+  }
+}
+
+static void move_dft_chunk(dft_chunk *dc, chunk_buffer &b) {
+  b.number(dc->N);
+  const size_t n = dc->N * dc->omega.size();
+  b.array(dc->dft, n);
+  b.array(dc->dft_single, n);
+  b.scalar(dc->stored_weight);
+  b.flag(dc->include_dV_and_interp_weights);
+  b.flag(dc->sqrt_dV_and_interp_weights);
+  b.scalar(dc->extra_weight);
+  b.point(dc->is);
+  b.point(dc->ie);
+  b.point(dc->s0);
+  b.point(dc->s1);
+  b.point(dc->e0);
+  b.point(dc->e1);
+  b.scalar(dc->dV0);
+  b.scalar(dc->dV1);
+  for (int i = 0; i < 5; ++i)
+    b.flag(dc->empty_dim[i]);
+  b.scalar(dc->scale);
+  b.point(dc->shift);
+  b.number(dc->sn);
+  b.array(dc->dft_phase, dc->omega.size());
+  b.vector(dc->dft_phase_step);
+  b.scalar(dc->dft_phase_time);
+  b.number(dc->dft_phase_age);
+  b.number(dc->avg1);
+  b.number(dc->avg2);
+  b.vector(dc->weight);
+  b.vector(dc->index);
+  b.number(dc->vc);
+  b.number(dc->decimation_factor);
+  b.point(dc->stride);
+
+  // any timesteps buffered for the next flush_dft, as in fields::dump
+  b.number(dc->batch_size);
+  b.number(dc->nbatched);
+  b.number(dc->batch_numcmp);
+  b.flag(dc->time_series);
+  b.scalar(dc->batch_time0);
+  b.vector(dc->batch_fields);
+  b.vector(dc->batch_phase);
+  b.vector(dc->batch_rescale);
+}
+
+/* whether a comes before b in a list of fields::add_dft, which prepends the
+   chunks in the order of loop_in_chunks: by symmetry transformation, lattice
+   shift (with the first direction varying fastest), and chunk */
+static bool dft_chunk_before(const dft_chunk *a, const dft_chunk *b) {
+  if (a->sn != b->sn) return a->sn > b->sn;
+  for (int d = 4; d >= 0; --d)
+    if (a->shift.in_direction(direction(d)) != b->shift.in_direction(direction(d)))
+      return a->shift.in_direction(direction(d)) > b->shift.in_direction(direction(d));
+  return a->fc->chunk_idx > b->fc->chunk_idx;
+}
+
+static dft_chunk *find_dft_anchor(dft_chunk *anchors, int list_id) {
+  for (dft_chunk *a = anchors; a; a = a->next_in_chunk)
+    if (a->list_id == list_id) return a;
+  abort("bug: missing DFT list %d in move_chunk", list_id);
+}
+
+/* The DFT chunks of fc are removed from the lists of add_dft on the old
+   owner, and inserted on the new owner where add_dft would have put them
+   (after the anchor of their list, see fields::dft_anchors), so that lists
+   that are combined chunk by chunk (e.g. the E and H lists of a dft_flux)
+   stay aligned. */
+static void move_dft_chunks(fields_chunk *fc, dft_chunk *anchors, const symmetry &S,
+                            chunk_buffer &b) {
+  size_t ndft = 0;
+  for (dft_chunk *dc = fc->dft_chunks; dc; dc = dc->next_in_chunk)
+    ++ndft;
+  b.number(ndft);
+  dft_chunk **tail = &fc->dft_chunks; // keep the order of fc->dft_chunks
+  for (size_t k = 0; k < ndft; ++k) {
+    dft_chunk *dc = b.unpacking ? NULL : fc->dft_chunks;
+    int list_id = dc ? dc->list_id : 0, c = dc ? dc->c : 0;
+    std::vector<double> omega;
+    if (dc) omega = dc->omega;
+    b.number(list_id);
+    b.number(c);
+    b.vector(omega);
+    dft_chunk *prev = find_dft_anchor(anchors, list_id);
+    if (b.unpacking) {
+      dc = new dft_chunk(component(c), omega, list_id);
+      dc->fc = fc;
+      dc->S = S;
+      *tail = dc;
+      tail = &dc->next_in_chunk;
+      move_dft_chunk(dc, b);
+      while (prev->next_in_dft && prev->next_in_dft->fc && dft_chunk_before(prev->next_in_dft, dc))
+        prev = prev->next_in_dft;
+      dc->next_in_dft = prev->next_in_dft;
+      prev->next_in_dft = dc;
+    }
+    else {
+      while (prev->next_in_dft && prev->next_in_dft != dc)
+        prev = prev->next_in_dft;
+      if (!prev->next_in_dft) abort("bug: DFT chunk not in its list in move_chunk");
+      prev->next_in_dft = dc->next_in_dft;
+      move_dft_chunk(dc, b);
+      delete dc; // also removes it from fc->dft_chunks
+    }
+  }
+}
+
+// send a buffer of arbitrary length, in pieces that fit in an int
+static void send_buffer(int from, int to, std::vector<double> &data) {
+  double n = data.size();
+  send(from, to, &n);
+  data.resize(size_t(n));
+  const size_t maxsend = INT_MAX / 2;
+  for (size_t start = 0; start < data.size(); start += maxsend)
+    send(from, to, &data[start], int(std::min(maxsend, data.size() - start)));
+}
+
+/* Move chunk i (with all of its data, including its DFT chunks) to
+   process proc.  This must be called from all processes, since every
+   process must know the owner of every chunk, but only the old and new
+   owners communicate.  Chunks holding sources cannot be moved. */
+void fields::move_chunk(int i, int proc) {
+  fields_chunk *fc = chunks[i];
+  const int from = fc->n_proc();
+  if (from == proc) return;
+
+  // copy-on-write, as for any other modification of the structure chunk,
+  // unless the structure is supposed to see the same chunks as the fields
+  if (!shared_chunks) fc->changing_structure();
+
+  if (my_rank() == from) {
+    FOR_FIELD_TYPES(ft) {
+      if (fc->sources[ft]) abort("cannot move chunk %d, which holds sources", i);
+    }
+    chunk_buffer b(false);
+    move_structure_chunk(fc->s, b);
+    move_fields_chunk(fc, b);
+    move_dft_chunks(fc, dft_anchors, S, b);
+    send_buffer(from, proc, b.data);
+  }
+  fc->s->set_n_proc(proc);
+  if (my_rank() == proc) {
+    chunk_buffer b(true);
+    send_buffer(from, proc, b.data);
+    move_structure_chunk(fc->s, b);
+    move_fields_chunk(fc, b);
+    move_dft_chunks(fc, dft_anchors, S, b);
+    fc->figure_out_step_plan();
+  }
+  chunk_connections_valid = false;
+}
+
+/* Reassign the chunks to the processes based on the measured time
+   spent timestepping each chunk, if the most heavily loaded process
+   takes more than (1 + tolerance) times the mean time.  Returns true
+   if any chunks were moved.
+
+   The new assignment is greedy: chunks (in order of decreasing cost)
+   stay where they are as long as their process is not overloaded, and
+   the remaining chunks go to a process with room for them, preferring
+   a process that owns neighboring chunks so that the halo communication
+   stays local.  Chunks holding sources are never moved, since the sources
+   are not the same on every process. */
+bool fields::rebalance_chunks(double tolerance) {
+  const int nprocs = count_processors();
+  if (nprocs == 1 || num_chunks < 2) return false;
+  if (is_phasing() || synchronized_magnetic_fields)
+    abort("cannot rebalance chunks while phasing in materials or with synchronized fields");
+
+  std::vector<double> cost = time_spent_on_chunks();
+
+  std::vector<int> pinned_mine(num_chunks), pinned(num_chunks);
+  for (int i = 0; i < num_chunks; ++i) {
+    pinned_mine[i] = 0;
+    FOR_FIELD_TYPES(ft) {
+      if (chunks[i]->is_mine() && chunks[i]->sources[ft]) pinned_mine[i] = 1;
+    }
+  }
+  am_now_working_on(MpiAllTime);
+  or_to_all(&pinned_mine[0], &pinned[0], num_chunks);
+  finished_working();
+
+  std::vector<double> load(nprocs, 0.0);
+  double total = 0, maxcost = 0;
+  for (int i = 0; i < num_chunks; ++i) {
+    load[chunks[i]->n_proc()] += cost[i];
+    total += cost[i];
+    maxcost = std::max(maxcost, cost[i]);
+  }
+  const double mean = total / nprocs;
+  const double maxload = *std::max_element(load.begin(), load.end());
+  if (total <= 0 || maxload <= (1 + tolerance) * mean) return false;
+  const double target = std::max(mean * (1 + 0.5 * tolerance), maxcost);
+
+  std::vector<int> owner(num_chunks, -1);
+  std::vector<double> new_load(nprocs, 0.0);
+  std::vector<int> order;
+  for (int i = 0; i < num_chunks; ++i) {
+    if (pinned[i]) {
+      owner[i] = chunks[i]->n_proc();
+      new_load[owner[i]] += cost[i];
+    }
+    else
+      order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&cost](int i, int j) { return cost[i] > cost[j]; });
+
+  std::vector<int> unassigned;
+  for (int i : order) {
+    const int p = chunks[i]->n_proc();
+    if (new_load[p] + cost[i] <= target) {
+      owner[i] = p;
+      new_load[p] += cost[i];
+    }
+    else
+      unassigned.push_back(i);
+  }
+  for (int i : unassigned) {
+    std::vector<double> area(nprocs, 0.0);
+    for (int j = 0; j < num_chunks; ++j)
+      if (owner[j] >= 0) area[owner[j]] += shared_face_area(chunks[i]->gv, chunks[j]->gv);
+    int best = -1;
+    for (int p = 0; p < nprocs; ++p)
+      if (new_load[p] + cost[i] <= target &&
+          (best < 0 || area[p] > area[best] ||
+           (area[p] == area[best] && new_load[p] < new_load[best])))
+        best = p;
+    if (best < 0) best = std::min_element(new_load.begin(), new_load.end()) - new_load.begin();
+    owner[i] = best;
+    new_load[best] += cost[i];
+  }
+
+  const double new_maxload = *std::max_element(new_load.begin(), new_load.end());
+  if (maxload - new_maxload < tolerance * mean) return false;
+
+  int num_moved = 0;
+  for (int i = 0; i < num_chunks; ++i)
+    if (owner[i] != chunks[i]->n_proc()) {
+      move_chunk(i, owner[i]);
+      num_moved++;
+    }
+  for (int i = 0; i < num_chunks; ++i)
+    chunks[i]->step_time = 0;
+
+  if (verbosity > 0)
+    master_printf("Rebalanced chunks: moved %d of %d chunks, maximum time per process %g -> %g s "
+                  "(mean %g s)\n",
+                  num_moved, num_chunks, maxload, new_maxload, mean);
+  return true;
+}
+
+} // namespace meep
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
 
 #include "meep.hpp"
 #include "meep_internals.hpp"
@@ -99,25 +100,19 @@ void fields::step() {
 }
 
 void fields::phase_material() {
-  bool changed = false;
   if (is_phasing()) {
+    /* phase_in_material gives a new_s to the chunks of every process, so
+       all processes know that the material changed without a global
+       or_to_all of the chunks' new_s flags on every step */
     for (int i = 0; i < num_chunks; i++)
-      if (chunks[i]->is_mine()) {
-        chunks[i]->phase_material(phasein_time);
-        changed = changed || chunks[i]->new_s;
-      }
+      if (chunks[i]->is_mine()) chunks[i]->phase_material(phasein_time);
     phasein_time--;
-    am_now_working_on(MpiAllTime);
-    bool changed_mpi = or_to_all(changed);
-    finished_working();
-    if (changed_mpi) {
-      calc_sources(time() + 0.5 * dt); // for integrated H sources
-      update_eh(H_stuff);              // ensure H = 1/mu * B
-      step_boundaries(H_stuff);
-      calc_sources(time() + dt); // for integrated E sources
-      update_eh(E_stuff);        // ensure E = 1/eps * D
-      step_boundaries(E_stuff);
-    }
+    calc_sources(time() + 0.5 * dt); // for integrated H sources
+    update_eh(H_stuff);              // ensure H = 1/mu * B
+    step_boundaries(H_stuff);
+    calc_sources(time() + dt); // for integrated E sources
+    update_eh(E_stuff);        // ensure E = 1/eps * D
+    step_boundaries(E_stuff);
   }
 }
 
@@ -141,13 +136,19 @@ void fields::step_boundaries(field_type ft) {
      array so that all of the connections for process i come before all
      of the connections for process i' for i < i'  */
 
-  // First copy outgoing data to buffers...
+  // First copy outgoing data to buffers... (pairs of chunks that are both
+  // owned by this process are copied directly below, without a buffer)
   am_now_working_on(Boundaries);
   for (int j = 0; j < num_chunks; j++)
     if (chunks[j]->is_mine()) {
       int wh[3] = {0, 0, 0};
       for (int i = 0; i < num_chunks; i++) {
         const int pair = j + i * num_chunks;
+        if (chunks[i]->is_mine()) {
+          for (int ip = 0; ip < 3; ip++)
+            wh[ip] += comm_sizes[ft][ip][pair];
+          continue;
+        }
         size_t n0 = 0;
         for (int ip = 0; ip < 3; ip++) {
           for (size_t n = 0; n < comm_sizes[ft][ip][pair]; n++)
@@ -164,11 +165,44 @@ void fields::step_boundaries(field_type ft) {
 
   // Finally, copy incoming data to the fields themselves, multiplying phases:
   am_now_working_on(Boundaries);
-  for (int i = 0; i < num_chunks; i++)
+  // wh_out[ip * num_chunks + j] is the start of the connections from chunk j
+  // to chunk i in chunk j's Outgoing array (used for the direct copies)
+  size_t *wh_out = new size_t[3 * num_chunks];
+  for (int n = 0; n < 3 * num_chunks; n++)
+    wh_out[n] = 0;
+  for (int i = 0; i < num_chunks; i++) {
     if (chunks[i]->is_mine()) {
       int wh[3] = {0, 0, 0};
       for (int j = 0; j < num_chunks; j++) {
         const int pair = j + i * num_chunks;
+        if (chunks[j]->is_mine()) {
+          // both chunks are local: copy owned -> not-owned points in one pass
+          connect_phase ip = CONNECT_PHASE;
+          realnum **in = chunks[i]->connections[ft][ip][Incoming] + wh[ip];
+          realnum **out = chunks[j]->connections[ft][ip][Outgoing] + wh_out[ip * num_chunks + j];
+          const complex<realnum> *ph = chunks[i]->connection_phases[ft] + wh[ip] / 2;
+          for (size_t n = 0; n < comm_sizes[ft][ip][pair]; n += 2) {
+            const double phr = real(ph[n / 2]);
+            const double phi = imag(ph[n / 2]);
+            const double re = *(out[n]), im = *(out[n + 1]);
+            *(in[n]) = phr * re - phi * im;
+            *(in[n + 1]) = phr * im + phi * re;
+          }
+          wh[ip] += comm_sizes[ft][ip][pair];
+          ip = CONNECT_NEGATE;
+          in = chunks[i]->connections[ft][ip][Incoming] + wh[ip];
+          out = chunks[j]->connections[ft][ip][Outgoing] + wh_out[ip * num_chunks + j];
+          for (size_t n = 0; n < comm_sizes[ft][ip][pair]; ++n)
+            *(in[n]) = -*(out[n]);
+          wh[ip] += comm_sizes[ft][ip][pair];
+          ip = CONNECT_COPY;
+          in = chunks[i]->connections[ft][ip][Incoming] + wh[ip];
+          out = chunks[j]->connections[ft][ip][Outgoing] + wh_out[ip * num_chunks + j];
+          for (size_t n = 0; n < comm_sizes[ft][ip][pair]; ++n)
+            *(in[n]) = *(out[n]);
+          wh[ip] += comm_sizes[ft][ip][pair];
+          continue;
+        }
         connect_phase ip = CONNECT_PHASE;
         for (size_t n = 0; n < comm_sizes[ft][ip][pair]; n += 2, wh[ip] += 2) {
           const double phr = real(chunks[i]->connection_phases[ft][wh[ip] / 2]);
@@ -188,14 +222,44 @@ void fields::step_boundaries(field_type ft) {
           *(chunks[i]->connections[ft][ip][Incoming][wh[ip]++]) = comm_blocks[ft][pair][n0 + n];
       }
     }
+    for (int j = 0; j < num_chunks; j++)
+      for (int ip = 0; ip < 3; ip++)
+        wh_out[ip * num_chunks + j] += comm_sizes[ft][ip][j + i * num_chunks];
+  }
+  delete[] wh_out;
   finished_working();
+}
 
+/* The chunks owned by this process, in order of decreasing measured
+   timestepping time.  Each phase of the timestep (step_db, update_eh, ...)
+   hands these chunks out one at a time to whichever OpenMP thread is idle,
+   so with several chunks per thread an expensive chunk (e.g. with a large
+   DFT monitor) is balanced by the other threads taking the cheaper chunks;
+   starting with the most expensive chunks keeps one from being left for
+   the end.  The threads only wait for each other at the end of each phase,
+   before the boundary communications that the next phase depends on. */
+std::vector<int> fields::my_chunks_by_time() const {
+  std::vector<int> order;
+  for (int i = 0; i < num_chunks; i++)
+    if (chunks[i]->is_mine()) order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [this](int i, int j) {
+    return chunks[i]->step_time > chunks[j]->step_time;
+  });
+  return order;
 }
 
 void fields::step_source(field_type ft, bool including_integrated) {
   if (ft != D_stuff && ft != B_stuff) abort("only step_source(D/B) is okay");
-  for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine()) chunks[i]->step_source(ft, including_integrated);
+  const std::vector<int> order = my_chunks_by_time();
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (size_t j = 0; j < order.size(); j++) {
+    const int i = order[j];
+    double start = wall_time();
+    chunks[i]->step_source(ft, including_integrated);
+    chunks[i]->step_time += wall_time() - start;
+  }
 }
 void fields_chunk::step_source(field_type ft, bool including_integrated) {
   if (doing_solve_cw && !including_integrated) return;
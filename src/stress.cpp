@@ -87,13 +87,16 @@ void dft_force::operator-=(const dft_force &st) {
   if (diag && st.diag) *diag -= *st.diag;
 }
 
-static void stress_sum(size_t Nfreq, double *F, const dft_chunk *F1, const dft_chunk *F2) {
+static void stress_sum(size_t Nfreq, double *F, dft_chunk *F1, dft_chunk *F2) {
+  flush_dfts(F1);
+  flush_dfts(F2);
   for (const dft_chunk *curF1 = F1, *curF2 = F2; curF1 && curF2;
        curF1 = curF1->next_in_dft, curF2 = curF2->next_in_dft) {
     complex<double> extra_weight(real(curF1->extra_weight), imag(curF1->extra_weight));
     for (size_t k = 0; k < curF1->N; ++k)
       for (size_t i = 0; i < Nfreq; ++i)
-        F[i] += real(extra_weight * curF1->dft[k * Nfreq + i] * conj(curF2->dft[k * Nfreq + i]));
+        F[i] += real(extra_weight * curF1->dft_value(k * Nfreq + i) *
+                     conj(curF2->dft_value(k * Nfreq + i)));
   }
 }
 
@@ -19,6 +19,9 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
 #include <memory>
 
 #include "meep.hpp"
@@ -100,6 +103,273 @@ static binary_partition *split_by_cost(int n, grid_volume gvol, bool fragment_co
   }
 }
 
+/* Index of the point x (with coordinates of the given number of bits) along
+   the Hilbert curve in dims dimensions, using the algorithm of J. Skilling,
+   "Programming the Hilbert curve," AIP Conf. Proc. 707, 381 (2004). */
+static uint64_t hilbert_index(int dims, int bits, const int *xin) {
+  unsigned x[3];
+  for (int i = 0; i < dims; ++i)
+    x[i] = xin[i];
+  if (dims > 1) {
+    // inverse undo of the excess work
+    for (unsigned Q = 1u << (bits - 1); Q > 1; Q >>= 1) {
+      const unsigned P = Q - 1;
+      for (int i = 0; i < dims; ++i)
+        if (x[i] & Q)
+          x[0] ^= P; // invert
+        else {       // exchange
+          const unsigned t = (x[0] ^ x[i]) & P;
+          x[0] ^= t;
+          x[i] ^= t;
+        }
+    }
+    // Gray encode
+    for (int i = 1; i < dims; ++i)
+      x[i] ^= x[i - 1];
+    unsigned t = 0;
+    for (unsigned Q = 1u << (bits - 1); Q > 1; Q >>= 1)
+      if (x[dims - 1] & Q) t ^= Q - 1;
+    for (int i = 0; i < dims; ++i)
+      x[i] ^= t;
+  }
+  // interleave the bits, most significant first
+  uint64_t h = 0;
+  for (int b = bits - 1; b >= 0; --b)
+    for (int i = 0; i < dims; ++i)
+      h = (h << 1) | ((x[i] >> b) & 1);
+  return h;
+}
+
+/* The coarse grid of cells used by split_by_hilbert_curve: cell j covers
+   pixels [j*size, min((j+1)*size, n)) along each direction, and part[]
+   is the index of the curve segment (= process slot) of each cell. */
+struct hilbert_grid {
+  int dims, size, n[3], ncells[3];
+  direction dirs[3];
+  std::vector<int> part;
+
+  int &part_at(const int *j) { return part[(j[0] * ncells[1] + j[1]) * ncells[2] + j[2]]; }
+};
+
+// recursively split the cells [lo, hi) into boxes that each lie within a single segment
+static binary_partition *hilbert_boxes(hilbert_grid &g, const grid_volume &gv, int *lo, int *hi) {
+  int j[3];
+  const int p = g.part_at(lo);
+  bool uniform = true;
+  for (j[0] = lo[0]; uniform && j[0] < hi[0]; ++j[0])
+    for (j[1] = lo[1]; uniform && j[1] < hi[1]; ++j[1])
+      for (j[2] = lo[2]; uniform && j[2] < hi[2]; ++j[2])
+        uniform = g.part_at(j) == p;
+  if (uniform) return new binary_partition(p);
+
+  /* split at the coarsest power-of-two boundary inside [lo, hi), i.e. like
+     an octree, since the Hilbert curve traverses each octant in one piece */
+  int best = -1, best_split = 0, best_level = -1;
+  for (int i = 0; i < g.dims; ++i)
+    for (int level = 30; level >= 0 && level > best_level; --level) {
+      const int split = (hi[i] - 1) >> level << level;
+      if (split > lo[i]) {
+        best = i;
+        best_split = split;
+        best_level = level;
+      }
+    }
+  const direction d = g.dirs[best];
+  const int pixel = std::min(best_split * g.size, g.n[best]);
+  const volume v = gv.surroundings();
+  binary_partition *bp =
+      new binary_partition(d, v.in_direction_min(d) + v.in_direction(d) * pixel / g.n[best]);
+  int mid[3];
+  std::copy(hi, hi + 3, mid);
+  mid[best] = best_split;
+  bp->left = hilbert_boxes(g, gv, lo, mid);
+  std::copy(lo, lo + 3, mid);
+  mid[best] = best_split;
+  bp->right = hilbert_boxes(g, gv, mid, hi);
+  return bp;
+}
+
+/* Alternative to split_by_cost: order the cells of a coarse grid along a
+   Hilbert space-filling curve, and cut the curve into n segments of equal
+   cost.  Each segment is spatially compact for any n, unlike the slabs that
+   bisection can give for odd n, but it is generally a union of several
+   boxes, so there may be more than n chunks (the leaves of the returned
+   partition have the segment number as their proc_id). */
+static binary_partition *split_by_hilbert_curve(int n, const grid_volume &gv, bool fragment_cost) {
+  hilbert_grid g;
+  g.dims = 0;
+  LOOP_OVER_DIRECTIONS(gv.dim, d) {
+    if (gv.num_direction(d) > 1) {
+      g.dirs[g.dims] = d;
+      g.n[g.dims++] = gv.num_direction(d);
+    }
+  }
+  if (n == 1 || g.dims == 0) return new binary_partition(0);
+
+  // about 16 coarse cells per segment
+  double ncoarse = 16.0 * n, npix = 1;
+  for (int i = 0; i < g.dims; ++i)
+    npix *= g.n[i];
+  g.size = std::max(1, int(pow(npix / ncoarse, 1.0 / g.dims)));
+  int bits = 1;
+  for (int i = 0; i < 3; ++i) {
+    g.ncells[i] = i < g.dims ? (g.n[i] + g.size - 1) / g.size : 1;
+    while ((1 << bits) < g.ncells[i])
+      ++bits;
+  }
+  if (bits * g.dims > 64) abort("too many cells for split_by_hilbert_curve");
+
+  // cost of each coarse cell, in the order of the curve
+  struct cell {
+    uint64_t h;
+    int j[3];
+    double cost;
+  };
+  std::vector<cell> cells;
+  int j[3];
+  for (j[0] = 0; j[0] < g.ncells[0]; ++j[0])
+    for (j[1] = 0; j[1] < g.ncells[1]; ++j[1])
+      for (j[2] = 0; j[2] < g.ncells[2]; ++j[2]) {
+        cell c;
+        std::copy(j, j + 3, c.j);
+        c.h = hilbert_index(g.dims, bits, j);
+        grid_volume vc = gv;
+        for (int i = 0; i < g.dims; ++i) {
+          const int lo = j[i] * g.size, hi = std::min(lo + g.size, g.n[i]);
+          vc.set_num_direction(g.dirs[i], hi - lo);
+          vc.shift_origin(g.dirs[i], lo * 2);
+        }
+        c.cost = fragment_cost ? vc.get_cost() : vc.nowned_min();
+        cells.push_back(c);
+      }
+  std::sort(cells.begin(), cells.end(), [](const cell &a, const cell &b) { return a.h < b.h; });
+
+  // cut the curve at multiples of the mean cost per segment
+  double total = 0;
+  for (const cell &c : cells)
+    total += c.cost;
+  g.part.resize(cells.size());
+  double sum = 0;
+  for (const cell &c : cells) {
+    const int p = total > 0 ? int((sum + 0.5 * c.cost) / total * n) : 0;
+    g.part_at(c.j) = std::min(p, n - 1);
+    sum += c.cost;
+  }
+
+  int lo[3] = {0, 0, 0};
+  return hilbert_boxes(g, gv, lo, g.ncells);
+}
+
+// area (in pixels) of the face shared by two non-overlapping chunk volumes, or 0 if they don't touch
+double shared_face_area(const grid_volume &gv1, const grid_volume &gv2) {
+  const ivec lo1 = gv1.little_corner(), hi1 = gv1.big_corner();
+  const ivec lo2 = gv2.little_corner(), hi2 = gv2.big_corner();
+  double area = 1;
+  int num_touching = 0;
+  LOOP_OVER_DIRECTIONS(gv1.dim, d) {
+    const int lo = std::max(lo1.in_direction(d), lo2.in_direction(d));
+    const int hi = std::min(hi1.in_direction(d), hi2.in_direction(d));
+    if (hi < lo) return 0;
+    if (hi == lo)
+      num_touching++;
+    else
+      area *= (hi - lo) / 2;
+  }
+  return num_touching == 1 ? area : 0;
+}
+
+/* Map the chunks (in the leaf order of the binary partition) onto the
+   processes, taking into account which processes share a node, so that
+   as much of the chunk surface area (= halo communication) as possible
+   stays within a node.  Leaves with a proc_id (ids[i] >= 0, from
+   split_by_hilbert_curve) are grouped by it.  Returns the process of
+   each chunk. */
+static std::vector<int> place_chunks_on_nodes(const std::vector<grid_volume> &chunk_volumes,
+                                              const std::vector<int> &ids) {
+  const int nprocs = count_processors();
+  const size_t nchunks = chunk_volumes.size();
+  std::vector<int> procs(nchunks);
+
+  // default layout: consecutive leaves (which are spatially close) on consecutive "slots"
+  std::vector<int> slot(nchunks);
+  const int nids = *std::max_element(ids.begin(), ids.end()) + 1;
+  for (size_t i = 0; i < nchunks; ++i)
+    procs[i] = slot[i] = ids[i] >= 0 ? ids[i] * nprocs / nids : i * nprocs / nchunks;
+  if (nprocs == 1) return procs;
+
+  std::vector<int> node_ids(nprocs);
+  get_node_ids(node_ids.data());
+  std::vector<int> ranks(nprocs); // ranks sorted by node
+  for (int p = 0; p < nprocs; ++p)
+    ranks[p] = p;
+  std::stable_sort(ranks.begin(), ranks.end(),
+                   [&node_ids](int p1, int p2) { return node_ids[p1] < node_ids[p2]; });
+  if (node_ids[ranks[0]] == node_ids[ranks[nprocs - 1]]) return procs; // single node
+
+  // surface area shared between the chunks of each pair of slots
+  std::vector<std::map<int, double> > adjacency(nprocs);
+  for (size_t i = 0; i < nchunks; ++i)
+    for (size_t j = i + 1; j < nchunks; ++j)
+      if (slot[i] != slot[j]) {
+        const double area = shared_face_area(chunk_volumes[i], chunk_volumes[j]);
+        if (area > 0) {
+          adjacency[slot[i]][slot[j]] += area;
+          adjacency[slot[j]][slot[i]] += area;
+        }
+      }
+
+  // initial guess: assign the slots to the processes sorted by node
+  std::vector<int> node(nprocs);
+  for (int s = 0; s < nprocs; ++s)
+    node[s] = node_ids[ranks[s]];
+  std::vector<int> default_node(node_ids);
+
+  // inter-node surface area of a slot->node assignment
+  auto internode_area = [&adjacency, nprocs](const std::vector<int> &nd) {
+    double area = 0;
+    for (int s = 0; s < nprocs; ++s)
+      for (const auto &a : adjacency[s])
+        if (a.first > s && nd[a.first] != nd[s]) area += a.second;
+    return area;
+  };
+  // change in the inter-node area from moving slot s to node n, ignoring slot t
+  auto move_cost = [&adjacency, &node](int s, int n, int t) {
+    double delta = 0;
+    for (const auto &a : adjacency[s])
+      if (a.first != t) delta += a.second * ((node[a.first] != n) - (node[a.first] != node[s]));
+    return delta;
+  };
+
+  // greedy refinement: swap the nodes of pairs of slots while that reduces the inter-node area
+  for (int pass = 0; pass < 10; ++pass) {
+    bool improved = false;
+    for (int s = 0; s < nprocs; ++s)
+      for (int t = s + 1; t < nprocs; ++t)
+        if (node[s] != node[t] && move_cost(s, node[t], t) + move_cost(t, node[s], s) < 0) {
+          std::swap(node[s], node[t]);
+          improved = true;
+        }
+    if (!improved) break;
+  }
+
+  // finally, give the slots of each node to the processes of that node
+  std::map<int, std::vector<int> > node_ranks;
+  for (int p = nprocs - 1; p >= 0; --p)
+    node_ranks[node_ids[ranks[p]]].push_back(ranks[p]);
+  std::vector<int> slot_rank(nprocs);
+  for (int s = 0; s < nprocs; ++s) {
+    slot_rank[s] = node_ranks[node[s]].back();
+    node_ranks[node[s]].pop_back();
+  }
+  for (size_t i = 0; i < nchunks; ++i)
+    procs[i] = slot_rank[slot[i]];
+
+  if (verbosity > 0)
+    master_printf("Inter-node chunk surface area: %g pixels (%g without topology-aware placement)\n",
+                  internode_area(node), internode_area(default_node));
+  return procs;
+}
+
 void structure::choose_chunkdivision(const grid_volume &thegv, int desired_num_chunks,
                                      const boundary_region &br, const symmetry &s,
                                      const binary_partition *bp) {
@@ -131,11 +401,15 @@ void structure::choose_chunkdivision(const grid_volume &thegv, int desired_num_c
   // Next, add effort volumes for PML boundary regions:
   br.apply(this);
 
+  // Assign the chunks to processes
+  std::vector<int> procs;
+  if (!bp) procs = place_chunks_on_nodes(chunk_volumes, ids);
+
   // Break off PML regions into their own chunks
   num_chunks = 0;
   chunks = new structure_chunk_ptr[chunk_volumes.size() * num_effort_volumes];
   for (size_t i = 0, stop = chunk_volumes.size(); i < stop; ++i) {
-    const int proc = (!bp) ? i * count_processors() / chunk_volumes.size() : ids[i] % count_processors();
+    const int proc = (!bp) ? procs[i] : ids[i] % count_processors();
     for (int j = 0; j < num_effort_volumes; ++j) {
       grid_volume vc;
       if (chunk_volumes[i].intersect_with(effort_volumes[j], &vc)) {
@@ -147,6 +421,7 @@ void structure::choose_chunkdivision(const grid_volume &thegv, int desired_num_c
 
   check_chunks();
   if (meep_geom::fragment_stats::resolution != 0) {
+    meep_geom::fragment_stats::init_cost_weights();
     // Save cost of each chunk's grid_volume
     for (int i = 0; i < num_chunks; ++i) {
       chunks[i]->cost = chunks[i]->gv.get_cost();
@@ -193,8 +468,16 @@ binary_partition *choose_chunkdivision(grid_volume &gv, volume &v, int desired_n
       if (break_this[d]) gv = gv.pad((direction)d);
   }
 
-  if (meep_geom::fragment_stats::resolution == 0 ||
-      meep_geom::fragment_stats::split_chunks_evenly) {
+  const bool fragment_cost = meep_geom::fragment_stats::resolution != 0 &&
+                             !meep_geom::fragment_stats::split_chunks_evenly;
+  if (meep_geom::fragment_stats::split_chunks_hilbert) {
+    if (verbosity > 0 && desired_num_chunks > 1)
+      master_printf("Splitting into %d parts by %s along a Hilbert curve\n", desired_num_chunks,
+                    fragment_cost ? "cost" : "voxels");
+    if (fragment_cost) meep_geom::fragment_stats::init_cost_weights();
+    return split_by_hilbert_curve(desired_num_chunks, gv, fragment_cost);
+  }
+  else if (!fragment_cost) {
     if (verbosity > 0 && desired_num_chunks > 1)
       master_printf("Splitting into %d chunks by voxels\n", desired_num_chunks);
     return split_by_cost(desired_num_chunks, gv, false);
@@ -202,6 +485,7 @@ binary_partition *choose_chunkdivision(grid_volume &gv, volume &v, int desired_n
   else {
     if (verbosity > 0 && desired_num_chunks > 1)
       master_printf("Splitting into %d chunks by cost\n", desired_num_chunks);
+    meep_geom::fragment_stats::init_cost_weights();
     return split_by_cost(desired_num_chunks, gv, true);
   }
 
@@ -748,6 +1032,14 @@ structure_chunk::structure_chunk(const structure_chunk *o) : v(o->v) {
           chiP[ft] = cur = ocur->clone();
         }
         cur->next = NULL;
+        // the subclass clone() methods don't copy sigma
+        FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+          cur->trivial_sigma[c][d] = ocur->trivial_sigma[c][d];
+          if (ocur->sigma[c][d] && !cur->sigma[c][d]) {
+            cur->sigma[c][d] = new realnum[ocur->ntot];
+            memcpy(cur->sigma[c][d], ocur->sigma[c][d], sizeof(realnum) * ocur->ntot);
+          }
+        }
       }
     }
   }
@@ -778,7 +1070,10 @@ structure_chunk::structure_chunk(const structure_chunk *o) : v(o->v) {
       chi2[c] = NULL;
     }
   }
-  FOR_COMPONENTS(c) FOR_DIRECTIONS(d) { trivial_chi1inv[c][d] = true; }
+  FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+    trivial_chi1inv[c][d] = true;
+    chi1inv[c][d] = conductivity[c][d] = condinv[c][d] = NULL;
+  }
   FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
     if (is_mine()) {
       trivial_chi1inv[c][d] = o->trivial_chi1inv[c][d];
@@ -811,11 +1106,11 @@ structure_chunk::structure_chunk(const structure_chunk *o) : v(o->v) {
   // Copy over the PML conductivity arrays:
   if (is_mine()) FOR_DIRECTIONS(d) {
       if (o->sig[d]) {
-        sig[d] = new realnum[2 * gv.num_direction(d) + 1];
-        kap[d] = new realnum[2 * gv.num_direction(d) + 1];
-        siginv[d] = new realnum[2 * gv.num_direction(d) + 1];
         sigsize[d] = o->sigsize[d];
-        for (int i = 0; i < 2 * gv.num_direction(d) + 1; i++) {
+        sig[d] = new realnum[sigsize[d]];
+        kap[d] = new realnum[sigsize[d]];
+        siginv[d] = new realnum[sigsize[d]];
+        for (int i = 0; i < sigsize[d]; i++) {
           sig[d][i] = o->sig[d][i];
           kap[d][i] = o->kap[d][i];
           siginv[d][i] = o->siginv[d][i];
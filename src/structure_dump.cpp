@@ -15,13 +15,15 @@
 %  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
-// Dump/load raw structure data to/from an HDF5 file.  Only
-// works if the number of processors/chunks is the same.
+// Dump/load raw structure data to/from an HDF5 file.  The file
+// can be loaded into any chunk layout (and number of processors)
+// of a structure with the same grid_volume.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <vector>
 
 #include "meep.hpp"
 #include "meep_internals.hpp"
@@ -80,226 +82,201 @@ void structure::dump_chunk_layout(const char *filename) {
     size_t nums_start = 0;
     file.write_chunk(1, &nums_start, &sz, nums);
   }
+  // the owner of each chunk, since a process may own several non-consecutive chunks
+  size_t nsz = num_chunks;
+  size_t *owners = new size_t[nsz];
+  for (int i = 0; i < num_chunks; ++i)
+    owners[i] = chunks[i]->n_proc();
+  file.create_data("gv_owners", 1, &nsz);
+  if (am_master()) {
+    size_t owners_start = 0;
+    file.write_chunk(1, &owners_start, &nsz, owners);
+  }
+  delete[] owners;
   delete[] origins;
   delete[] nums;
 }
 
-void structure::dump(const char *filename) {
-  if (verbosity > 0) master_printf("creating epsilon output file \"%s\"...\n", filename);
-
-  // make/save a num_chunks x NUM_FIELD_COMPONENTS x 5 array counting
-  // the number of entries in the chi1inv array for each chunk.
-  size_t *num_chi1inv_ = new size_t[num_chunks * NUM_FIELD_COMPONENTS * 5];
-  memset(num_chi1inv_, 0, sizeof(size_t) * size_t(num_chunks * NUM_FIELD_COMPONENTS * 5));
-  size_t my_ntot = 0;
-  for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine()) {
-      size_t ntot = chunks[i]->gv.ntot();
-      for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c)
-        for (int d = 0; d < 5; ++d)
-          if (chunks[i]->chi1inv[c][d])
-            my_ntot += (num_chi1inv_[(i * NUM_FIELD_COMPONENTS + c) * 5 + d] = ntot);
-    }
-  size_t *num_chi1inv = new size_t[num_chunks * NUM_FIELD_COMPONENTS * 5];
-  sum_to_master(num_chi1inv_, num_chi1inv, num_chunks * NUM_FIELD_COMPONENTS * 5);
-  delete[] num_chi1inv_;
-
-  // determine total dataset size and offset of this process's data
-  size_t my_start = partial_sum_to_all(my_ntot) - my_ntot;
-  size_t ntotal = sum_to_all(my_ntot);
+/* The chi1inv and sigma arrays are stored as one dataset per component
+   and direction over the whole grid_volume gv of the structure (with
+   the same indexing as the chunk arrays, i.e. row-major in the order
+   below, see grid_volume::set_strides), so that they can be loaded
+   into any chunk layout and number of processes. */
+static int array_dims(const grid_volume &gv, direction ds[3], size_t dims[3]) {
+  static const direction dirs[4][3] = {{Z, Z, Z}, {X, Y, Z}, {X, Y, Z}, {R, Z, Z}};
+  static const int ranks[4] = {1, 2, 3, 2}; // for D1, D2, D3, Dcyl
+  const int rank = ranks[gv.dim];
+  for (int i = 0; i < rank; ++i) {
+    ds[i] = dirs[gv.dim][i];
+    dims[i] = gv.num_direction(ds[i]) + 1;
+  }
+  return rank;
+}
 
-  h5file file(filename, h5file::WRITE, true);
-  size_t dims[3] = {(size_t)num_chunks, NUM_FIELD_COMPONENTS, 5};
-  size_t start[3] = {0, 0, 0};
-  file.create_data("num_chi1inv", 3, dims);
-  if (am_master()) file.write_chunk(3, start, dims, num_chi1inv);
-  delete[] num_chi1inv;
-
-  // write the data
-  file.create_data("chi1inv", 1, &ntotal, false /* append_data */, false /* single_precision */);
-  for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine()) {
-      size_t ntot = chunks[i]->gv.ntot();
-      for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c)
-        for (int d = 0; d < 5; ++d)
-          if (chunks[i]->chi1inv[c][d]) {
-            file.write_chunk(1, &my_start, &ntot, chunks[i]->chi1inv[c][d]);
-            my_start += ntot;
-          }
-    }
+// the offset of the array of chunk gvc in the global array of gv
+static void chunk_offset(const grid_volume &gv, const grid_volume &gvc, size_t start[3]) {
+  direction ds[3];
+  size_t dims[3];
+  const int rank = array_dims(gv, ds, dims);
+  for (int i = 0; i < rank; ++i)
+    start[i] = (gvc.little_corner() - gv.little_corner()).in_direction(ds[i]) / 2;
+}
 
-  // Get the sizes of susceptibility lists for chiP[E_stuff] and chiP[H_stuff]
-  // Since this info is copied to each chunk, we can just get it from the first chunk
-  size_t num_sus[2] = {0, 0};
-  susceptibility *Esus = chunks[0]->chiP[E_stuff];
-  while (Esus) {
-    num_sus[E_stuff] += 1;
-    Esus = Esus->next;
-  }
-  susceptibility *Hsus = chunks[0]->chiP[H_stuff];
-  while (Hsus) {
-    num_sus[H_stuff] += 1;
-    Hsus = Hsus->next;
-  }
+/* Write the points of component c in the array data of chunk gvc (or
+   the constant val if data is NULL) to the current dataset over gv.  A
+   point shared by neighboring chunks is written only by the chunk that
+   owns it (see grid_volume::owns), and the unowned points on the edges
+   of gv by the chunk on that edge, so that every point is written once. */
+static void write_chunk_array(h5file &file, const grid_volume &gv, const grid_volume &gvc,
+                              component c, const realnum *data, realnum val) {
+  direction ds[3];
+  size_t dims[3], start[3] = {0, 0, 0}, lo[3] = {0, 0, 0}, count[3] = {1, 1, 1},
+                  n[3] = {1, 1, 1};
+  const int rank = array_dims(gv, ds, dims);
+  chunk_offset(gv, gvc, start);
+  for (int i = 0; i < rank; ++i) {
+    const bool shifted = gv.iyee_shift(c).in_direction(ds[i]) != 0;
+    n[i] = gvc.num_direction(ds[i]) + 1;
+    if (!shifted && start[i] > 0) lo[i] = 1;
+    const size_t hi = (shifted && start[i] + n[i] < dims[i]) ? n[i] - 2 : n[i] - 1;
+    start[i] += lo[i];
+    count[i] = hi + 1 - lo[i];
+  }
+  std::vector<realnum> buf(count[0] * count[1] * count[2], val);
+  if (data) {
+    size_t idx = 0;
+    for (size_t i0 = lo[0]; i0 < lo[0] + count[0]; ++i0)
+      for (size_t i1 = lo[1]; i1 < lo[1] + count[1]; ++i1)
+        for (size_t i2 = lo[2]; i2 < lo[2] + count[2]; ++i2)
+          buf[idx++] = data[(i0 * n[1] + i1) * n[2] + i2];
+  }
+  file.write_chunk(rank, start, count, buf.data());
+}
 
-  {
-    // Write the number of susceptibilites
-    size_t len = 2;
-    file.create_data("num_sus", 1, &len);
-    if (am_master()) {
-      size_t start = 0;
-      size_t ntot = 2;
-      file.write_chunk(1, &start, &ntot, num_sus);
-    }
-  }
+// read the array of chunk gvc from the current dataset over gv
+static void read_chunk_array(h5file &file, const grid_volume &gv, const grid_volume &gvc,
+                             realnum *data) {
+  direction ds[3];
+  size_t dims[3], cdims[3], start[3];
+  const int rank = array_dims(gv, ds, dims);
+  array_dims(gvc, ds, cdims);
+  chunk_offset(gv, gvc, start);
+  file.read_chunk(rank, start, cdims, data);
+}
 
-  // Get number of non-null sigma entries for each chiP in each chunk.
-  // Assumes each susceptibility in the chiP[E_stuff] list has the
-  // same number of non-null sigma elements. Likewise for chiP[H_stuff]
-  size_t *my_num_sigmas[2];
-  size_t *num_sigmas[2];
-  for (int ft = 0; ft < 2; ++ft) {
-    my_num_sigmas[ft] = new size_t[num_chunks];
-    num_sigmas[ft] = new size_t[num_chunks];
-    memset(my_num_sigmas[ft], 0, sizeof(size_t) * num_chunks);
-    memset(num_sigmas[ft], 0, sizeof(size_t) * num_chunks);
-  }
+static void check_array_size(h5file &file, const char *dname, const grid_volume &gv) {
+  direction ds[3];
+  size_t dims[3], fdims[3] = {0, 0, 0};
+  const int rank = array_dims(gv, ds, dims);
+  int frank;
+  file.read_size(dname, &frank, fdims, 3);
+  if (frank != rank || fdims[0] != dims[0] || (rank > 1 && fdims[1] != dims[1]) ||
+      (rank > 2 && fdims[2] != dims[2]))
+    abort("grid size mismatch for %s in structure::load", dname);
+}
 
-  for (int i = 0; i < num_chunks; ++i) {
-    if (chunks[i]->is_mine()) {
-      for (int ft = 0; ft < 2; ++ft) {
-        susceptibility *sus = chunks[i]->chiP[ft];
-        if (sus) {
-          for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c) {
-            for (int d = 0; d < 5; ++d) {
-              if (sus->sigma[c][d]) { my_num_sigmas[ft][i] += 1; }
-            }
-          }
-        }
-      }
+/* Deallocate the trivial entries of the row c of a chi1inv or sigma
+   tensor, as in structure_chunk::set_chi1inv and add_susceptibility: the
+   off-diagonal entries that are zero everywhere, and the diagonal entry
+   (equal to diag everywhere) only if the whole row is trivial. */
+static void remove_trivial_row(const grid_volume &gv, component c, realnum **row, realnum diag,
+                               bool trivial[5]) {
+  const direction dc = component_direction(c);
+  bool all_trivial = true;
+  FOR_DIRECTIONS(d) {
+    const realnum val = d == dc ? diag : 0;
+    trivial[d] = true;
+    if (row[d])
+      for (size_t i = 0; i < gv.ntot() && trivial[d]; ++i)
+        trivial[d] = row[d][i] == val;
+    all_trivial = all_trivial && trivial[d];
+  }
+  FOR_DIRECTIONS(d) {
+    if (trivial[d] && (d != dc || all_trivial)) {
+      delete[] row[d];
+      row[d] = NULL;
     }
   }
+}
 
-  // Write num_sigmas data.
-  {
-    size_t ntot = num_chunks * 2;
-    file.create_data("num_sigmas", 1, &ntot);
+static void chi1inv_name(char *dname, component c, direction d) {
+  snprintf(dname, 64, "chi1inv_%s_%s", component_name(c), direction_name(d));
+}
 
-    for (int i = 0; i < num_chunks; ++i) {
-      if (chunks[i]->is_mine()) {
-        for (int ft = 0; ft < 2; ++ft) {
-          size_t start = ft * num_chunks + i;
-          size_t count = 1;
-          file.write_chunk(1, &start, &count, &my_num_sigmas[ft][i]);
-        }
-      }
-    }
-  }
+static void sigma_name(char *dname, int ft, int j, component c, direction d) {
+  snprintf(dname, 64, "%c_sigma_%d_%s_%s", ft == E_stuff ? 'E' : 'H', j, component_name(c),
+           direction_name(d));
+}
 
-  file.prevent_deadlock();
-  for (int ft = 0; ft < 2; ++ft) {
-    sum_to_all(my_num_sigmas[ft], num_sigmas[ft], num_chunks);
-  }
+static int num_susceptibilities(const susceptibility *sus) {
+  int n = 0;
+  for (; sus; sus = sus->next)
+    ++n;
+  return n;
+}
 
-  size_t num_E_sigmas = 0;
-  size_t num_H_sigmas = 0;
-  for (int i = 0; i < num_chunks; ++i) {
-    if (num_sigmas[E_stuff][i] != 0) { num_E_sigmas = num_sigmas[E_stuff][i]; }
-    if (num_sigmas[H_stuff][i] != 0) { num_H_sigmas = num_sigmas[H_stuff][i]; }
-  }
+static susceptibility *nth_susceptibility(susceptibility *sus, int j) {
+  while (j-- > 0)
+    sus = sus->next;
+  return sus;
+}
 
-  // Allocate space for component and direction of non-null sigmas
-  size_t *my_sigma_cd[2] = {NULL, NULL};
-  my_sigma_cd[E_stuff] = new size_t[num_E_sigmas * 2];
-  memset(my_sigma_cd[E_stuff], 0, sizeof(size_t) * num_E_sigmas * 2);
-  my_sigma_cd[H_stuff] = new size_t[num_H_sigmas * 2];
-  memset(my_sigma_cd[H_stuff], 0, sizeof(size_t) * num_H_sigmas * 2);
-
-  size_t *sigma_cd[2] = {NULL, NULL};
-  sigma_cd[E_stuff] = new size_t[num_E_sigmas * 2];
-  memset(sigma_cd[E_stuff], 0, sizeof(size_t) * num_E_sigmas * 2);
-  sigma_cd[H_stuff] = new size_t[num_H_sigmas * 2];
-  memset(sigma_cd[H_stuff], 0, sizeof(size_t) * num_H_sigmas * 2);
-
-  // Find component and direction of non-null sigmas
-  {
-    for (int ft = 0; ft < 2; ++ft) {
-      int j = 0;
-      bool done = false;
-      for (int i = 0; i < num_chunks; ++i) {
-        if (done) { break; }
-        if (chunks[i]->is_mine()) {
-          susceptibility *sus = chunks[i]->chiP[ft];
-          if (sus) {
-            for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c) {
-              for (int d = 0; d < 5; ++d) {
-                if (sus->sigma[c][d]) {
-                  my_sigma_cd[ft][j] = c;
-                  my_sigma_cd[ft][j + 1] = d;
-                  j += 2;
-                  done = true;
-                }
-              }
-            }
-          }
-        }
-      }
-    }
-    bw_or_to_all(my_sigma_cd[E_stuff], sigma_cd[E_stuff], num_E_sigmas * 2);
-    bw_or_to_all(my_sigma_cd[H_stuff], sigma_cd[H_stuff], num_H_sigmas * 2);
-  }
+void structure::dump(const char *filename) {
+  if (verbosity > 0) master_printf("creating epsilon output file \"%s\"...\n", filename);
 
-  // Write location (component and direction) data of non-null sigmas (sigma[c][d])
-  {
-    size_t len = (num_E_sigmas + num_H_sigmas) * 2;
-    file.create_data("sigma_cd", 1, &len);
-    size_t start = 0;
-    for (int ft = 0; ft < 2; ++ft) {
-      if (am_master()) {
-        size_t count = (ft == 0 ? num_E_sigmas : num_H_sigmas) * 2;
-        file.write_chunk(1, &start, &count, sigma_cd[ft]);
-        start += count;
+  /* Find which chi1inv and sigma components are allocated on any
+     chunk, before opening the file (which is exclusive to one process
+     at a time if HDF5 is not compiled for parallel I/O).  Each
+     susceptibility has the same index j in the chiP lists of all chunks. */
+  const int nsus[2] = {num_susceptibilities(chunks[0]->chiP[E_stuff]),
+                       num_susceptibilities(chunks[0]->chiP[H_stuff])};
+  const int nc = NUM_FIELD_COMPONENTS * 5;
+  const int nflags = nc * (1 + nsus[E_stuff] + nsus[H_stuff]);
+  std::vector<int> my_have(nflags, 0), have(nflags, 0);
+  for (int i = 0; i < num_chunks; i++)
+    if (chunks[i]->is_mine()) {
+      FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+        if (chunks[i]->chi1inv[c][d]) my_have[c * 5 + d] = 1;
+        int k = nc;
+        for (int ft = 0; ft < 2; ++ft)
+          for (susceptibility *sus = chunks[i]->chiP[ft]; sus; sus = sus->next, k += nc)
+            if (sus->sigma[c][d]) my_have[k + c * 5 + d] = 1;
       }
     }
-  }
+  or_to_all(my_have.data(), have.data(), nflags);
 
-  // Write the actual data in a particular non-null sigma[c][d] for each susceptibility in this
-  // chunk's chiP lists.
-  size_t nsig[2] = {num_E_sigmas, num_H_sigmas};
-  for (int i = 0; i < num_chunks; ++i) {
-    for (int ft = 0; ft < 2; ++ft) {
-      if (nsig[ft] != 0 && num_sigmas[ft][i]) {
-        for (size_t j = 0; j < nsig[ft] * 2; j += 2) {
-          char dname[20];
-          int c = sigma_cd[ft][j];
-          int d = sigma_cd[ft][j + 1];
-          snprintf(dname, 20, "%c_%d_sigma_%d_%d", ft == 0 ? 'E' : 'H', i, c, d);
-          size_t ntot = chunks[i]->gv.ntot() * num_sus[ft];
-          file.create_data(dname, 1, &ntot);
-          if (chunks[i]->is_mine()) {
-            susceptibility *sus = chunks[i]->chiP[ft];
-            size_t start = 0;
-            while (sus) {
-              size_t count = chunks[i]->gv.ntot();
-              file.write_chunk(1, &start, &count, sus->sigma[c][d]);
-              sus = sus->next;
-              start += count;
-            }
-          }
-        }
+  h5file file(filename, h5file::WRITE, true);
+  direction ds[3];
+  size_t dims[3];
+  const int rank = array_dims(gv, ds, dims);
+  char dname[64];
+
+  FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+    if (!have[c * 5 + d]) continue;
+    chi1inv_name(dname, c, d);
+    file.create_data(dname, rank, dims, false /* append_data */, false /* single_precision */);
+    for (int i = 0; i < num_chunks; i++)
+      if (chunks[i]->is_mine())
+        write_chunk_array(file, gv, chunks[i]->gv, c, chunks[i]->chi1inv[c][d],
+                          d == component_direction(c) ? 1 : 0);
+  }
+
+  int k = nc;
+  for (int ft = 0; ft < 2; ++ft)
+    for (int j = 0; j < nsus[ft]; ++j, k += nc)
+      FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+        if (!have[k + c * 5 + d]) continue;
+        sigma_name(dname, ft, j, c, d);
+        file.create_data(dname, rank, dims, false /* append_data */,
+                         sizeof(realnum) == sizeof(float) /* single_precision */);
+        for (int i = 0; i < num_chunks; i++)
+          if (chunks[i]->is_mine())
+            write_chunk_array(file, gv, chunks[i]->gv, c,
+                              nth_susceptibility(chunks[i]->chiP[ft], j)->sigma[c][d], 0);
       }
-    }
-  }
 
   write_susceptibility_params(&file, "E_params", E_stuff);
   write_susceptibility_params(&file, "H_params", H_stuff);
-
-  for (int ft = 0; ft < 2; ++ft) {
-    delete[] sigma_cd[ft];
-    delete[] my_sigma_cd[ft];
-    delete[] num_sigmas[ft];
-    delete[] my_num_sigmas[ft];
-  }
 }
 
 // Reconstruct the chiP lists of susceptibilities from the params hdf5 data
@@ -457,18 +434,19 @@ void split_by_binarytree(grid_volume gvol,
 }
 
 void structure::load_chunk_layout(const char *filename, boundary_region &br) {
-  // Load chunk grid_volumes from a file
+  // Load chunk grid_volumes from a file (which need not have the current number of chunks)
   h5file file(filename, h5file::READONLY, true);
-  size_t sz = num_chunks * 3;
+  int origins_rank;
+  size_t origins_dims;
+  file.read_size("gv_origins", &origins_rank, &origins_dims, 1);
+  if (origins_rank != 1 || origins_dims % 3) { abort("chunk mismatch in structure::load"); }
+  const size_t sz = origins_dims;
+  const int file_num_chunks = int(sz / 3);
   double *origins = new double[sz];
   memset(origins, 0, sizeof(double) * sz);
   size_t *nums = new size_t[sz];
   memset(nums, 0, sizeof(size_t) * sz);
 
-  int origins_rank;
-  size_t origins_dims;
-  file.read_size("gv_origins", &origins_rank, &origins_dims, 1);
-  if (origins_rank != 1 || origins_dims != sz) { abort("chunk mismatch in structure::load"); }
   if (am_master()) {
     size_t gv_origins_start = 0;
     file.read_chunk(1, &gv_origins_start, &origins_dims, origins);
@@ -487,10 +465,28 @@ void structure::load_chunk_layout(const char *filename, boundary_region &br) {
   file.prevent_deadlock();
   broadcast(0, nums, sz);
 
+  // owners of the chunks, if present (older files assign consecutive chunks to each process)
+  size_t *owners = new size_t[file_num_chunks];
+  for (int i = 0; i < file_num_chunks; ++i)
+    owners[i] = i * count_processors() / file_num_chunks;
+  if (file.dataset_exists("gv_owners")) {
+    int owners_rank;
+    size_t owners_dims;
+    file.read_size("gv_owners", &owners_rank, &owners_dims, 1);
+    if (owners_rank != 1 || owners_dims != size_t(file_num_chunks))
+      abort("chunk mismatch in structure::load");
+    if (am_master()) {
+      size_t owners_start = 0;
+      file.read_chunk(1, &owners_start, &owners_dims, owners);
+    }
+    file.prevent_deadlock();
+    broadcast(0, owners, file_num_chunks);
+  }
+
   std::vector<grid_volume> gvs;
   std::vector<int> ids;
   // Populate a vector with the new grid_volumes
-  for (int i = 0; i < num_chunks; ++i) {
+  for (int i = 0; i < file_num_chunks; ++i) {
     int idx = i * 3;
     grid_volume new_gv = gv;
     vec new_origin(new_gv.dim);
@@ -500,11 +496,12 @@ void structure::load_chunk_layout(const char *filename, boundary_region &br) {
     }
     new_gv.set_origin(new_origin);
     gvs.push_back(new_gv);
-    ids.push_back(i * count_processors() / num_chunks);
+    ids.push_back(int(owners[i]));
   }
 
   load_chunk_layout(gvs, ids, br);
 
+  delete[] owners;
   delete[] origins;
   delete[] nums;
 }
@@ -512,10 +509,16 @@ void structure::load_chunk_layout(const char *filename, boundary_region &br) {
 void structure::load_chunk_layout(const std::vector<grid_volume> &gvs,
                                   const std::vector<int> &ids,
                                   boundary_region &br) {
-  if (gvs.size() != size_t(num_chunks)) abort("load_chunk_layout: wrong number of chunks.");
-  // Recreate the chunks with the new grid_volumes
-  for (int i = 0; i < num_chunks; ++i) {
+  // Recreate the chunks with the new grid_volumes, whose number may differ
+  // from the current one (e.g. for a layout from another partitioning method)
+  for (int i = 0; i < num_chunks; ++i)
     if (chunks[i]->refcount-- <= 1) delete chunks[i];
+  if (gvs.size() != size_t(num_chunks)) {
+    delete[] chunks;
+    num_chunks = int(gvs.size());
+    chunks = new structure_chunk *[num_chunks];
+  }
+  for (int i = 0; i < num_chunks; ++i) {
     chunks[i] = new structure_chunk(gvs[i], v, Courant, ids[i] % count_processors());
     br.apply(this, chunks[i]);
   }
@@ -526,194 +529,73 @@ void structure::load(const char *filename) {
   h5file file(filename, h5file::READONLY, true);
 
   if (verbosity > 0) master_printf("reading epsilon from file \"%s\"...\n", filename);
-
-  // make/save a num_chunks x NUM_FIELD_COMPONENTS x 5 array counting
-  // the number of entries in the chi1inv array for each chunk.
-  size_t *num_chi1inv = new size_t[num_chunks * NUM_FIELD_COMPONENTS * 5];
-  int rank;
-  size_t dims[3], _dims[3] = {(size_t)num_chunks, NUM_FIELD_COMPONENTS, 5};
-  size_t start[3] = {0, 0, 0};
-  file.read_size("num_chi1inv", &rank, dims, 3);
-  if (rank != 3 || _dims[0] != dims[0] || _dims[1] != dims[1] || _dims[2] != dims[2])
-    abort("chunk mismatch in structure::load");
-  if (am_master()) file.read_chunk(3, start, dims, num_chi1inv);
-
-  file.prevent_deadlock();
-  broadcast(0, num_chi1inv, dims[0] * dims[1] * dims[2]);
+  if (file.dataset_exists("num_chi1inv"))
+    abort("structure file \"%s\" was written by an older version of Meep", filename);
 
   changing_chunks();
-
-  // allocate data as needed and check sizes
-  size_t my_ntot = 0;
-  for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine()) {
-      size_t ntot = chunks[i]->gv.ntot();
-      for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c)
-        for (int d = 0; d < 5; ++d) {
-          size_t n = num_chi1inv[(i * NUM_FIELD_COMPONENTS + c) * 5 + d];
-          if (n == 0) {
-            delete[] chunks[i]->chi1inv[c][d];
-            chunks[i]->chi1inv[c][d] = NULL;
-          }
-          else {
-            if (n != ntot) abort("grid size mismatch %zd vs %zd in structure::load", n, ntot);
-            chunks[i]->chi1inv[c][d] = new realnum[ntot];
-            my_ntot += ntot;
-          }
+  char dname[64];
+
+  // read each chunk's part of the chi1inv arrays (trivial arrays are not stored)
+  FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+    chi1inv_name(dname, c, d);
+    const bool have = file.dataset_exists(dname);
+    if (have) check_array_size(file, dname, gv);
+    for (int i = 0; i < num_chunks; i++)
+      if (chunks[i]->is_mine()) {
+        realnum *&chi1inv = chunks[i]->chi1inv[c][d];
+        if (have) {
+          if (!chi1inv) chi1inv = new realnum[chunks[i]->gv.ntot()];
+          read_chunk_array(file, gv, chunks[i]->gv, chi1inv);
         }
-    }
-
-  // determine total dataset size and offset of this process's data
-  size_t my_start = partial_sum_to_all(my_ntot) - my_ntot;
-  size_t ntotal = sum_to_all(my_ntot);
-
-  // read the data
-  file.read_size("chi1inv", &rank, dims, 1);
-  if (rank != 1 || dims[0] != ntotal) abort("inconsistent data size in structure::load");
+        else {
+          delete[] chi1inv;
+          chi1inv = NULL;
+        }
+      }
+  }
   for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine()) {
-      size_t ntot = chunks[i]->gv.ntot();
-      for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c)
-        for (int d = 0; d < 5; ++d)
-          if (chunks[i]->chi1inv[c][d]) {
-            file.read_chunk(1, &my_start, &ntot, chunks[i]->chi1inv[c][d]);
-            my_start += ntot;
-          }
-    }
+    if (chunks[i]->is_mine()) FOR_COMPONENTS(c) {
+        remove_trivial_row(chunks[i]->gv, c, chunks[i]->chi1inv[c], 1,
+                           chunks[i]->trivial_chi1inv[c]);
+      }
+
   // Create susceptibilites from params datasets
   set_chiP_from_file(&file, "E_params", E_stuff);
   set_chiP_from_file(&file, "H_params", H_stuff);
 
-  // Read the number of susceptibilities in the chiP lists.
-  size_t num_sus[] = {0, 0};
-  {
-    int rank = 0;
-    size_t dims[] = {0, 0, 0};
-    file.read_size("num_sus", &rank, dims, 1);
-    if (dims[0] > 0) {
-      if (am_master()) {
-        size_t start = 0;
-        size_t count = 2;
-        file.read_chunk(rank, &start, &count, num_sus);
-      }
-    }
-    file.prevent_deadlock();
-    broadcast(0, num_sus, 2);
-  }
-
-  // Allocate and read non-null sigma entry data
-  size_t *num_sigmas[2] = {NULL, NULL};
-  num_sigmas[E_stuff] = new size_t[num_chunks];
-  memset(num_sigmas[E_stuff], 0, sizeof(size_t) * num_chunks);
-  num_sigmas[H_stuff] = new size_t[num_chunks];
-  memset(num_sigmas[H_stuff], 0, sizeof(size_t) * num_chunks);
-
-  // Read num_sigmas data
-  {
-    int rank = 0;
-    size_t dims[] = {0, 0, 0};
-    file.read_size("num_sigmas", &rank, dims, 1);
-    if (dims[0] != (size_t)num_chunks * 2) { abort("inconsistent data size in structure::load"); }
-    if (am_master()) {
-      size_t start = 0;
-      size_t count = num_chunks;
-      file.read_chunk(rank, &start, &count, num_sigmas[E_stuff]);
-      start += count;
-      file.read_chunk(rank, &start, &count, num_sigmas[H_stuff]);
-    }
-    file.prevent_deadlock();
-    broadcast(0, num_sigmas[E_stuff], num_chunks);
-    broadcast(0, num_sigmas[H_stuff], num_chunks);
-  }
-
-  // Allocate space for component and direction data of the non-null susceptibilities
-  size_t *sigma_cd[2] = {NULL, NULL};
-
-  size_t nsig[2] = {0, 0};
-  for (int ft = 0; ft < 2; ++ft) {
-    for (int i = 0; i < num_chunks; ++i) {
-      if (num_sigmas[ft][i] != 0) { nsig[ft] = num_sigmas[ft][i]; }
-    }
-  }
-
-  sigma_cd[E_stuff] = new size_t[nsig[E_stuff] * 2];
-  memset(sigma_cd[E_stuff], 0, sizeof(size_t) * nsig[E_stuff] * 2);
-  sigma_cd[H_stuff] = new size_t[nsig[H_stuff] * 2];
-  memset(sigma_cd[H_stuff], 0, sizeof(size_t) * nsig[H_stuff] * 2);
-
-  // Read the component/direction data
-  {
-    int rank;
-    size_t dims[] = {0, 0, 0};
-    file.read_size("sigma_cd", &rank, dims, 1);
-    if (dims[0] != 2 * (nsig[E_stuff] + nsig[H_stuff])) {
-      abort("inconsistent data size in structure::load");
-    }
-
-    if (am_master()) {
-      size_t start = 0;
-      for (int ft = 0; ft < 2; ++ft) {
-        size_t count = nsig[ft] * 2;
-        file.read_chunk(rank, &start, &count, sigma_cd[ft]);
-        start += count;
-      }
-    }
-    file.prevent_deadlock();
-    broadcast(0, sigma_cd[E_stuff], nsig[E_stuff] * 2);
-    broadcast(0, sigma_cd[H_stuff], nsig[H_stuff] * 2);
-  }
-
-  for (int ft = 0; ft < 2; ++ft) {
-    for (int i = 0; i < num_chunks; ++i) {
-      for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c) {
-        for (int d = 0; d < 5; ++d) {
-          susceptibility *sus = chunks[i]->chiP[ft];
-          while (sus) {
-            for (size_t j = 0; j < nsig[ft] * 2; j += 2) {
-              int _c = sigma_cd[ft][j];
-              int _d = sigma_cd[ft][j + 1];
-              sus->trivial_sigma[_c][_d] = false;
-            }
-            sus = sus->next;
+  for (int ft = 0; ft < 2; ++ft)
+    for (int j = 0; j < num_susceptibilities(chunks[0]->chiP[ft]); ++j) {
+      FOR_COMPONENTS(c) FOR_DIRECTIONS(d) {
+        sigma_name(dname, ft, j, c, d);
+        if (!file.dataset_exists(dname)) continue;
+        check_array_size(file, dname, gv);
+        for (int i = 0; i < num_chunks; i++)
+          if (chunks[i]->is_mine()) {
+            susceptibility *sus = nth_susceptibility(chunks[i]->chiP[ft], j);
+            sus->sigma[c][d] = new realnum[chunks[i]->gv.ntot()];
+            read_chunk_array(file, gv, chunks[i]->gv, sus->sigma[c][d]);
           }
-        }
       }
-    }
-  }
 
-  // Load sigma data
-  for (int ft = 0; ft < 2; ++ft) {
-    for (int i = 0; i < num_chunks; ++i) {
-      for (int c = 0; c < NUM_FIELD_COMPONENTS; ++c) {
-        for (int d = 0; d < 5; ++d) {
-          char dname[20];
-          snprintf(dname, 20, "%c_%d_sigma_%d_%d", ft == 0 ? 'E' : 'H', i, c, d);
-          if (file.dataset_exists(dname)) {
-            int rank;
-            size_t dims[3] = {0, 0, 0};
-            file.read_size(dname, &rank, dims, 1);
-            if (num_sigmas[ft][i] && chunks[i]->is_mine()) {
-              susceptibility *sus = chunks[i]->chiP[ft];
-              size_t start = 0;
-              while (sus) {
-                size_t count = chunks[i]->gv.ntot();
-                if (sus->sigma[c][d]) { delete[] sus->sigma[c][d]; }
-                sus->sigma[c][d] = new realnum[count];
-                sus->trivial_sigma[c][d] = false;
-                file.read_chunk(rank, &start, &count, sus->sigma[c][d]);
-                sus = sus->next;
-                start += count;
-              }
-            }
+      // trivial_sigma is true only if sigma is trivial on every chunk (see add_susceptibility)
+      int trivial[NUM_FIELD_COMPONENTS][5];
+      FOR_COMPONENTS(c) FOR_DIRECTIONS(d) { trivial[c][d] = true; }
+      for (int i = 0; i < num_chunks; i++)
+        if (chunks[i]->is_mine()) {
+          susceptibility *sus = nth_susceptibility(chunks[i]->chiP[ft], j);
+          FOR_COMPONENTS(c) {
+            bool chunk_trivial[5];
+            remove_trivial_row(chunks[i]->gv, c, sus->sigma[c], 0, chunk_trivial);
+            FOR_DIRECTIONS(d) { trivial[c][d] = trivial[c][d] && chunk_trivial[d]; }
           }
         }
+      int trivial_sync[NUM_FIELD_COMPONENTS][5];
+      file.prevent_deadlock();
+      and_to_all(&trivial[0][0], &trivial_sync[0][0], NUM_FIELD_COMPONENTS * 5);
+      for (int i = 0; i < num_chunks; i++) {
+        susceptibility *sus = nth_susceptibility(chunks[i]->chiP[ft], j);
+        FOR_COMPONENTS(c) FOR_DIRECTIONS(d) { sus->trivial_sigma[c][d] = trivial_sync[c][d]; }
       }
     }
-  }
-
-  for (int ft = 0; ft < 2; ++ft) {
-    delete[] num_sigmas[ft];
-    delete[] sigma_cd[ft];
-  }
 }
 } // namespace meep
@@ -26,6 +26,7 @@
    array.  The meep::fields class is responsible for allocating P and
    sigma and passing them to susceptibility::update_P. */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "meep.hpp"
@@ -157,6 +158,12 @@ void *lorentzian_susceptibility::copy_internal_data(void *data) const {
   return (void *)dnew;
 }
 
+realnum *lorentzian_susceptibility::internal_data_values(void *data, size_t *n) const {
+  lorentzian_data *d = (lorentzian_data *)data;
+  *n = (d->sz_data - offsetof(lorentzian_data, data)) / sizeof(realnum);
+  return d->data;
+}
+
 #if 0
 /* Return true if the discretized Lorentzian ODE is intrinsically unstable,
    i.e. if it corresponds to a filter with a pole z outside the unit circle.
@@ -431,6 +438,12 @@ void *gyrotropic_susceptibility::copy_internal_data(void *data) const {
   return (void *)dnew;
 }
 
+realnum *gyrotropic_susceptibility::internal_data_values(void *data, size_t *n) const {
+  gyrotropy_data *d = (gyrotropy_data *)data;
+  *n = (d->sz_data - offsetof(gyrotropy_data, data)) / sizeof(realnum);
+  return d->data;
+}
+
 bool gyrotropic_susceptibility::needs_P(component c, int cmp,
                                         realnum *W[NUM_FIELD_COMPONENTS][2]) const {
   if (!is_electric(c) && !is_magnetic(c)) return false;
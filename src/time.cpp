@@ -67,6 +67,15 @@ double fields::mean_time_spent_on(time_sink s) {
   return total_time_spent / n;
 }
 
+// wall time spent timestepping each chunk (by its owner) since the last rebalancing
+std::vector<double> fields::time_spent_on_chunks() {
+  std::vector<double> time_spent_per_chunk(num_chunks), temp(num_chunks);
+  for (int i = 0; i < num_chunks; ++i)
+    temp[i] = chunks[i]->is_mine() ? chunks[i]->step_time : 0;
+  sum_to_all(&temp[0], &time_spent_per_chunk[0], num_chunks);
+  return time_spent_per_chunk;
+}
+
 static const char *ts2n(time_sink s) {
   switch (s) {
     case Stepping: return "time stepping";
@@ -19,6 +19,7 @@
 
 #include "meep.hpp"
 #include "meep_internals.hpp"
+#include "config.h"
 
 using namespace std;
 
@@ -26,10 +27,18 @@ namespace meep {
 
 void fields::update_eh(field_type ft, bool skip_w_components) {
   if (ft != E_stuff && ft != H_stuff) abort("update_eh only works with E/H");
-  for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine())
-      if (chunks[i]->update_eh(ft, skip_w_components))
-        chunk_connections_valid = false; // E/H allocated - reconnect chunks
+  const std::vector<int> order = my_chunks_by_time();
+  bool allocated = false;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(|| : allocated)
+#endif
+  for (size_t j = 0; j < order.size(); j++) {
+    const int i = order[j];
+    double start = wall_time();
+    if (chunks[i]->update_eh(ft, skip_w_components)) allocated = true;
+    chunks[i]->step_time += wall_time() - start;
+  }
+  if (allocated) chunk_connections_valid = false; // E/H allocated - reconnect chunks
 }
 
 bool fields_chunk::needs_W_prev(component c) const {
@@ -28,9 +28,18 @@ using namespace std;
 namespace meep {
 
 void fields::update_pols(field_type ft) {
-  for (int i = 0; i < num_chunks; i++)
-    if (chunks[i]->is_mine())
-      if (chunks[i]->update_pols(ft)) chunk_connections_valid = false;
+  const std::vector<int> order = my_chunks_by_time();
+  bool allocated = false;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(|| : allocated)
+#endif
+  for (size_t j = 0; j < order.size(); j++) {
+    const int i = order[j];
+    double start = wall_time();
+    if (chunks[i]->update_pols(ft)) allocated = true;
+    chunks[i]->step_time += wall_time() - start;
+  }
+  if (allocated) chunk_connections_valid = false;
 }
 
 bool fields_chunk::update_pols(field_type ft) {
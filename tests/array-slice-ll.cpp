@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <complex>
 
 #include "meep.hpp"
@@ -238,6 +239,61 @@ int main(int argc, char *argv[]) {
     double RelErr2D = Compare(slice2d_realnum, file_slice2d, NX * NY, "Sy_2d");
     master_printf("2D: rel error %e\n", RelErr2D);
 
+    //
+    // write the 2D slice directly into a column-major buffer
+    //
+    ptrdiff_t strides[2] = {1, NX};
+    double *slice2d_transposed = new double[NX * NY];
+    f.get_array_slice(v2d, Sy, slice2d_transposed, 0, true, strides);
+    for (int i = 0; i < NX; ++i)
+      for (int j = 0; j < NY; ++j)
+        if (slice2d_transposed[i + j * NX] != slice2d[i * NY + j])
+          abort("strided 2D slice differs at (%d,%d): %g vs. %g", i, j,
+                slice2d_transposed[i + j * NX], slice2d[i * NY + j]);
+    delete[] slice2d_transposed;
+    master_printf("2D: strided slice is identical\n");
+
+    //
+    // the sum of the blocks of each process is the slice, for the 2D
+    // slice and for the 1D slice without snapping (interpolated across
+    // the empty y dimension)
+    //
+    std::vector<array_slice_box> boxes = f.get_array_slice_boxes(v2d, Sy, 0, true);
+    double *sum2d = new double[NX * NY]();
+    for (size_t n = 0; n < boxes.size(); ++n) {
+      const array_slice_box &b = boxes[n];
+      for (size_t i = 0; i < b.count[0]; ++i)
+        for (size_t j = 0; j < b.count[1]; ++j)
+          sum2d[(b.start[0] + i) * NY + b.start[1] + j] += b.data[i * b.count[1] + j];
+      delete[] b.data;
+    }
+    for (int i = 0; i < NX * NY; ++i)
+      if (sum_to_all(sum2d[i]) != slice2d[i])
+        abort("2D slice blocks differ at %d: %g vs. %g", i, sum_to_all(sum2d[i]), slice2d[i]);
+    delete[] sum2d;
+
+    std::complex<double> *slice1d_interp = f.get_complex_array_slice(v1d, Hz);
+    boxes = f.get_array_slice_boxes(v1d, Hz, 0, false, true);
+    std::complex<double> *sum1d = new std::complex<double>[NX]();
+    for (size_t n = 0; n < boxes.size(); ++n) {
+      const array_slice_box &b = boxes[n];
+      if (b.count[1] != 1 || b.count[2] != 1) abort("1D slice block is not 1D");
+      for (size_t i = 0; i < b.count[0]; ++i)
+        sum1d[b.start[0] + i] += std::complex<double>(b.data[2 * i], b.data[2 * i + 1]);
+      delete[] b.data;
+    }
+    double max1d = 0;
+    for (int i = 0; i < NX; ++i)
+      max1d = std::max(max1d, abs(slice1d_interp[i]));
+    for (int i = 0; i < NX; ++i) {
+      std::complex<double> val(sum_to_all(real(sum1d[i])), sum_to_all(imag(sum1d[i])));
+      if (abs(val - slice1d_interp[i]) > 1e-14 * max1d)
+        abort("1D slice blocks differ at %d: %g vs. %g", i, abs(val), abs(slice1d_interp[i]));
+    }
+    delete[] sum1d;
+    delete[] slice1d_interp;
+    master_printf("1D and 2D: slice blocks sum to the slice\n");
+
   }; // if (write_files) ... else ...
 
   return 0;
@@ -0,0 +1,94 @@
+/* Check saving and loading the chunk cost weights of fragment_stats
+   (including the handling of comments, unknown names, and missing files),
+   and a quick calibration run. */
+
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "meep.hpp"
+
+#include "ctl-math.h"
+#include "ctlgeom.h"
+
+#include "meepgeom.hpp"
+
+using namespace meep;
+using meep_geom::fragment_stats;
+
+static const int N = fragment_stats::NUM_COST_WEIGHTS;
+
+static void check_weights(const double *w, const char *what) {
+  for (int i = 0; i < N; ++i)
+    if (fabs(fragment_stats::cost_weights[i] - w[i]) > 1e-7 * fabs(w[i]))
+      abort("%s: cost weight %s is %g instead of %g", what, fragment_stats::cost_weight_names[i],
+            fragment_stats::cost_weights[i], w[i]);
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  verbosity = 0;
+
+  char *dir = make_output_directory();
+  const std::string fname = std::string(dir) + "/cost_weights";
+
+  // don't read (or write) the weights of the user
+  setenv("MEEP_COST_WEIGHTS", (std::string(dir) + "/missing").c_str(), 1);
+  fragment_stats::init_cost_weights();
+
+  double w0[N], w[N];
+  for (int i = 0; i < N; ++i)
+    w0[i] = fragment_stats::cost_weights[i];
+
+  // a missing file leaves the weights unchanged
+  if (fragment_stats::load_cost_weights((std::string(dir) + "/missing").c_str()))
+    abort("load_cost_weights succeeded for a missing file");
+  check_weights(w0, "missing file");
+
+  // save, change, and reload the weights
+  fragment_stats::save_cost_weights(fname.c_str());
+  for (int i = 0; i < N; ++i)
+    fragment_stats::cost_weights[i] = i + 1;
+  if (!fragment_stats::load_cost_weights(fname.c_str())) abort("cannot load %s", fname.c_str());
+  check_weights(w0, "saved weights");
+
+  // only the weights in the file are changed; comments and unknown names are skipped
+  if (am_master()) {
+    FILE *f = fopen(fname.c_str(), "w");
+    if (!f) abort("cannot write %s", fname.c_str());
+    fprintf(f, "# a comment\n");
+    fprintf(f, "dft 2.5e-4\n");
+    fprintf(f, "no_such_weight 3.0\n");
+    fprintf(f, "pml_2d\n");
+    fprintf(f, "pixels_in_box 7.25e-4 # trailing comment\n");
+    fclose(f);
+  }
+  all_wait();
+  for (int i = 0; i < N; ++i)
+    w[i] = w0[i];
+  w[fragment_stats::DFT_COST] = 2.5e-4;
+  w[fragment_stats::PIXEL_COST] = 7.25e-4;
+  if (!fragment_stats::load_cost_weights(fname.c_str())) abort("cannot load %s", fname.c_str());
+  check_weights(w, "edited file");
+
+  // calibration keeps the weight of a plain pixel, and saves the weights
+  const double pixel_cost = fragment_stats::cost_weights[fragment_stats::PIXEL_COST];
+  fragment_stats::calibrate_cost_weights(fname.c_str(), 4, 1);
+  for (int i = 0; i < N; ++i) {
+    w[i] = fragment_stats::cost_weights[i];
+    if (!std::isfinite(w[i]) || w[i] < 0)
+      abort("calibrated cost weight %s = %g", fragment_stats::cost_weight_names[i], w[i]);
+    master_printf("%s: %g\n", fragment_stats::cost_weight_names[i], w[i]);
+  }
+  if (w[fragment_stats::PIXEL_COST] != pixel_cost)
+    abort("calibration changed the pixel cost %g to %g", pixel_cost, w[fragment_stats::PIXEL_COST]);
+  for (int i = 0; i < N; ++i)
+    fragment_stats::cost_weights[i] = 0;
+  if (!fragment_stats::load_cost_weights(fname.c_str())) abort("cannot load %s", fname.c_str());
+  check_weights(w, "calibrated weights");
+
+  delete_directory(dir);
+  delete[] dir;
+  return 0;
+}
@@ -36,7 +36,7 @@ double dummy_eps(const vec &) { return 1.0; }
 /***************************************************************/
 /***************************************************************/
 void Run(bool Pulse, double resolution, cdouble **field_array = 0, int *array_rank = 0,
-         size_t *array_dims = 0) {
+         size_t *array_dims = 0, double *single_error = 0) {
   /***************************************************************/
   /* initialize geometry                                         */
   /***************************************************************/
@@ -81,10 +81,27 @@ void Run(bool Pulse, double resolution, cdouble **field_array = 0, int *array_ra
     component components[6] = {Ex, Ey, Ez, Hx, Hy, Hz};
     dft_fields dftFields = f.add_dft_fields(components, 6, f.v, fcen, fcen, 1);
     dft_flux dftFlux = f.add_dft_flux(X, f.v, fcen, fcen, 1);
+    f.set_dft_single_precision(true);
+    dft_fields dftSingle = f.add_dft_fields(components + 2, 1, f.v, fcen, fcen, 1);
 
     while (f.round_time() < f.last_source_time() + 100.0)
       f.step();
 
+    /* L2 norm of the difference between the single- and double-precision
+       DFTs of Ez, relative to the L2 norm of the latter */
+    int rank;
+    size_t dims[3];
+    cdouble *ez = f.get_dft_array(dftFields, Ez, 0, &rank, dims);
+    cdouble *ez_single = f.get_dft_array(dftSingle, Ez, 0, &rank, dims);
+    double normdiff = 0.0, norm = 0.0;
+    for (size_t i = 0; i < dims[0] * dims[1]; i++) {
+      normdiff += std::norm(ez_single[i] - ez[i]);
+      norm += std::norm(ez[i]);
+    }
+    *single_error = sqrt(normdiff / norm);
+    delete[] ez_single;
+    delete[] ez;
+
     f.output_dft(dftFlux, "dft-flux");
     f.output_dft(dftFields, "dft-fields");
 
@@ -238,7 +255,8 @@ int main(int argc, char *argv[]) {
   cdouble *field_array = 0;
   int array_rank;
   size_t array_dims[3];
-  Run(true, resolution, &field_array, &array_rank, array_dims);
+  double L2ErrorSingle;
+  Run(true, resolution, &field_array, &array_rank, array_dims, &L2ErrorSingle);
   Run(false, resolution);
 
   /* compare DFT field array to DFT HDF5 output */
@@ -251,6 +269,7 @@ int main(int argc, char *argv[]) {
   double L2ErrorFile =
       compare_complex_hdf5_datasets("dft-fields.h5", "ez_0", "cw-fields.h5", "ez", 2, &max_dft);
   if (verbose) master_printf("L2Error (file<-->file) = %e\n", L2ErrorFile);
+  if (verbose) master_printf("L2Error (single<-->double) = %e\n", L2ErrorSingle);
 
   bool unit_test = (argc == 1); // run unit-test checks if no command-line arguments
   if (unit_test) {
@@ -281,6 +300,12 @@ int main(int argc, char *argv[]) {
       return -1;
     }
 
+    if (L2ErrorSingle > 1.0e-5) {
+      master_printf("L2 norm of single-double precision error=%e (should be <1e-5)\n",
+                    L2ErrorSingle);
+      return -1;
+    }
+
     return 0;
   }
 }
@@ -0,0 +1,120 @@
+/* Check that a run restarted from a checkpoint of the fields (fields::dump
+   and fields::load, with PML, dispersive materials, and DFT monitors in
+   the middle of a batch) is identical to the uninterrupted run, and that
+   a structure loaded (structure::load) into a different number of chunks
+   than it was dumped from is identical to the initialized structure. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <meep.hpp>
+using namespace meep;
+using std::complex;
+using std::vector;
+
+static double eps(const vec &p) { return fabs(p.x() - 4) < 1 ? 4.0 : 1.0; }
+static double sigma(const vec &p) { return p.y() > 3 ? 0.5 : 0.0; }
+
+static void run(const char *dump_file, const char *load_file, bool real_fields,
+                vector<complex<double> > &vals, double *flx) {
+  grid_volume gv = vol2d(8, 6, 10);
+  structure s(gv, eps, pml(1.0), identity(), 4);
+  s.add_susceptibility(sigma, E_stuff, lorentzian_susceptibility(1.1, 0.1));
+  fields f(&s);
+  if (real_fields) f.use_real_fields();
+  f.set_dft_batch_size(8);
+  gaussian_src_time src(0.8, 0.5);
+  f.add_point_source(Ez, src, vec(2.1, 2.3));
+  f.add_point_source(Hz, src, vec(5.2, 4.1));
+  dft_flux flux = f.add_dft_flux_plane(volume(vec(6.5, 1), vec(6.5, 5)), 0.6, 1.0, 3);
+
+  if (load_file)
+    f.load(load_file);
+  else
+    while (f.time() < 6.3)
+      f.step();
+  if (dump_file) f.dump(dump_file);
+  while (f.time() < 14)
+    f.step();
+
+  vals.clear();
+  for (double x = 0.35; x < 8; x += 0.9)
+    for (double y = 0.25; y < 6; y += 0.7) {
+      vals.push_back(f.get_field(Ez, vec(x, y)));
+      vals.push_back(f.get_field(Hz, vec(x, y)));
+      vals.push_back(f.get_field(Ex, vec(x, y)));
+    }
+  double *F = flux.flux();
+  for (int i = 0; i < 3; ++i)
+    flx[i] = F[i];
+  delete[] F;
+}
+
+static double eps_disk(const vec &p) {
+  return (p.x() - 4) * (p.x() - 4) + (p.y() - 3) * (p.y() - 3) < 2.2 ? 6.0 : 1.0;
+}
+static double one(const vec &) { return 1.0; }
+
+static void run_structure(int num_chunks, const char *dump_file, const char *load_file,
+                          vector<complex<double> > &vals) {
+  grid_volume gv = vol2d(8, 6, 10);
+  structure s(gv, load_file ? one : eps_disk, pml(1.0), identity(), num_chunks, 0.5, true);
+  if (load_file)
+    s.load(load_file);
+  else
+    s.add_susceptibility(sigma, E_stuff, lorentzian_susceptibility(1.1, 0.1));
+  if (dump_file) s.dump(dump_file);
+  fields f(&s);
+  gaussian_src_time src(0.8, 0.5);
+  f.add_point_source(Ez, src, vec(2.1, 2.3));
+  f.add_point_source(Hz, src, vec(5.2, 4.1));
+  while (f.time() < 10)
+    f.step();
+  vals.clear();
+  for (double x = 0.35; x < 8; x += 0.9)
+    for (double y = 0.25; y < 6; y += 0.7) {
+      vals.push_back(f.get_field(Ez, vec(x, y)));
+      vals.push_back(f.get_field(Hz, vec(x, y)));
+    }
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  verbosity = 0;
+  const char *temp_dir = make_output_directory();
+  char fname[512];
+  snprintf(fname, 512, "%s/fields.h5", temp_dir);
+  for (int real_fields = 0; real_fields < 2; ++real_fields) {
+    vector<complex<double> > vals0, vals1;
+    double flx0[3], flx1[3];
+    run(fname, NULL, real_fields, vals0, flx0);
+    run(NULL, fname, real_fields, vals1, flx1);
+    double maxval = 0;
+    for (size_t i = 0; i < vals0.size(); ++i) {
+      maxval = std::max(maxval, abs(vals0[i]));
+      if (vals0[i] != vals1[i])
+        abort("fields changed by dump/load: %g%+gi vs. %g%+gi", real(vals0[i]), imag(vals0[i]),
+              real(vals1[i]), imag(vals1[i]));
+    }
+    master_printf("%s fields: restarted run is identical (max field %g)\n",
+                  real_fields ? "real" : "complex", maxval);
+    for (int i = 0; i < 3; ++i)
+      if (flx0[i] != flx1[i]) abort("flux changed by dump/load: %g vs. %g", flx0[i], flx1[i]);
+  }
+
+  snprintf(fname, 512, "%s/structure.h5", temp_dir);
+  vector<complex<double> > vals;
+  run_structure(4, fname, NULL, vals);
+  for (int num_chunks = 1; num_chunks <= 3; num_chunks += 2) {
+    vector<complex<double> > vals0, vals1;
+    run_structure(num_chunks, NULL, NULL, vals0);
+    run_structure(num_chunks, NULL, fname, vals1);
+    for (size_t i = 0; i < vals0.size(); ++i)
+      if (vals0[i] != vals1[i])
+        abort("structure changed by dump/load into %d chunks: %g%+gi vs. %g%+gi", num_chunks,
+              real(vals0[i]), imag(vals0[i]), real(vals1[i]), imag(vals1[i]));
+    master_printf("structure loaded into %d chunks is identical\n", num_chunks);
+  }
+  delete_directory(temp_dir);
+  return 0;
+}
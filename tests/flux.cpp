@@ -225,6 +225,162 @@ int flux_2d(const double xmax, const double ymax, double eps(const vec &)) {
   return 1;
 }
 
+/* flux spectrum of two sources through a box, with the DFTs accumulated
+   in batches of timesteps and/or only every decimation timesteps, and
+   optionally stored in single precision or computed from recorded time
+   series of time_series samples */
+double *dft_flux_2d(const double xmax, const double ymax, double eps(const vec &), int Nfreq,
+                    int batch_size, int decimation, bool single_precision = false,
+                    int time_series = 0) {
+  grid_volume gv = voltwo(xmax, ymax, 8.0);
+  structure s(gv, eps, pml(0.5));
+  fields f(&s);
+  gaussian_src_time src(0.25, 0.1);
+  f.add_point_source(Ez, src, vec(xmax / 6 + 0.1, ymax / 6 + 0.3));
+  f.add_point_source(Hz, src, vec(xmax / 3 + 0.2, ymax / 2 + 0.1));
+  f.set_dft_batch_size(batch_size);
+  f.set_dft_decimation(decimation);
+  f.set_dft_single_precision(single_precision);
+  volume box(vec(xmax / 6 - 0.9, ymax / 6 - 0.7), vec(2 * xmax / 3, 2 * ymax / 3));
+  if (decimation == 0) { // the sources are band-limited, so decimation must be chosen
+    std::vector<double> freq = linspace(0.2, 0.3, Nfreq);
+    const int k = f.dft_decimation_factor(freq.data(), Nfreq);
+    master_printf("automatic DFT decimation factor %d\n", k);
+    if (k <= 1) abort("no automatic DFT decimation for band-limited sources");
+  }
+  dft_flux flux = f.add_dft_flux_box(box, 0.2, 0.3, Nfreq);
+  if (time_series) flux.record_time_series(time_series);
+  while (f.time() < 150) // until the fields have decayed, so that the spectrum is band-limited
+    f.step();
+  return flux.flux();
+}
+
+static std::complex<double> custom_dipole(double t, void *data) {
+  (void)data;
+  return exp(-t * t);
+}
+
+/* check that accumulating the DFT in batches of timesteps (flushed by
+   flux(), including a partial last batch) gives the same flux spectrum,
+   that decimation (chosen automatically from the bandwidth) changes it
+   only slightly, and that single-precision storage (rounding the sum once
+   per batch) changes it by about the float roundoff of each batch */
+int batched_dft_2d(const double xmax, const double ymax, double eps(const vec &)) {
+  master_printf("\nBatched, decimated, and single-precision DFT test...\n");
+  const int Nfreq = 20;
+  double *fl0 = dft_flux_2d(xmax, ymax, eps, Nfreq, 1, 1);
+  double *fl1 = dft_flux_2d(xmax, ymax, eps, Nfreq, 13, 1);
+  double *fl2 = dft_flux_2d(xmax, ymax, eps, Nfreq, 5, 0);
+  double *fl3 = dft_flux_2d(xmax, ymax, eps, Nfreq, 1, 1, true);
+  double *fl4 = dft_flux_2d(xmax, ymax, eps, Nfreq, 13, 1, true);
+
+  // no automatic decimation for a source of unknown bandwidth
+  grid_volume gv = voltwo(xmax, ymax, 8.0);
+  structure s(gv, eps, pml(0.5));
+  fields f(&s);
+  custom_src_time src(custom_dipole, NULL);
+  f.add_point_source(Ez, src, vec(xmax / 6 + 0.1, ymax / 6 + 0.3));
+  std::vector<double> freq = linspace(0.2, 0.3, Nfreq);
+  if (f.dft_decimation_factor(freq.data(), Nfreq) != 1)
+    abort("automatic DFT decimation for a custom source");
+
+  int ok = 1;
+  for (int i = 0; i < Nfreq && ok; ++i)
+    ok = compare(fl1[i], fl0[i], 1e-10, 1e-20, "Batched flux spectrum") &&
+         compare(fl2[i], fl0[i], 1e-3, 1e-20, "Decimated flux spectrum") &&
+         compare(fl3[i], fl0[i], 1e-5, 1e-20, "Single-precision flux spectrum") &&
+         compare(fl4[i], fl0[i], 1e-6, 1e-20, "Batched single-precision flux spectrum");
+  delete[] fl4;
+  delete[] fl3;
+  delete[] fl2;
+  delete[] fl1;
+  delete[] fl0;
+  return ok;
+}
+
+/* check that the flux spectrum from recorded time series (in batches of
+   1000 samples plus a partial batch, transformed with FFTs) is the same */
+int time_series_dft_2d(const double xmax, const double ymax, double eps(const vec &)) {
+  master_printf("\nTime-series DFT test...\n");
+  const int Nfreq = 500;
+  double *fl0 = dft_flux_2d(xmax, ymax, eps, Nfreq, 1, 1);
+  double *fl1 = dft_flux_2d(xmax, ymax, eps, Nfreq, 1, 1, false, 1000);
+  double *fl2 = dft_flux_2d(xmax, ymax, eps, 3, 1, 1, false, 1000);
+  double *fl3 = dft_flux_2d(xmax, ymax, eps, 3, 1, 1);
+  double maxflux = 0;
+  for (int i = 0; i < Nfreq; ++i)
+    maxflux = std::max(maxflux, fabs(fl0[i]));
+  int ok = 1;
+  for (int i = 0; i < Nfreq && ok; ++i)
+    ok = compare(fl1[i], fl0[i], 1e-8, 1e-10 * maxflux, "Time-series flux spectrum");
+  for (int i = 0; i < 3 && ok; ++i) // (few frequencies: no FFTs)
+    ok = compare(fl2[i], fl3[i], 1e-10, 1e-20, "Time-series flux spectrum (3 frequencies)");
+  delete[] fl3;
+  delete[] fl2;
+  delete[] fl1;
+  delete[] fl0;
+  return ok;
+}
+
+/* check that a dft_fields volume storing only every stride-th point gives
+   the same values as the corresponding points of the full DFT grid (also
+   for mirror symmetry and a volume that is empty in one direction), and
+   that get_array_metadata describes the coarser grid */
+int strided_dft_fields_2d(const double xmax, const double ymax, double eps(const vec &),
+                          bool use_symmetry) {
+  master_printf("\nStrided DFT fields test (%s symmetry)...\n", use_symmetry ? "with" : "no");
+  const int stride = 3;
+  grid_volume gv = voltwo(xmax, ymax, 8.0);
+  structure s(gv, eps, pml(0.5), use_symmetry ? mirror(Y, gv) : identity());
+  fields f(&s);
+  gaussian_src_time src(0.25, 0.1);
+  f.add_point_source(Ez, src, vec(xmax / 3 + 0.2, ymax / 2));
+  component c = Ez;
+  volume vols[2] = {volume(vec(1.13, 0.71), vec(xmax - 1.4, ymax - 0.9)),
+                    volume(vec(0.83, 0.4), vec(xmax - 2.1, 0.4))};
+  for (int iv = 0; iv < 2; ++iv) {
+    dft_fields full = f.add_dft_fields(&c, 1, vols[iv], 0.2, 0.3, 3);
+    dft_fields coarse = f.add_dft_fields(&c, 1, vols[iv], 0.2, 0.3, 3, true, stride);
+    while (f.time() < 10 * (iv + 1))
+      f.step();
+    int rank, crank;
+    size_t dims[3], cdims[3];
+    std::complex<double> *a = f.get_dft_array(full, c, 2, &rank, dims);
+    std::complex<double> *ca = f.get_dft_array(coarse, c, 2, &crank, cdims);
+    if (crank != rank) abort("wrong rank %d of strided DFT array", crank);
+    if (rank == 1) dims[1] = cdims[1] = 1; // (the empty direction is collapsed)
+    for (int i = 0; i < rank; ++i)
+      if (cdims[i] != (dims[i] - 1) / stride + 1) abort("wrong dimensions of strided DFT array");
+    double maxval = 0, maxdiff = 0;
+    for (size_t i = 0; i < cdims[0] * cdims[1]; ++i) {
+      size_t j = (i / cdims[1]) * stride * dims[1] + (i % cdims[1]) * stride;
+      maxval = std::max(maxval, abs(a[j]));
+      maxdiff = std::max(maxdiff, abs(ca[i] - a[j]));
+    }
+    delete[] ca;
+    delete[] a;
+    master_printf("max difference %g (max DFT field %g)\n", maxdiff, maxval);
+    if (maxval == 0 || maxdiff > 1e-14 * maxval) return 0;
+
+    std::vector<double> m = f.get_array_metadata(vols[iv]);
+    std::vector<double> cm = f.get_array_metadata(vols[iv], stride);
+    size_t nx = size_t(m[0]), cnx = size_t(cm[0]);
+    if (cnx != (nx - 1) / stride + 1 || cm[1 + cnx] != (iv == 1 ? 1 : cdims[1]))
+      abort("wrong grid in strided array metadata");
+    if (cm[1] != m[1] || fabs(cm[2] - cm[1] - stride / f.gv.a) > 1e-12)
+      abort("wrong strided grid points");
+    double wsum = 0, cwsum = 0;
+    for (size_t i = m.size() - nx * size_t(m[1 + nx]); i < m.size(); ++i)
+      wsum += m[i];
+    for (size_t i = cm.size() - cnx * size_t(cm[1 + cnx]); i < cm.size(); ++i)
+      cwsum += cm[i];
+    if (!compare(cwsum, wsum, 1e-12, 0, "Sum of strided weights")) return 0;
+    full.remove();
+    coarse.remove();
+  }
+  return 1;
+}
+
 int flux_cyl(const double rmax, const double zmax, double eps(const vec &), int m) {
   const double a = 8.0;
 
@@ -320,6 +476,10 @@ int main(int argc, char **argv) {
 
   width = 5.0;
   attempt("Flux 2D 5", flux_2d(10.0, 10.0, bump2));
+  attempt("Batched, decimated, and single-precision DFT 2D", batched_dft_2d(10.0, 10.0, bump2));
+  attempt("Time-series DFT 2D", time_series_dft_2d(10.0, 10.0, bump2));
+  attempt("Strided DFT fields 2D", strided_dft_fields_2d(10.0, 8.0, one, false));
+  attempt("Strided DFT fields 2D with symmetry", strided_dft_fields_2d(10.0, 8.0, one, true));
 
   width = 5.0;
   attempt("Flux cylindrical 5", flux_cyl(20.0, 10.0, bump2, 1));
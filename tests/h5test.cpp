@@ -59,11 +59,12 @@ double get_reim(complex<double> x, int reim) { return reim ? imag(x) : real(x);
 
 bool check_2d(double eps(const vec &), double a, int splitting, symfunc Sf, double kx, double ky,
               component src_c, int file_c, volume file_gv, bool real_fields, int expected_rank,
-              const char *name, const char *mydirname) {
+              const char *name, const char *mydirname, bool async = false) {
   const grid_volume gv = vol2d(xsize, ysize, a);
   structure s(gv, eps, no_pml(), Sf(gv), splitting);
   s.set_output_directory(mydirname);
   fields f(&s);
+  if (async) f.set_output_async(true, 1024); // small queue, to also test waiting on it
 
   f.use_bloch(X, real_fields ? 0.0 : kx);
   f.use_bloch(Y, real_fields ? 0.0 : ky);
@@ -171,11 +172,12 @@ bool check_2d(double eps(const vec &), double a, int splitting, symfunc Sf, doub
 
 bool check_3d(double eps(const vec &), double a, int splitting, symfunc Sf, component src_c,
               int file_c, volume file_gv, bool real_fields, int expected_rank, const char *name,
-              const char *mydirname) {
+              const char *mydirname, bool async = false) {
   const grid_volume gv = vol3d(xsize, ysize, zsize, a);
   structure s(gv, eps, no_pml(), Sf(gv), splitting);
   s.set_output_directory(mydirname);
   fields f(&s);
+  if (async) f.set_output_async(true, 1024); // small queue, to also test waiting on it
 
   if (real_fields) f.use_real_fields();
   f.add_point_source(src_c, 0.3, 2.0, 0.0, 1.0, gv.center(), 1.0, 1);
@@ -279,11 +281,12 @@ bool check_3d(double eps(const vec &), double a, int splitting, symfunc Sf, comp
 
 bool check_2d_monitor(double eps(const vec &), double a, int splitting, symfunc Sf, component src_c,
                       int file_c, const vec &pt, bool real_fields, const char *name,
-                      const char *mydirname) {
+                      const char *mydirname, bool async = false) {
   const grid_volume gv = vol2d(xsize, ysize, a);
   structure s(gv, eps, no_pml(), Sf(gv), splitting);
   s.set_output_directory(mydirname);
   fields f(&s);
+  if (async) f.set_output_async(true, 1024); // small queue, to also test waiting on it
 
   if (real_fields) f.use_real_fields();
   f.add_point_source(src_c, 0.3, 2.0, 0.0, 1.0, gv.center(), 1.0, 1);
@@ -356,6 +359,66 @@ bool check_2d_monitor(double eps(const vec &), double a, int splitting, symfunc
   return 1;
 }
 
+/* Check compressed output of an appended movie of Ez: lossless compression
+   must reproduce the uncompressed data exactly, and lossy compression must
+   be within its absolute error tolerance (and smaller). */
+bool check_compression(double a, int splitting, const char *mydirname) {
+  const grid_volume gv = vol2d(xsize, ysize, a);
+  structure s(gv, funky_eps_2d, no_pml(), identity(), splitting);
+  s.set_output_directory(mydirname);
+  fields f(&s);
+  if (splitting % 2 && count_processors() == 1) f.set_output_async(true, 1024);
+  f.use_real_fields();
+  f.add_point_source(Ez, 0.3, 2.0, 0.0, 1.0, gv.center(), 1.0, 1);
+
+  const char *names[3] = {"compress_none", "compress_deflate", "compress_lossy"};
+  const double tol = 1e-3;
+  h5file *files[3];
+  for (int i = 0; i < 3; ++i)
+    files[i] = f.open_h5file(names[i]);
+  for (int n = 0; n < 10; ++n) {
+    for (int i = 0; i < 3; ++i) {
+      f.set_output_compression(i ? 6 : 0, i == 2 ? tol : 0);
+      f.output_hdf5(Ez, gv.surroundings(), files[i], true);
+    }
+    for (int j = 0; j < 5; ++j)
+      f.step();
+  }
+
+  double *data[3], maxerr[3] = {0, 0, 0}, maxval = 0;
+  size_t dims[3][3], n = 1;
+  long size[3];
+  for (int i = 0; i < 3; ++i) {
+    delete files[i];
+    all_wait();
+    files[i] = f.open_h5file(names[i], h5file::READONLY);
+    int rank;
+    data[i] = (double *)files[i]->read("ez", &rank, dims[i], 3, false);
+    if (!data[i] || rank != 3) abort("failed to read %s", names[i]);
+    delete files[i];
+    FILE *fp = fopen(f.h5file_name(names[i]), "rb");
+    fseek(fp, 0, SEEK_END);
+    size[i] = ftell(fp);
+    fclose(fp);
+  }
+  for (int k = 0; k < 3; ++k)
+    n *= dims[0][k];
+  for (size_t j = 0; j < n; ++j) {
+    maxval = max(maxval, fabs(data[0][j]));
+    for (int i = 1; i < 3; ++i)
+      maxerr[i] = max(maxerr[i], fabs(data[i][j] - data[0][j]));
+  }
+  for (int i = 0; i < 3; ++i)
+    delete[] data[i];
+  master_printf("Compression: %ld bytes, deflate %ld bytes (err %g), lossy %ld bytes (err %g), "
+                "max %g\n",
+                size[0], size[1], maxerr[1], size[2], maxerr[2], maxval);
+  if (maxerr[1] != 0) abort("lossless compression changed the data");
+  if (maxerr[2] > tol) abort("lossy compression error %g > tolerance %g", maxerr[2], tol);
+  if (size[2] >= size[1] || size[1] >= size[0]) abort("compression didn't reduce the file size");
+  return true;
+}
+
 int main(int argc, char **argv) {
   const double a = 10.0;
   initialize mpi(argc, argv);
@@ -449,6 +512,34 @@ int main(int argc, char **argv) {
               return 1;
           }
       }
+
+  /* the same checks with asynchronous output (only supported for a single
+     process), for a few cases with an odd number of chunks */
+  if (count_processors() == 1) {
+    for (int splitting = 1; splitting <= 3; splitting += 2)
+      for (int use_real = 1; use_real >= 0; --use_real) {
+        char name[1024];
+        snprintf(name, 1024, "async_check_2d_tm_mirrory_%d_plane_ez%s", splitting,
+                 use_real ? "_r" : "");
+        master_printf("Checking %s...\n", name);
+        if (!check_2d(funky_eps_2d, a, splitting, Sf2[2], Sf2_kx[2], Sf2_ky[2], Ez, Ez, gv_2d[0],
+                      use_real, gv_2d_rank[0], name, temp_dir, true))
+          return 1;
+        snprintf(name, 1024, "async_check_2d_monitor_tm_identity_%d_hy%s", splitting,
+                 use_real ? "_r" : "");
+        master_printf("Checking %s...\n", name);
+        if (!check_2d_monitor(funky_eps_2d, a, splitting, Sf2[0], Ez, Hy, vec(pad1, pad2),
+                              use_real, name, temp_dir, true))
+          return 1;
+      }
+    master_printf("Checking async_check_3d_ezsrc_identity_3_plane_ex_r...\n");
+    if (!check_3d(funky_eps_3d, a, 3, Sf3[0], Ez, Ex, gv_3d[1], true, gv_3d_rank[1],
+                  "async_check_3d_ezsrc_identity_3_plane_ex_r", temp_dir, true))
+      return 1;
+  }
+
+  for (int splitting = 1; splitting <= 2; ++splitting)
+    if (!check_compression(a, splitting, temp_dir)) return 1;
 #endif /* HAVE_HDF5 */
 
   delete_directory(temp_dir);
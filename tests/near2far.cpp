@@ -25,6 +25,7 @@
 using namespace meep;
 using std::complex;
 using std::polar;
+using std::vector;
 
 double two(const vec &) { return 2.0; }
 
@@ -247,6 +248,165 @@ int check_2d_3d(ndim dim, const double xmax, double a, component c0, component c
   return 1;
 }
 
+/* Check that the FFT near-to-far transformation for far fields on a plane parallel to
+   a planar near-field surface agrees with the direct sum over near-field points, and
+   that the direct sum of get_farfields_array agrees with farfield at a few points. */
+int check_planar(ndim dim, double a, bool periodic) {
+  const double sxy = 4, sz = 3;
+  grid_volume gv = dim == D2 ? vol2d(sxy, sz, a) : vol3d(sxy, sxy, sz, a);
+  gv.center_origin();
+  const direction dn = dim == D2 ? Y : Z;
+  master_printf("TESTING %s FFT NEAR2FAR AT RESOLUTION %g%s...\n", dim == D2 ? "2D" : "3D", a,
+                periodic ? " (PERIODIC)" : "");
+
+  structure s(gv, two, pml(1.0, dn), dim == D2 || periodic ? identity() : mirror(Y, gv));
+  fields f(&s);
+  if (periodic) f.use_bloch(X, 0.1);
+  gaussian_src_time src(0.5, 0.2);
+  f.add_point_source(dim == D2 ? Ez : Ex, src, zero_vec(dim));
+  f.add_point_source(Hz, src, dim == D2 ? vec(0.3, -0.2) : vec(0.3, 0.0, -0.2), 0.5);
+  vec c0 = zero_vec(dim), c1 = zero_vec(dim);
+  LOOP_OVER_DIRECTIONS(dim, d) {
+    c0.set_direction(d, d == dn ? 0.4 : -0.5 * sxy);
+    c1.set_direction(d, d == dn ? 0.4 : 0.5 * sxy);
+  }
+  volume_list vl(volume(c0, c1), direction_component(Sx, dn), 1.0);
+  double freqs[2] = {0.45, 0.55};
+  dft_near2far n2f = f.add_dft_near2far(&vl, freqs, 2, periodic ? 3 : 1);
+  while (f.time() < 3)
+    f.step();
+
+  // a far-field plane whose grid is not commensurate with the near-field grid
+  vec f0 = zero_vec(dim), f1 = zero_vec(dim);
+  LOOP_OVER_DIRECTIONS(dim, d) {
+    f0.set_direction(d, d == dn ? 6.0 : -4.1);
+    f1.set_direction(d, d == dn ? 6.0 : (d == X ? 3.3 : 2.9));
+  }
+  int rank;
+  size_t dims[4] = {1, 1, 1, 1}, N = 1;
+  const double res = dim == D2 ? 7.3 : 3.3;
+  n2f.use_fft = false;
+  double *EH0 = n2f.get_farfields_array(volume(f0, f1), rank, dims, N, res);
+  n2f.use_fft = true;
+  double *EH = n2f.get_farfields_array(volume(f0, f1), rank, dims, N, res);
+  double diff = 0, norm = 0;
+  for (size_t i = 0; i < 6 * 2 * N * 2; ++i) {
+    diff += (EH[i] - EH0[i]) * (EH[i] - EH0[i]);
+    norm += EH0[i] * EH0[i];
+  }
+  delete[] EH;
+
+  // the direct sum (with batched Green's functions) should agree with farfield
+  double diff1 = 0, norm1 = 0;
+  for (size_t idx = 0; idx < N; idx += N / 7) {
+    const size_t ix = dim == D2 ? idx : idx / dims[1], iy = dim == D2 ? 0 : idx % dims[1];
+    vec x = f0;
+    x.set_direction(X, f0.x() + ix * (f1.x() - f0.x()) / (dims[0] - 1));
+    if (dim == D3) x.set_direction(Y, f0.y() + iy * (f1.y() - f0.y()) / (dims[1] - 1));
+    complex<double> *EH1 = n2f.farfield(x);
+    for (int i = 0; i < 2; ++i)
+      for (int k = 0; k < 6; ++k) {
+        complex<double> v(EH0[((k * 2 + 0) * N + idx) * 2 + i],
+                          EH0[((k * 2 + 1) * N + idx) * 2 + i]);
+        diff1 += std::norm(v - EH1[i * 6 + k]);
+        norm1 += std::norm(EH1[i * 6 + k]);
+      }
+    delete[] EH1;
+  }
+  delete[] EH0;
+  double relerr = sqrt(diff / norm), relerr1 = sqrt(diff1 / norm1);
+  master_printf("  FFT NEAR2FAR: %zd points, relerr = %g (direct sum relerr = %g)\n", N, relerr,
+                relerr1);
+  return relerr < 1e-5 && relerr1 < 1e-9;
+}
+
+/* the sum of the fields EH[6 * Nfreq] at x of the near-field points pts (from
+   near_field_points) over the periodic copies weighted by the smooth window
+   exp(-(n/Nw)^2), which converges to the lattice sum as Nw -> infinity */
+static void windowed_sum(complex<double> *EH, const dft_near2far &n2f, const vector<double> &pts,
+                         const vec &x, int Nw) {
+  const size_t Nfreq = n2f.freq.size(), stride = 8 + 2 * Nfreq;
+  vector<complex<double> > EH_local(6 * Nfreq, 0.0);
+  int nmax[2];
+  for (int j = 0; j < 2; ++j)
+    nmax[j] = n2f.periodic_d[j] == NO_DIRECTION ? 0 : 4 * Nw;
+  for (size_t n = 0; n < pts.size(); n += stride) {
+    vec x0 = zero_vec(x.dim);
+    LOOP_OVER_DIRECTIONS(x.dim, d) { x0.set_direction(d, pts[n + d]); }
+    for (int n0 = -nmax[0]; n0 <= nmax[0]; ++n0)
+      for (int n1 = -nmax[1]; n1 <= nmax[1]; ++n1) {
+        vec xs = x0;
+        for (int j = 0; j < 2; ++j)
+          if (n2f.periodic_d[j] != NO_DIRECTION)
+            xs.set_direction(n2f.periodic_d[j],
+                             x0.in_direction(n2f.periodic_d[j]) + (j ? n1 : n0) * n2f.period[j]);
+        complex<double> w = polar(exp(-double(n0 * n0 + n1 * n1) / (Nw * Nw)),
+                                  n0 * n2f.periodic_k[0] + n1 * n2f.periodic_k[1]);
+        for (size_t i = 0; i < Nfreq; ++i) {
+          complex<double> EH6[6], f0(pts[n + 8 + 2 * i], pts[n + 9 + 2 * i]);
+          (x.dim == D2 ? green2d : green3d)(EH6, x, n2f.freq[i], n2f.eps, n2f.mu, xs,
+                                            component(int(pts[n + 6])), f0 * w);
+          for (int k = 0; k < 6; ++k)
+            EH_local[6 * i + k] += EH6[k];
+        }
+      }
+  }
+  sum_to_all(EH_local.data(), EH, 6 * Nfreq);
+}
+
+/* Check the lattice sum over all periodic copies of a periodic near-field surface against
+   windowed sums over the copies (Richardson-extrapolated in the window size). */
+int check_lattice_sum(ndim dim, double a, int Nw) {
+  const double sp = 1.3, sn = 8;
+  grid_volume gv = dim == D2 ? vol2d(sp, sn, a) : vol3d(sp, 1.1, sn, a);
+  gv.center_origin();
+  const direction dn = dim == D2 ? Y : Z;
+  master_printf("TESTING %s LATTICE SUM AT RESOLUTION %g...\n", dim == D2 ? "2D" : "3D", a);
+
+  structure s(gv, two, pml(1.0, dn));
+  fields f(&s);
+  f.use_bloch(X, 0.15);
+  if (dim == D3) f.use_bloch(Y, -0.1);
+  gaussian_src_time src(0.3, 0.2);
+  vec x0 = zero_vec(dim);
+  x0.set_direction(X, 0.2);
+  x0.set_direction(dn, -1.0);
+  f.add_point_source(dim == D2 ? Ez : Ex, src, x0);
+  f.add_point_source(Hz, src, x0, 0.5);
+  vec c0 = zero_vec(dim), c1 = zero_vec(dim);
+  LOOP_OVER_DIRECTIONS(dim, d) {
+    c0.set_direction(d, d == dn ? 0.5 : -0.5 * gv.num_direction(d) / a);
+    c1.set_direction(d, d == dn ? 0.5 : 0.5 * gv.num_direction(d) / a);
+  }
+  volume_list vl(volume(c0, c1), direction_component(Sx, dn), 1.0);
+  double freqs[2] = {0.3, 0.35};
+  dft_near2far n2f = f.add_dft_near2far(&vl, freqs, 2, 2);
+  n2f.lattice_sum = true;
+  while (f.time() < 4)
+    f.step();
+
+  vector<double> pts = n2f.near_field_points();
+  double diff = 0, norm = 0;
+  for (int i = 0; i < 3; ++i) {
+    vec x = zero_vec(dim);
+    x.set_direction(X, -0.6 + 0.33 * i);
+    if (dim == D3) x.set_direction(Y, 0.3 - 0.15 * i);
+    x.set_direction(dn, 1.5 + 0.3 * i);
+    complex<double> *EH = n2f.farfield(x), EH1[12], EH2[12];
+    windowed_sum(EH1, n2f, pts, x, Nw);
+    windowed_sum(EH2, n2f, pts, x, 2 * Nw);
+    for (int k = 0; k < 12; ++k) {
+      complex<double> EH0 = (4.0 * EH2[k] - EH1[k]) / 3.0; // the error is ~ 1/Nw^2
+      diff += std::norm(EH[k] - EH0);
+      norm += std::norm(EH0);
+    }
+    delete[] EH;
+  }
+  double relerr = sqrt(diff / norm);
+  master_printf("  LATTICE SUM: relerr = %g\n", relerr);
+  return relerr < 2e-3;
+}
+
 int main(int argc, char **argv) {
   initialize mpi(argc, argv);
 
@@ -259,7 +419,12 @@ int main(int argc, char **argv) {
 #if defined(HAVE_JN) || defined(HAVE_LIBGSL) // required for Hankel functions in 2d near2far
   if (!check_2d_3d(D2, 8, a2d, Ez, Hx, false)) return 1;
   if (!check_2d_3d(D2, 8, a2d, Ex, Hz, true)) return 1;
+  if (!check_planar(D2, 10, false)) return 1;
+  if (!check_planar(D2, 10, true)) return 1;
+  if (!check_lattice_sum(D2, 20, 50)) return 1;
 #endif
+  if (!check_planar(D3, 10, false)) return 1;
+  if (!check_lattice_sum(D3, 10, 5)) return 1;
 
   return 0;
 }
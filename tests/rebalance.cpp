@@ -0,0 +1,109 @@
+/* Check that moving chunks between processes with fields::rebalance_chunks
+   in the middle of a run (with PML, dispersive materials, sources, and
+   DFT monitors) doesn't change the fields or the DFTs.  Every chunk with
+   DFT monitors (but no sources) is also moved explicitly with
+   fields::move_chunk.  Chunks can only move with more than one process
+   (the test is run with mpirun in MPI builds); serially, this only
+   checks that rebalance_chunks does nothing. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <meep.hpp>
+using namespace meep;
+using std::complex;
+using std::vector;
+
+static double eps(const vec &p) { return fabs(p.x() - 4) < 1 ? 4.0 : 1.0; }
+static double sigma(const vec &p) { return p.y() > 3 ? 0.5 : 0.0; }
+
+static void run(bool rebalance, bool real_fields, vector<complex<double> > &vals, double *flx) {
+  grid_volume gv = vol2d(8, 6, 10);
+  structure s(gv, eps, pml(1.0), identity(), 8);
+  s.add_susceptibility(sigma, E_stuff, lorentzian_susceptibility(1.1, 0.1));
+  fields f(&s);
+  if (real_fields) f.use_real_fields();
+  gaussian_src_time src(0.8, 0.5);
+  f.add_point_source(Ez, src, vec(2.1, 2.3));
+  f.add_point_source(Hz, src, vec(5.2, 4.1));
+  dft_flux flux = f.add_dft_flux_plane(volume(vec(6.5, 1), vec(6.5, 5)), 0.6, 1.0, 3);
+  component cs[2] = {Ey, Hz};
+  dft_fields dftf = f.add_dft_fields(cs, 2, volume(vec(1.5, 2.5), vec(7, 3.5)), 0.7, 0.9, 2);
+
+  while (f.time() < 6)
+    f.step();
+  if (rebalance) {
+    // pretend that the chunks of process 0 are expensive, to force some moves
+    for (int i = 0; i < f.num_chunks; ++i)
+      if (f.chunks[i]->is_mine()) f.chunks[i]->step_time = my_rank() == 0 ? 10 : 1;
+    if (f.rebalance_chunks() != (count_processors() > 1)) abort("unexpected rebalance_chunks");
+
+    const int nprocs = count_processors();
+    vector<int> move_mine(f.num_chunks), move(f.num_chunks);
+    for (int i = 0; i < f.num_chunks; ++i) {
+      move_mine[i] = f.chunks[i]->is_mine() && f.chunks[i]->dft_chunks;
+      FOR_FIELD_TYPES(ft) {
+        if (f.chunks[i]->sources[ft]) move_mine[i] = 0;
+      }
+    }
+    or_to_all(&move_mine[0], &move[0], f.num_chunks);
+    int num_moved = 0;
+    for (int i = 0; i < f.num_chunks && nprocs > 1; ++i)
+      if (move[i]) {
+        const int proc = (f.chunks[i]->n_proc() + 1) % nprocs;
+        f.move_chunk(i, proc);
+        if (f.chunks[i]->n_proc() != proc) abort("chunk %d was not moved", i);
+        num_moved++;
+      }
+    if (nprocs > 1 && num_moved == 0) abort("no chunks with DFT monitors were moved");
+  }
+  while (f.time() < 14)
+    f.step();
+
+  vals.clear();
+  for (double x = 0.35; x < 8; x += 0.9)
+    for (double y = 0.25; y < 6; y += 0.7) {
+      vals.push_back(f.get_field(Ez, vec(x, y)));
+      vals.push_back(f.get_field(Hz, vec(x, y)));
+      vals.push_back(f.get_field(Ex, vec(x, y)));
+    }
+  double *F = flux.flux();
+  for (int i = 0; i < 3; ++i)
+    flx[i] = F[i];
+  delete[] F;
+  for (int ic = 0; ic < 2; ++ic)
+    for (int i = 0; i < 2; ++i) {
+      int rank;
+      size_t dims[3];
+      complex<double> *a = f.get_dft_array(dftf, cs[ic], i, &rank, dims);
+      size_t n = 1;
+      for (int j = 0; j < rank; ++j)
+        n *= dims[j];
+      for (size_t j = 0; j < n; ++j)
+        vals.push_back(a[j]);
+      delete[] a;
+    }
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  verbosity = 0;
+  for (int real_fields = 0; real_fields < 2; ++real_fields) {
+    vector<complex<double> > vals0, vals1;
+    double flx0[3], flx1[3];
+    run(false, real_fields, vals0, flx0);
+    run(true, real_fields, vals1, flx1);
+    double maxval = 0, maxdiff = 0;
+    for (size_t i = 0; i < vals0.size(); ++i) {
+      maxval = std::max(maxval, abs(vals0[i]));
+      maxdiff = std::max(maxdiff, abs(vals0[i] - vals1[i]));
+    }
+    master_printf("%s fields: max difference %g (max field %g)\n", real_fields ? "real" : "complex",
+                  maxdiff, maxval);
+    if (maxdiff > 1e-12 * maxval) abort("fields changed by rebalancing chunks");
+    for (int i = 0; i < 3; ++i)
+      if (fabs(flx0[i] - flx1[i]) > 1e-12 * fabs(flx0[i]))
+        abort("flux changed by rebalancing chunks: %g vs. %g", flx0[i], flx1[i]);
+  }
+  return 0;
+}